@@ -59,6 +59,20 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized']), 64)
 
+        # The muhash set hash gives the same statistics, and is kept up to
+        # date across a disconnect and reconnect
+        res2 = node.gettxoutsetinfo("muhash")
+        for field in ['total_amount', 'transactions', 'height', 'txouts', 'bestblock']:
+            assert_equal(res2[field], res[field])
+        assert_equal(len(res2['muhash']), 64)
+
+        node.invalidateblock(res['bestblock'])
+        res3 = node.gettxoutsetinfo("muhash")
+        assert_equal(res3['height'], 199)
+        assert(res3['muhash'] != res2['muhash'])
+        node.reconsiderblock(res['bestblock'])
+        assert_equal(node.gettxoutsetinfo("muhash"), res2)
+
     def _test_getblockheader(self):
         node = self.nodes[0]
 
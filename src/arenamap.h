@@ -0,0 +1,409 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ARENAMAP_H
+#define BITCOIN_ARENAMAP_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map with the parts of the unordered_map interface the coins cache
+ * uses, laid out to spend as little memory per entry as possible.
+ *
+ * Entries are kept in an arena: chunks of nodes that grow geometrically up
+ * to MAX_CHUNK_NODES and are only freed by clear(). Erased nodes go to a
+ * free list and are reused, so there is no allocation (and no malloc
+ * overhead) per entry, and entries never move: pointers and references to
+ * them stay valid until they are erased, as in a node based map.
+ *
+ * The index is an open addressing table with linear probing, holding per
+ * slot a node pointer and a control byte with 7 bits of the hash, so probes
+ * past other keys rarely touch their nodes. Erased slots become tombstones,
+ * which keeps iterators other than the erased one valid; erase(it++) while
+ * iterating is fine. Inserting may rebuild the table, after which iterators
+ * can no longer be advanced, but still point to their entry.
+ *
+ * As every allocation is either a chunk or the table, DynamicMemoryUsage is
+ * exact up to malloc rounding.
+ */
+template <typename K, typename T, typename Hash = std::hash<K> >
+class arenamap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+    typedef Hash hasher;
+
+private:
+    union Node
+    {
+        Node* pnextFree;
+        typename std::aligned_storage<sizeof(value_type), std::alignment_of<value_type>::value>::type storage;
+
+        value_type* value() { return reinterpret_cast<value_type*>(&storage); }
+    };
+
+    static const uint8_t SLOT_EMPTY = 0;
+    static const uint8_t SLOT_DELETED = 1;
+    static const uint8_t SLOT_FULL = 0x80;
+    static const size_t MIN_SLOTS = 8;
+    static const size_t MIN_CHUNK_NODES = 4;
+    static const size_t MAX_CHUNK_NODES = 4096;
+
+    std::vector<std::pair<Node*, size_t> > vChunks;
+    size_t nChunkUsed;  //!< nodes handed out from the last chunk
+    size_t nNodes;      //!< nodes in all chunks
+    size_t nChunkUsage; //!< malloc usage of all chunks
+    Node* pfree;        //!< erased nodes
+
+    uint8_t* ctrl;
+    Node** slots;
+    size_t nSlots;      //!< zero or a power of two
+    size_t nSize;
+    size_t nDeleted;    //!< tombstone slots
+
+    Hash hash;
+
+    static uint8_t Control(size_t h) { return SLOT_FULL | (h >> (sizeof(size_t) * 8 - 7)); }
+
+    //! Move pos and node to the first full slot from pos on, or to end()
+    void Seek(size_t& pos, Node*& node) const
+    {
+        for (; pos < nSlots; pos++) {
+            if (ctrl[pos] & SLOT_FULL) {
+                node = slots[pos];
+                return;
+            }
+        }
+        node = NULL;
+    }
+
+    size_t FindSlot(const K& key) const
+    {
+        if (nSize == 0)
+            return nSlots;
+        const size_t h = hash(key);
+        const uint8_t c = Control(h);
+        const size_t mask = nSlots - 1;
+        for (size_t pos = h & mask;; pos = (pos + 1) & mask) {
+            if (ctrl[pos] == SLOT_EMPTY)
+                return nSlots;
+            if (ctrl[pos] == c && slots[pos]->value()->first == key)
+                return pos;
+        }
+    }
+
+    void Rehash(size_t nSlotsNew)
+    {
+        uint8_t* ctrlNew = new uint8_t[nSlotsNew]();
+        Node** slotsNew;
+        try {
+            slotsNew = new Node*[nSlotsNew];
+        } catch (...) {
+            delete[] ctrlNew;
+            throw;
+        }
+        const size_t mask = nSlotsNew - 1;
+        for (size_t i = 0; i < nSlots; i++) {
+            if (!(ctrl[i] & SLOT_FULL))
+                continue;
+            const size_t h = hash(slots[i]->value()->first);
+            size_t pos = h & mask;
+            while (ctrlNew[pos] != SLOT_EMPTY)
+                pos = (pos + 1) & mask;
+            ctrlNew[pos] = Control(h);
+            slotsNew[pos] = slots[i];
+        }
+        delete[] ctrl;
+        delete[] slots;
+        ctrl = ctrlNew;
+        slots = slotsNew;
+        nSlots = nSlotsNew;
+        nDeleted = 0;
+    }
+
+    Node* AllocateNode()
+    {
+        if (pfree) {
+            Node* node = pfree;
+            pfree = node->pnextFree;
+            return node;
+        }
+        if (vChunks.empty() || nChunkUsed == vChunks.back().second) {
+            const size_t nChunk = nNodes < MIN_CHUNK_NODES ? MIN_CHUNK_NODES : nNodes > MAX_CHUNK_NODES ? MAX_CHUNK_NODES : nNodes;
+            Node* chunk = static_cast<Node*>(::operator new(nChunk * sizeof(Node)));
+            try {
+                vChunks.push_back(std::make_pair(chunk, nChunk));
+            } catch (...) {
+                ::operator delete(chunk);
+                throw;
+            }
+            nChunkUsed = 0;
+            nNodes += nChunk;
+            nChunkUsage += memusage::MallocUsage(nChunk * sizeof(Node));
+        }
+        return &vChunks.back().first[nChunkUsed++];
+    }
+
+    void FreeNode(Node* node)
+    {
+        node->pnextFree = pfree;
+        pfree = node;
+    }
+
+    void EraseSlot(size_t pos)
+    {
+        Node* node = slots[pos];
+        // A slot followed by an empty one ends no probe sequence that could
+        // still need it, so it can be emptied instead of becoming a tombstone.
+        if (ctrl[(pos + 1) & (nSlots - 1)] == SLOT_EMPTY) {
+            ctrl[pos] = SLOT_EMPTY;
+        } else {
+            ctrl[pos] = SLOT_DELETED;
+            nDeleted++;
+        }
+        nSize--;
+        node->value()->~value_type();
+        FreeNode(node);
+    }
+
+public:
+    class const_iterator;
+
+    class iterator
+    {
+        friend class arenamap;
+        friend class const_iterator;
+
+        const arenamap* map;
+        size_t pos;
+        Node* node;
+
+        iterator(const arenamap* mapIn, size_t posIn, Node* nodeIn) : map(mapIn), pos(posIn), node(nodeIn) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename arenamap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        iterator() : map(NULL), pos(0), node(NULL) {}
+
+        reference operator*() const { return *node->value(); }
+        pointer operator->() const { return node->value(); }
+        iterator& operator++() { map->Seek(++pos, node); return *this; }
+        iterator operator++(int) { iterator copy(*this); ++*this; return copy; }
+        bool operator==(const iterator& other) const { return node == other.node; }
+        bool operator!=(const iterator& other) const { return node != other.node; }
+    };
+
+    class const_iterator
+    {
+        friend class arenamap;
+
+        const arenamap* map;
+        size_t pos;
+        Node* node;
+
+        const_iterator(const arenamap* mapIn, size_t posIn, Node* nodeIn) : map(mapIn), pos(posIn), node(nodeIn) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef const typename arenamap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef value_type& reference;
+
+        const_iterator() : map(NULL), pos(0), node(NULL) {}
+        const_iterator(const iterator& it) : map(it.map), pos(it.pos), node(it.node) {}
+
+        reference operator*() const { return *node->value(); }
+        pointer operator->() const { return node->value(); }
+        const_iterator& operator++() { map->Seek(++pos, node); return *this; }
+        const_iterator operator++(int) { const_iterator copy(*this); ++*this; return copy; }
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.node == b.node; }
+        friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.node != b.node; }
+    };
+
+    explicit arenamap(const Hash& hashIn = Hash()) : nChunkUsed(0), nNodes(0), nChunkUsage(0), pfree(NULL), ctrl(NULL), slots(NULL), nSlots(0), nSize(0), nDeleted(0), hash(hashIn) {}
+    arenamap(arenamap&& other) : arenamap(other.hash) { swap(other); }
+    arenamap& operator=(arenamap&& other) { clear(); swap(other); return *this; }
+    arenamap(const arenamap&) = delete;
+    arenamap& operator=(const arenamap&) = delete;
+    ~arenamap() { clear(); }
+
+    iterator begin() { size_t pos = 0; Node* node; Seek(pos, node); return iterator(this, pos, node); }
+    const_iterator begin() const { size_t pos = 0; Node* node; Seek(pos, node); return const_iterator(this, pos, node); }
+    iterator end() { return iterator(this, nSlots, NULL); }
+    const_iterator end() const { return const_iterator(this, nSlots, NULL); }
+
+    size_type size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const K& key)
+    {
+        const size_t pos = FindSlot(key);
+        return pos == nSlots ? end() : iterator(this, pos, slots[pos]);
+    }
+
+    const_iterator find(const K& key) const
+    {
+        const size_t pos = FindSlot(key);
+        return pos == nSlots ? end() : const_iterator(this, pos, slots[pos]);
+    }
+
+    size_type count(const K& key) const { return FindSlot(key) == nSlots ? 0 : 1; }
+
+    //! Insert (key, value) unless key is present. value is not used up then.
+    template <typename V>
+    std::pair<iterator, bool> emplace(const K& key, V&& value)
+    {
+        if (nSlots == 0)
+            Rehash(MIN_SLOTS);
+        const size_t h = hash(key);
+        const uint8_t c = Control(h);
+        size_t mask = nSlots - 1;
+        size_t pos = h & mask;
+        size_t posInsert = nSlots;
+        for (;; pos = (pos + 1) & mask) {
+            if (ctrl[pos] == SLOT_EMPTY)
+                break;
+            if (ctrl[pos] == SLOT_DELETED) {
+                if (posInsert == nSlots)
+                    posInsert = pos;
+            } else if (ctrl[pos] == c && slots[pos]->value()->first == key) {
+                return std::make_pair(iterator(this, pos, slots[pos]), false);
+            }
+        }
+
+        Node* node = AllocateNode();
+        try {
+            new (&node->storage) value_type(key, std::forward<V>(value));
+        } catch (...) {
+            FreeNode(node);
+            throw;
+        }
+        if (posInsert == nSlots) {
+            // Using up an empty slot: keep at least one in eight slots empty
+            // so that probes stay short, growing if tombstones are not enough.
+            if ((nSize + nDeleted + 1) * 8 > nSlots * 7) {
+                try {
+                    Rehash((nSize + 1) * 16 > nSlots * 7 ? nSlots * 2 : nSlots);
+                } catch (...) {
+                    node->value()->~value_type();
+                    FreeNode(node);
+                    throw;
+                }
+                mask = nSlots - 1;
+                for (pos = h & mask; ctrl[pos] != SLOT_EMPTY; pos = (pos + 1) & mask) {}
+            }
+            posInsert = pos;
+        } else {
+            nDeleted--;
+        }
+        ctrl[posInsert] = c;
+        slots[posInsert] = node;
+        nSize++;
+        return std::make_pair(iterator(this, posInsert, node), true);
+    }
+
+    template <typename P>
+    std::pair<iterator, bool> insert(P&& p) { return emplace(p.first, std::forward<P>(p).second); }
+
+    T& operator[](const K& key) { return emplace(key, T()).first->second; }
+
+    iterator erase(const_iterator it)
+    {
+        size_t pos = it.pos;
+        if (pos >= nSlots || !(ctrl[pos] & SLOT_FULL) || slots[pos] != it.node) {
+            // The table was rebuilt since it was obtained
+            pos = FindSlot(it.node->value()->first);
+            assert(pos < nSlots);
+        }
+        iterator next(this, pos + 1, NULL);
+        Seek(next.pos, next.node);
+        EraseSlot(pos);
+        return next;
+    }
+
+    size_type erase(const K& key)
+    {
+        const size_t pos = FindSlot(key);
+        if (pos == nSlots)
+            return 0;
+        EraseSlot(pos);
+        return 1;
+    }
+
+    //! Remove all entries and release all memory
+    void clear()
+    {
+        for (size_t i = 0; i < nSlots; i++) {
+            if (ctrl[i] & SLOT_FULL)
+                slots[i]->value()->~value_type();
+        }
+        for (size_t i = 0; i < vChunks.size(); i++)
+            ::operator delete(vChunks[i].first);
+        std::vector<std::pair<Node*, size_t> >().swap(vChunks);
+        delete[] ctrl;
+        delete[] slots;
+        ctrl = NULL;
+        slots = NULL;
+        pfree = NULL;
+        nChunkUsed = nNodes = nChunkUsage = 0;
+        nSlots = nSize = nDeleted = 0;
+    }
+
+    void swap(arenamap& other)
+    {
+        vChunks.swap(other.vChunks);
+        std::swap(nChunkUsed, other.nChunkUsed);
+        std::swap(nNodes, other.nNodes);
+        std::swap(nChunkUsage, other.nChunkUsage);
+        std::swap(pfree, other.pfree);
+        std::swap(ctrl, other.ctrl);
+        std::swap(slots, other.slots);
+        std::swap(nSlots, other.nSlots);
+        std::swap(nSize, other.nSize);
+        std::swap(nDeleted, other.nDeleted);
+        std::swap(hash, other.hash);
+    }
+
+    //! Slots in the index
+    size_t bucket_count() const { return nSlots; }
+
+    //! Memory of the arena and index, not including what entries allocate themselves
+    size_t DynamicMemoryUsage() const
+    {
+        return nChunkUsage + memusage::MallocUsage(vChunks.capacity() * sizeof(vChunks[0])) +
+               memusage::MallocUsage(nSlots) + memusage::MallocUsage(nSlots * sizeof(Node*));
+    }
+};
+
+namespace memusage
+{
+
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const arenamap<X, Y, Z>& m)
+{
+    return m.DynamicMemoryUsage();
+}
+
+}
+
+#endif // BITCOIN_ARENAMAP_H
@@ -5,10 +5,13 @@
 #include "bench.h"
 #include "coins.h"
 #include "policy/policy.h"
+#include "random.h"
 #include "wallet/crypter.h"
 
 #include <vector>
 
+#include <boost/unordered_map.hpp>
+
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
 //
 // Helper: create two dummy transactions, each with
@@ -85,3 +88,38 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching);
+
+// The coins cache workload, on the map type the cache used before and on
+// CCoinsMap: fill a map, look every entry up, then erase it again.
+template <typename Map>
+static void CoinsMapWorkload(benchmark::State& state)
+{
+    const int nEntries = 10000;
+    std::vector<uint256> vTxid(nEntries);
+    for (int i = 0; i < nEntries; i++)
+        vTxid[i] = GetRandHash();
+
+    while (state.KeepRunning()) {
+        Map map;
+        for (const uint256& txid : vTxid)
+            map.insert(std::make_pair(txid, CCoinsCacheEntry()));
+        for (const uint256& txid : vTxid)
+            assert(map.find(txid) != map.end());
+        for (const uint256& txid : vTxid)
+            map.erase(txid);
+        assert(map.empty());
+    }
+}
+
+static void CCoinsMapBoost(benchmark::State& state)
+{
+    CoinsMapWorkload<boost::unordered_map<uint256, CCoinsCacheEntry, SaltedTxidHasher> >(state);
+}
+
+static void CCoinsMapArena(benchmark::State& state)
+{
+    CoinsMapWorkload<CCoinsMap>(state);
+}
+
+BENCHMARK(CCoinsMapBoost);
+BENCHMARK(CCoinsMapArena);
@@ -58,3 +58,39 @@ static void CoinSelection(benchmark::State& state)
 }
 
 BENCHMARK(CoinSelection);
+
+// Wallets with many small outputs, as kept by a service that receives
+// grants and pays them out. The coins are made once; only the selection
+// is measured, with and without the search for a selection without change.
+static void CoinSelectionLarge(benchmark::State& state, int nCoins, bool fBnB)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    // Grants between 0.01 and 10 coins
+    for (int i = 0; i < nCoins; i++)
+        addCoin(CENT + (i * 7919 % 1000) * CENT, wallet, vCoins);
+    const CCoinSelectionParams params(CFeeRate(10000));
+
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(2505 * COIN / 10, 1, 6, 0, vCoins, setCoinsRet, nValueRet, fBnB ? &params : NULL);
+        assert(success);
+        assert(nValueRet >= 2505 * COIN / 10);
+    }
+
+    BOOST_FOREACH (const COutput& output, vCoins)
+        delete output.tx;
+}
+
+static void CoinSelection10k(benchmark::State& state) { CoinSelectionLarge(state, 10000, false); }
+static void CoinSelection100k(benchmark::State& state) { CoinSelectionLarge(state, 100000, false); }
+static void CoinSelectionBnB10k(benchmark::State& state) { CoinSelectionLarge(state, 10000, true); }
+static void CoinSelectionBnB100k(benchmark::State& state) { CoinSelectionLarge(state, 100000, true); }
+
+BENCHMARK(CoinSelection10k);
+BENCHMARK(CoinSelection100k);
+BENCHMARK(CoinSelectionBnB10k);
+BENCHMARK(CoinSelectionBnB100k);
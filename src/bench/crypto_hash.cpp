@@ -10,6 +10,7 @@
 #include "uint256.h"
 #include "utiltime.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
@@ -69,10 +70,30 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+/* Number of block headers to scrypt per iteration */
+static const size_t SCRYPT_HEADERS = 64;
+
+static void Scrypt(benchmark::State& state)
+{
+    std::vector<char> in(80 * SCRYPT_HEADERS, 0), out(32 * SCRYPT_HEADERS);
+    while (state.KeepRunning())
+        for (size_t i = 0; i < SCRYPT_HEADERS; i++)
+            scrypt_1024_1_1_256(&in[80 * i], &out[32 * i]);
+}
+
+static void Scrypt_batch(benchmark::State& state)
+{
+    std::vector<char> in(80 * SCRYPT_HEADERS, 0), out(32 * SCRYPT_HEADERS);
+    while (state.KeepRunning())
+        scrypt_1024_1_1_256_batch(in.data(), out.data(), SCRYPT_HEADERS);
+}
+
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
+BENCHMARK(Scrypt);
+BENCHMARK(Scrypt_batch);
 
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
@@ -20,6 +20,29 @@ void CChain::SetTip(CBlockIndex *pindex) {
     }
 }
 
+CChainSnapshot::CChainSnapshot(const CChain& chain, const CChainSnapshot* pprev) : nHeight(chain.Height()) {
+    int nChunks = (nHeight + CHUNK_SIZE) / CHUNK_SIZE;
+    vChunks.reserve(nChunks);
+    for (int i = 0; i < nChunks; i++) {
+        int nBegin = i * CHUNK_SIZE;
+        int nEnd = nHeight + 1 < nBegin + CHUNK_SIZE ? nHeight + 1 : nBegin + CHUNK_SIZE;
+        // A chunk of the previous snapshot is still valid if it has the same
+        // size and ends at the same block, as every entry links to the next.
+        if (pprev && i < (int)pprev->vChunks.size()) {
+            const std::shared_ptr<const Chunk>& chunk = pprev->vChunks[i];
+            if ((int)chunk->size() == nEnd - nBegin && chunk->back() == chain[nEnd - 1]) {
+                vChunks.push_back(chunk);
+                continue;
+            }
+        }
+        std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+        chunk->reserve(nEnd - nBegin);
+        for (int nHeightIn = nBegin; nHeightIn < nEnd; nHeightIn++)
+            chunk->push_back(chain[nHeightIn]);
+        vChunks.push_back(chunk);
+    }
+}
+
 CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const {
     int nStep = 1;
     std::vector<uint256> vHave;
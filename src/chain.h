@@ -13,6 +13,7 @@
 #include "uint256.h"
 #include "utilmoneystr.h"
 
+#include <memory>
 #include <vector>
 
 class CBlockFileInfo
@@ -225,6 +226,11 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) SolarCoin: cached GetPoSKernelPS() and GetAverageStakeWeight() of this block, set once
+    //! under cs_main by SetStakeWeightCache() when the entry is added or loaded, negative until then
+    double dKernelPS;
+    double dAverageStakeWeight;
+
     void SetNull()
     {
         phashBlock = NULL;
@@ -240,6 +246,8 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        dKernelPS = -1;
+        dAverageStakeWeight = -1;
 
         nMint = 0;
         nMoneySupply = 0;
@@ -599,4 +607,56 @@ public:
     CBlockIndex* FindEarliestAtLeast(int64_t nTime) const;
 };
 
+/**
+ * An immutable copy of a CChain, published by validation every time the tip
+ * changes so that readers (RPC and REST) can walk the active chain without
+ * holding cs_main. The entries are kept in fixed size chunks which are shared
+ * with the previous snapshot as long as they are unchanged, so publishing a
+ * new tip only copies the last chunk.
+ */
+class CChainSnapshot {
+private:
+    static const int CHUNK_SIZE = 1024;
+    typedef std::vector<const CBlockIndex*> Chunk;
+    std::vector<std::shared_ptr<const Chunk> > vChunks;
+    int nHeight;
+
+public:
+    /** An empty chain. */
+    CChainSnapshot() : nHeight(-1) {}
+
+    /** Copy chain, reusing the chunks of pprev (if any) that did not change. */
+    CChainSnapshot(const CChain& chain, const CChainSnapshot* pprev);
+
+    /** Returns the index entry at a particular height in this chain, or NULL if no such height exists. */
+    const CBlockIndex *operator[](int nHeightIn) const {
+        if (nHeightIn < 0 || nHeightIn > nHeight)
+            return NULL;
+        return (*vChunks[nHeightIn / CHUNK_SIZE])[nHeightIn % CHUNK_SIZE];
+    }
+
+    /** Returns the index entry for the tip of this chain, or NULL if none. */
+    const CBlockIndex *Tip() const {
+        return (*this)[nHeight];
+    }
+
+    /** Efficiently check whether a block is present in this chain. */
+    bool Contains(const CBlockIndex *pindex) const {
+        return pindex != NULL && (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Find the successor of a block in this chain, or NULL if the given index is not found or is the tip. */
+    const CBlockIndex *Next(const CBlockIndex *pindex) const {
+        if (Contains(pindex))
+            return (*this)[pindex->nHeight + 1];
+        else
+            return NULL;
+    }
+
+    /** Return the maximal height in the chain. Is equal to chain.Tip() ? chain.Tip()->nHeight : -1. */
+    int Height() const {
+        return nHeight;
+    }
+};
+
 #endif // BITCOIN_CHAIN_H
@@ -46,6 +46,7 @@ bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return 0; }
+bool CCoinsView::Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const { return false; }
 
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
@@ -53,8 +54,10 @@ bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { retu
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
+CCoinsView &CCoinsViewBacked::GetBackend() const { return *base; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
+bool CCoinsViewBacked::Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const { return base->Cursors(nShards, vCursors); }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
@@ -82,11 +85,26 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const
         // The parent only has an empty entry for this txid; we can consider our
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
+    } else {
+        ret->second.SetBase(ret->second.coins);
     }
-    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
+    cachedCoinsUsage += ret->second.DynamicMemoryUsage();
     return ret;
 }
 
+void CCoinsViewCache::AddFetchedCoins(const uint256 &txid, CCoins &coins) {
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second)
+        return;
+    coins.swap(ret.first->second.coins);
+    if (ret.first->second.coins.IsPruned()) {
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    } else {
+        ret.first->second.SetBase(ret.first->second.coins);
+    }
+    cachedCoinsUsage += ret.first->second.DynamicMemoryUsage();
+}
+
 bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
     CCoinsMap::const_iterator it = FetchCoins(txid);
     if (it != cacheCoins.end()) {
@@ -108,9 +126,11 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
         } else if (ret.first->second.coins.IsPruned()) {
             // The parent view only has a pruned entry for this; mark it as fresh.
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        } else {
+            ret.first->second.SetBase(ret.first->second.coins);
         }
     } else {
-        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+        cachedCoinUsage = ret.first->second.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
@@ -134,6 +154,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
 CCoinsModifier CCoinsViewCache::ModifyNewCoins(const uint256 &txid, bool coinbase) {
     assert(!hasModifier);
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    size_t cachedCoinUsage = ret.second ? 0 : ret.first->second.DynamicMemoryUsage();
     if (!coinbase) {
         // New coins must not already exist.
         if (!ret.first->second.coins.IsPruned())
@@ -146,10 +167,14 @@ CCoinsModifier CCoinsViewCache::ModifyNewCoins(const uint256 &txid, bool coinbas
             // to mark this fresh.
             ret.first->second.flags |= CCoinsCacheEntry::FRESH;
         }
+    } else if (!(ret.first->second.flags & CCoinsCacheEntry::FRESH)) {
+        // A duplicate coinbase replaces whatever outputs the parent view has,
+        // and we did not load them.
+        ret.first->second.fBaseUnknown = true;
     }
     ret.first->second.coins.Clear();
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first, 0);
+    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
 static const CCoins coinEmpty; // 0.15.1
@@ -199,7 +224,11 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // and move the data up and mark it as dirty
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
-                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+                    // Without an entry of our own, our view of this txid is our
+                    // parent's, which the child recorded when it loaded it.
+                    entry.vBaseUnspent.swap(it->second.vBaseUnspent);
+                    entry.fBaseUnknown = it->second.fBaseUnknown;
+                    cachedCoinsUsage += entry.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
                     // We can mark it FRESH in the parent if it was FRESH in the child
                     // Otherwise it might have just been flushed from the parent's cache
@@ -220,14 +249,16 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
-                    // A normal modification.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    // A normal modification. Our own vBaseUnspent still
+                    // describes our parent, so only the coins move up.
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
-                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage += itUs->second.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.fBaseUnknown |= it->second.fBaseUnknown;
                     // NOTE: It is possible the child has a FRESH flag here in
                     // the event the entry we found in the parent is pruned. But
                     // we must not copy that FRESH flag to the parent as that
@@ -254,7 +285,7 @@ void CCoinsViewCache::Uncache(const uint256& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
     if (it != cacheCoins.end() && it->second.flags == 0) {
-        cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+        cachedCoinsUsage -= it->second.DynamicMemoryUsage();
         cacheCoins.erase(it);
     }
 }
@@ -318,6 +349,11 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight, CAmount
 CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
+    const CCoins& coins = it->second.coins;
+    fHadUnspent = !coins.IsPruned();
+    nHeightBefore = coins.nHeight;
+    nVersionBefore = coins.nVersion;
+    fCoinBaseBefore = coins.fCoinBase;
 }
 
 CCoinsModifier::~CCoinsModifier()
@@ -329,8 +365,13 @@ CCoinsModifier::~CCoinsModifier()
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
     } else {
+        const CCoins& coins = it->second.coins;
+        // Outputs kept across a change of transaction metadata must be
+        // rewritten as well, not only the ones that were added or spent.
+        if (fHadUnspent && !coins.IsPruned() && (coins.nHeight != nHeightBefore || coins.nVersion != nVersionBefore || coins.fCoinBase != fCoinBaseBefore))
+            it->second.fBaseUnknown = true;
         // If the coin still exists after the modification, add the new usage
-        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+        cache.cachedCoinsUsage += it->second.DynamicMemoryUsage();
     }
 }
 
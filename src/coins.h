@@ -6,6 +6,7 @@
 #ifndef BITCOIN_COINS_H
 #define BITCOIN_COINS_H
 
+#include "arenamap.h"
 #include "compressor.h"
 #include "core_memusage.h"
 #include "hash.h"
@@ -16,8 +17,10 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <memory>
+#include <vector>
+
 #include <boost/foreach.hpp>
-#include <boost/unordered_map.hpp>
 
 /** 
  * Pruned version of CTransaction: only retains metadata and unspent transaction outputs
@@ -258,7 +261,7 @@ class SaltedTxidHasher
 {
 private:
     /** Salt */
-    const uint64_t k0, k1;
+    uint64_t k0, k1;
 
 public:
     SaltedTxidHasher();
@@ -277,6 +280,13 @@ struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    /**
+     * Which outputs the parent view had unspent when this entry was loaded,
+     * so that the coin database can write and erase only the outputs that
+     * changed instead of the whole transaction. Empty for FRESH entries.
+     */
+    std::vector<bool> vBaseUnspent;
+    bool fBaseUnknown; // The entry was overwritten without loading the parent's version, so vBaseUnspent cannot be trusted.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -288,10 +298,24 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    CCoinsCacheEntry() : coins(), flags(0), fBaseUnknown(false) {}
+
+    void SetBase(const CCoins& base) {
+        vBaseUnspent.assign(base.vout.size(), false);
+        for (unsigned int i = 0; i < base.vout.size(); i++)
+            vBaseUnspent[i] = !base.vout[i].IsNull();
+    }
+
+    bool IsBaseUnspent(unsigned int nPos) const {
+        return nPos < vBaseUnspent.size() && vBaseUnspent[nPos];
+    }
+
+    size_t DynamicMemoryUsage() const {
+        return coins.DynamicMemoryUsage() + (vBaseUnspent.capacity() ? memusage::MallocUsage((vBaseUnspent.capacity() + 7) / 8) : 0);
+    }
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, SaltedTxidHasher> CCoinsMap;
+typedef arenamap<uint256, CCoinsCacheEntry, SaltedTxidHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -335,6 +359,11 @@ public:
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
 
+    //! Get up to nShards cursors over disjoint txid ranges of one consistent
+    //! state, which together cover all of it. Returns false if the view
+    //! cannot be iterated in parts.
+    virtual bool Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -352,8 +381,10 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView &GetBackend() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+    bool Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const;
 };
 
 
@@ -369,7 +400,10 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    size_t cachedCoinUsage; // Cached memory usage of the cache entry before modification
+    bool fHadUnspent; // Whether the CCoins had unspent outputs before modification
+    int nHeightBefore, nVersionBefore; // Transaction metadata before modification
+    bool fCoinBaseBefore;
     CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
@@ -415,6 +449,14 @@ public:
      */
     bool HaveCoinsInCache(const uint256 &txid) const;
 
+    /**
+     * Add coins that were read from the backing view by someone else (e.g. an
+     * input prefetcher), as if they had been fetched through this cache. Does
+     * nothing if txid is already cached. The backing view must not have been
+     * modified since the coins were read. Swaps coins.
+     */
+    void AddFetchedCoins(const uint256 &txid, CCoins &coins);
+
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
      * more efficient than GetCoins. Modifications to other cache entries are
@@ -0,0 +1,221 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Most threads a scan uses
+const int MAX_SCAN_THREADS = 16;
+
+/**
+ * The set element of an unspent output is its outpoint followed by the
+ * output. Height and coinbase flag are left out, as undo data only has them
+ * for the last output of a transaction.
+ */
+void ApplyOutput(MuHash3072& muhash, const uint256& txid, uint32_t n, const CTxOut& out, bool fInsert)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << COutPoint(txid, n) << out;
+    if (fInsert)
+        muhash.Insert((const unsigned char*)ss.data(), ss.size());
+    else
+        muhash.Remove((const unsigned char*)ss.data(), ss.size());
+}
+
+}
+
+CCoinsStatsCache coinsStatsCache;
+
+CCoinsStatsCache::CPart& CCoinsStatsCache::CPart::operator+=(const CPart& other)
+{
+    muhash *= other.muhash;
+    nTransactions += other.nTransactions;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nTotalAmount += other.nTotalAmount;
+    return *this;
+}
+
+CCoinsStatsCache::CCoinsStatsCache() : fValid(false), fScanning(false), nHeight(0)
+{
+}
+
+void CCoinsStatsCache::Clear()
+{
+    LOCK(cs_main);
+    fValid = false;
+    part = CPart();
+    hashBlock.SetNull();
+    nHeight = 0;
+}
+
+void CCoinsStatsCache::UpdateTip(const CCoinsViewCache& viewOld, const CCoinsViewCache& viewNew, const CBlock& block, const CBlockIndex* pindexNew)
+{
+    AssertLockHeld(cs_main);
+    if (!fValid && !fScanning)
+        return;
+    CPart& delta = fValid ? part : partScanDelta;
+
+    // Every coin a block changes belongs to one of its transactions or to
+    // one they spend.
+    std::vector<uint256> vTxid;
+    for (const auto& tx : block.vtx) {
+        vTxid.push_back(tx->GetHash());
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin)
+            vTxid.push_back(txin.prevout.hash);
+    }
+    std::sort(vTxid.begin(), vTxid.end());
+    vTxid.erase(std::unique(vTxid.begin(), vTxid.end()), vTxid.end());
+
+    for (const uint256& txid : vTxid) {
+        const CCoins* pcoinsOld = viewOld.AccessCoins(txid);
+        const CCoins* pcoinsNew = viewNew.AccessCoins(txid);
+        delta.nTransactions += (pcoinsNew && !pcoinsNew->IsPruned()) - (pcoinsOld && !pcoinsOld->IsPruned());
+        size_t nOutputs = std::max(pcoinsOld ? pcoinsOld->vout.size() : 0, pcoinsNew ? pcoinsNew->vout.size() : 0);
+        for (size_t n = 0; n < nOutputs; n++) {
+            bool fOld = pcoinsOld && pcoinsOld->IsAvailable(n);
+            bool fNew = pcoinsNew && pcoinsNew->IsAvailable(n);
+            if (fOld == fNew)
+                continue;
+            const CTxOut& out = fNew ? pcoinsNew->vout[n] : pcoinsOld->vout[n];
+            ApplyOutput(delta.muhash, txid, n, out, fNew);
+            delta.nTransactionOutputs += fNew ? 1 : -1;
+            delta.nTotalAmount += fNew ? out.nValue : -out.nValue;
+        }
+    }
+
+    if (fValid) {
+        hashBlock = pindexNew->GetBlockHash();
+        nHeight = pindexNew->nHeight;
+    }
+}
+
+bool CCoinsStatsCache::ScanPart(CCoinsViewCursor* pcursor, CPart& part, const std::atomic<bool>& fAbort)
+{
+    try {
+        while (pcursor->Valid()) {
+            if (fAbort)
+                return false;
+            uint256 txid;
+            CCoins coins;
+            if (!pcursor->GetKey(txid) || !pcursor->GetValue(coins))
+                return error("%s: unable to read value", __func__);
+            part.nTransactions++;
+            for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                const CTxOut& out = coins.vout[n];
+                if (out.IsNull())
+                    continue;
+                ApplyOutput(part.muhash, txid, n, out, true);
+                part.nTransactionOutputs++;
+                part.nTotalAmount += out.nValue;
+            }
+            pcursor->Next();
+        }
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool CCoinsStatsCache::GetStats(CCoinsView* view, CCoinsStats& stats)
+{
+    LOCK(cs_scan);
+
+    std::vector<std::unique_ptr<CCoinsViewCursor> > vCursors;
+    uint256 hashScanBlock;
+    {
+        LOCK(cs_main);
+        if (!fValid) {
+            // The cursors read the coin database, so it has to be at the tip.
+            FlushStateToDisk();
+            int nShards = std::max(1, std::min(GetNumCores(), MAX_SCAN_THREADS));
+            if (!view->Cursors(nShards, vCursors)) {
+                vCursors.clear();
+                vCursors.emplace_back(view->Cursor());
+            }
+            hashScanBlock = vCursors[0]->GetBestBlock();
+            fScanning = true;
+            partScanDelta = CPart();
+        }
+    }
+
+    if (!vCursors.empty()) {
+        int64_t nStart = GetTimeMicros();
+        std::vector<CPart> vParts(vCursors.size());
+        std::unique_ptr<bool[]> vResult(new bool[vCursors.size()]);
+        std::atomic<bool> fAbort(false);
+        boost::thread_group threads;
+        for (size_t i = 0; i < vCursors.size(); i++) {
+            CCoinsViewCursor* pcursor = vCursors[i].get();
+            CPart* ppart = &vParts[i];
+            bool* pfResult = &vResult[i];
+            threads.create_thread([pcursor, ppart, pfResult, &fAbort] {
+                RenameThread("bitcoin-coinstats");
+                *pfResult = ScanPart(pcursor, *ppart, fAbort);
+            });
+        }
+        try {
+            threads.join_all();
+        } catch (const boost::thread_interrupted&) {
+            fAbort = true;
+            threads.join_all();
+            LOCK(cs_main);
+            fScanning = false;
+            throw;
+        }
+
+        LOCK(cs_main);
+        fScanning = false;
+        for (size_t i = 0; i < vCursors.size(); i++) {
+            if (!vResult[i])
+                return false;
+        }
+        part = CPart();
+        for (const CPart& partScanned : vParts)
+            part += partScanned;
+        // Blocks connected or disconnected while the scan ran
+        part += partScanDelta;
+        fValid = true;
+        hashFinalizedBlock.SetNull();
+        hashBlock = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : hashScanBlock;
+        nHeight = std::max(0, chainActive.Height());
+        LogPrint("bench", "%s: scanned %d transactions in %u threads: %.2fms\n", __func__, part.nTransactions, vCursors.size(), (GetTimeMicros() - nStart) * 0.001);
+    }
+
+    CPart partTip;
+    {
+        LOCK(cs_main);
+        if (!fValid)
+            return false;
+        partTip = part;
+        stats.hashBlock = hashBlock;
+        stats.nHeight = nHeight;
+    }
+    stats.nTransactions = partTip.nTransactions;
+    stats.nTransactionOutputs = partTip.nTransactionOutputs;
+    stats.nTotalAmount = partTip.nTotalAmount;
+    // Finalizing takes a modular inversion, do it once per block and outside cs_main.
+    if (hashFinalizedBlock != stats.hashBlock) {
+        partTip.muhash.Finalize(hashMuHash.begin());
+        hashFinalizedBlock = stats.hashBlock;
+    }
+    stats.hashMuHash = hashMuHash;
+    return true;
+}
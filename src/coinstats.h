@@ -0,0 +1,96 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+#include <atomic>
+
+class CBlock;
+class CBlockIndex;
+class CCoinsView;
+class CCoinsViewCache;
+class CCoinsViewCursor;
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    uint256 hashSerialized;
+    uint256 hashMuHash;
+    CAmount nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+};
+
+/**
+ * Statistics of the unspent output set at the tip of the active chain, with a
+ * MuHash3072 of its outputs as the set hash. Since that hash does not depend
+ * on the order of the outputs, the first request scans the coin database in
+ * parallel, one thread per txid range of a single database snapshot, and
+ * combines the parts. From then on ConnectTip and DisconnectTip pass every
+ * block's coin changes to UpdateTip, so later requests only need to finalize
+ * the hash, once per block.
+ */
+class CCoinsStatsCache
+{
+private:
+    /** Counts and hash of a part of the set, or of a change to it */
+    struct CPart
+    {
+        MuHash3072 muhash;
+        int64_t nTransactions;
+        int64_t nTransactionOutputs;
+        CAmount nTotalAmount;
+
+        CPart() : nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
+        CPart& operator+=(const CPart& other);
+    };
+
+    // Protected by cs_main
+    bool fValid;    //!< part holds the whole set at hashBlock
+    bool fScanning; //!< a scan is running, blocks go to partScanDelta
+    CPart part;
+    CPart partScanDelta;
+    uint256 hashBlock;
+    int nHeight;
+
+    //! Serializes scans, protects the finalized hash
+    CCriticalSection cs_scan;
+    uint256 hashFinalizedBlock;
+    uint256 hashMuHash;
+
+    static bool ScanPart(CCoinsViewCursor* pcursor, CPart& part, const std::atomic<bool>& fAbort);
+
+public:
+    CCoinsStatsCache();
+
+    /**
+     * Apply the changes a connected or disconnected block made, from viewOld
+     * (the chain state before) to viewNew (after). pindexNew is the new tip.
+     */
+    void UpdateTip(const CCoinsViewCache& viewOld, const CCoinsViewCache& viewNew, const CBlock& block, const CBlockIndex* pindexNew);
+
+    /**
+     * Get the statistics of view, which must be pcoinsTip, scanning it first
+     * if needed. Must be called without cs_main held.
+     */
+    bool GetStats(CCoinsView* view, CCoinsStats& stats);
+
+    void Clear();
+};
+
+extern CCoinsStatsCache coinsStatsCache;
+
+#endif // BITCOIN_COINSTATS_H
@@ -0,0 +1,165 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
+
+#include <string.h>
+
+namespace {
+
+/** 2^3072 - p */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLE32(data + 4 * i);
+    }
+    if (IsOverflow()) AddPrimeDiff();
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+bool Num3072::IsOverflow() const
+{
+    // Only values whose upper limbs are all ones and whose lowest limb is at
+    // least 2^32 - MAX_PRIME_DIFF can be >= p.
+    if (limbs[0] <= 0xffffffff - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != 0xffffffff) return false;
+    }
+    return true;
+}
+
+void Num3072::AddPrimeDiff()
+{
+    uint64_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && c; ++i) {
+        c += limbs[i];
+        limbs[i] = (uint32_t)c;
+        c >>= 32;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product into 2 * LIMBS limbs. No term can exceed 2^64 - 1.
+    uint32_t tmp[2 * LIMBS];
+    for (int i = 0; i < LIMBS; ++i) {
+        tmp[i] = 0;
+    }
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t c = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            c += (uint64_t)limbs[i] * a.limbs[j] + tmp[i + j];
+            tmp[i + j] = (uint32_t)c;
+            c >>= 32;
+        }
+        tmp[i + LIMBS] = (uint32_t)c;
+    }
+
+    // 2^3072 = MAX_PRIME_DIFF (mod p): fold the upper half into the lower one.
+    uint64_t c = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        c += (uint64_t)tmp[i + LIMBS] * MAX_PRIME_DIFF + tmp[i];
+        limbs[i] = (uint32_t)c;
+        c >>= 32;
+    }
+
+    // The carry is below 2^21, fold it once more.
+    c *= MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && c; ++i) {
+        c += limbs[i];
+        limbs[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    // If that wrapped around, the limbs are now small enough for a last fold
+    // not to wrap again.
+    if (c) AddPrimeDiff();
+
+    if (IsOverflow()) AddPrimeDiff();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^(p - 2) = a^-1 (mod p). All bits of p - 2 are set except in
+    // its lowest limb, which is 2^32 - MAX_PRIME_DIFF - 2.
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        const uint32_t e = i == 0 ? (uint32_t)(0xffffffff - MAX_PRIME_DIFF - 1) : 0xffffffff;
+        for (int bit = 31; bit >= 0; --bit) {
+            result.Multiply(result);
+            if ((e >> bit) & 1) result.Multiply(*this);
+        }
+    }
+    return result;
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        WriteLE32(out + 4 * i, limbs[i]);
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    // Expand SHA256(data) to 384 bytes with SHA512(SHA256(data) || i).
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+
+    unsigned char buf[Num3072::BYTE_SIZE];
+    for (unsigned char i = 0; i < Num3072::BYTE_SIZE / CSHA512::OUTPUT_SIZE; ++i) {
+        CSHA512().Write(key, sizeof(key)).Write(&i, 1).Finalize(buf + i * CSHA512::OUTPUT_SIZE);
+    }
+    return Num3072(buf);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    Num3072 result = numerator;
+    result.Multiply(denominator.GetInverse());
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    result.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717, stored as little-endian 32-bit limbs */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMBS = 96;
+
+    uint32_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    //! Interpret 384 little-endian bytes as a number and reduce it
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    //! this = this * a mod p, a may be *this
+    void Multiply(const Num3072& a);
+    //! The multiplicative inverse of this mod p (0 for 0)
+    Num3072 GetInverse() const;
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+private:
+    bool IsOverflow() const;
+    //! Add 2^3072 - p, dropping the carry out of the top limb
+    void AddPrimeDiff();
+};
+
+/**
+ * A hash of a set of byte strings that is independent of the order in which
+ * they are added: every element is expanded to a number modulo a 3072-bit
+ * prime and the set hash is their product. Elements can be removed again and
+ * the hashes of disjoint sets can be combined, so a set can be hashed in
+ * shards or kept up to date incrementally. The numerator and denominator are
+ * kept apart so that Remove only needs an inversion in Finalize.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! Add all elements of the set hashed by mul
+    MuHash3072& operator*=(const MuHash3072& mul);
+    //! Remove all elements of the set hashed by div
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -33,14 +33,10 @@
 #include <string.h>
 #include <openssl/sha.h>
 
-#if defined(USE_SSE2) && !defined(USE_SSE2_ALWAYS)
-#ifdef _MSC_VER
-// MSVC 64bit is unable to use inline asm
-#include <intrin.h>
-#else
-// GCC Linux or i686-w64-mingw32
-#include <cpuid.h>
-#endif
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define USE_SCRYPT_LANES 1
 #endif
 
 static inline uint32_t be32dec(const void *pp)
@@ -285,43 +281,197 @@ void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scrat
 	PBKDF2_SHA256((const uint8_t *)input, 80, B, 128, 1, (uint8_t *)output, 32);
 }
 
-#if defined(USE_SSE2)
-// By default, set to generic scrypt function. This will prevent crash in case when scrypt_detect_sse2() wasn't called
-void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad) = &scrypt_1024_1_1_256_sp_generic;
+#if defined(USE_SCRYPT_LANES)
+/*
+ * Interleaved scrypt: lane l of every vector belongs to input l, so the
+ * salsa20/8 rounds of several hashes run side by side in SIMD registers.
+ * The data dependent reads of the second ROMix loop differ per lane and are
+ * done one lane at a time. The kernels are written with GCC vector types
+ * and only turn into SSE2 or AVX2 code once inlined into the functions
+ * carrying the matching target attribute below.
+ */
+typedef uint32_t scrypt_v4 __attribute__((vector_size(16)));
+typedef uint32_t scrypt_v8 __attribute__((vector_size(32)));
+
+template <typename V>
+static inline __attribute__((always_inline)) void xor_salsa8_lanes(V B[16], const V Bx[16])
+{
+	V x00,x01,x02,x03,x04,x05,x06,x07,x08,x09,x10,x11,x12,x13,x14,x15;
+	int i;
+
+	x00 = (B[ 0] ^= Bx[ 0]);
+	x01 = (B[ 1] ^= Bx[ 1]);
+	x02 = (B[ 2] ^= Bx[ 2]);
+	x03 = (B[ 3] ^= Bx[ 3]);
+	x04 = (B[ 4] ^= Bx[ 4]);
+	x05 = (B[ 5] ^= Bx[ 5]);
+	x06 = (B[ 6] ^= Bx[ 6]);
+	x07 = (B[ 7] ^= Bx[ 7]);
+	x08 = (B[ 8] ^= Bx[ 8]);
+	x09 = (B[ 9] ^= Bx[ 9]);
+	x10 = (B[10] ^= Bx[10]);
+	x11 = (B[11] ^= Bx[11]);
+	x12 = (B[12] ^= Bx[12]);
+	x13 = (B[13] ^= Bx[13]);
+	x14 = (B[14] ^= Bx[14]);
+	x15 = (B[15] ^= Bx[15]);
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on columns. */
+		x04 ^= ROTL(x00 + x12,  7);  x09 ^= ROTL(x05 + x01,  7);
+		x14 ^= ROTL(x10 + x06,  7);  x03 ^= ROTL(x15 + x11,  7);
+
+		x08 ^= ROTL(x04 + x00,  9);  x13 ^= ROTL(x09 + x05,  9);
+		x02 ^= ROTL(x14 + x10,  9);  x07 ^= ROTL(x03 + x15,  9);
+
+		x12 ^= ROTL(x08 + x04, 13);  x01 ^= ROTL(x13 + x09, 13);
+		x06 ^= ROTL(x02 + x14, 13);  x11 ^= ROTL(x07 + x03, 13);
+
+		x00 ^= ROTL(x12 + x08, 18);  x05 ^= ROTL(x01 + x13, 18);
+		x10 ^= ROTL(x06 + x02, 18);  x15 ^= ROTL(x11 + x07, 18);
+
+		/* Operate on rows. */
+		x01 ^= ROTL(x00 + x03,  7);  x06 ^= ROTL(x05 + x04,  7);
+		x11 ^= ROTL(x10 + x09,  7);  x12 ^= ROTL(x15 + x14,  7);
+
+		x02 ^= ROTL(x01 + x00,  9);  x07 ^= ROTL(x06 + x05,  9);
+		x08 ^= ROTL(x11 + x10,  9);  x13 ^= ROTL(x12 + x15,  9);
+
+		x03 ^= ROTL(x02 + x01, 13);  x04 ^= ROTL(x07 + x06, 13);
+		x09 ^= ROTL(x08 + x11, 13);  x14 ^= ROTL(x13 + x12, 13);
+
+		x00 ^= ROTL(x03 + x02, 18);  x05 ^= ROTL(x04 + x07, 18);
+		x10 ^= ROTL(x09 + x08, 18);  x15 ^= ROTL(x14 + x13, 18);
+	}
+	B[ 0] += x00;
+	B[ 1] += x01;
+	B[ 2] += x02;
+	B[ 3] += x03;
+	B[ 4] += x04;
+	B[ 5] += x05;
+	B[ 6] += x06;
+	B[ 7] += x07;
+	B[ 8] += x08;
+	B[ 9] += x09;
+	B[10] += x10;
+	B[11] += x11;
+	B[12] += x12;
+	B[13] += x13;
+	B[14] += x14;
+	B[15] += x15;
+}
+
+template <typename V, int N>
+static inline __attribute__((always_inline)) void scrypt_1024_1_1_256_sp_lanes(const char *input, char *output, char *scratchpad)
+{
+	uint8_t B[128];
+	V X[32];
+	V *W;
+	uint32_t i, j, k;
+	int l;
+
+	W = (V *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+	for (l = 0; l < N; l++) {
+		PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, (const uint8_t *)&input[80 * l], 80, 1, B, 128);
+		for (k = 0; k < 32; k++)
+			X[k][l] = le32dec(&B[4 * k]);
+	}
+
+	for (i = 0; i < 1024; i++) {
+		memcpy(&W[i * 32], X, sizeof(X));
+		xor_salsa8_lanes<V>(&X[0], &X[16]);
+		xor_salsa8_lanes<V>(&X[16], &X[0]);
+	}
+	for (i = 0; i < 1024; i++) {
+		for (l = 0; l < N; l++) {
+			j = 32 * (X[16][l] & 1023);
+			for (k = 0; k < 32; k++)
+				X[k][l] ^= W[j + k][l];
+		}
+		xor_salsa8_lanes<V>(&X[0], &X[16]);
+		xor_salsa8_lanes<V>(&X[16], &X[0]);
+	}
 
-std::string scrypt_detect_sse2()
+	for (l = 0; l < N; l++) {
+		for (k = 0; k < 32; k++)
+			le32enc(&B[4 * k], X[k][l]);
+		PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, B, 128, 1, (uint8_t *)&output[32 * l], 32);
+	}
+}
+
+__attribute__((target("sse2")))
+static void scrypt_1024_1_1_256_sp_sse2_4way(const char *input, char *output, char *scratchpad)
+{
+	scrypt_1024_1_1_256_sp_lanes<scrypt_v4, 4>(input, output, scratchpad);
+}
+
+__attribute__((target("avx2")))
+static void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad)
 {
-    std::string ret;
-#if defined(USE_SSE2_ALWAYS)
-    ret = "scrypt: using scrypt-sse2 as built.";
-#else // USE_SSE2_ALWAYS
-    // 32bit x86 Linux or Windows, detect cpuid features
-    unsigned int cpuid_edx=0;
-#if defined(_MSC_VER)
-    // MSVC
-    int x86cpuid[4];
-    __cpuid(x86cpuid, 1);
-    cpuid_edx = (unsigned int)buffer[3];
-#else // _MSC_VER
-    // Linux or i686-w64-mingw32 (gcc-4.6.3)
-    unsigned int eax, ebx, ecx;
-    __get_cpuid(1, &eax, &ebx, &ecx, &cpuid_edx);
-#endif // _MSC_VER
-
-    if (cpuid_edx & 1<<26)
-    {
-        scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_sse2;
-        ret = "scrypt: using scrypt-sse2 as detected");
-    }
-    else
-    {
-        scrypt_1024_1_1_256_sp_detected = &scrypt_1024_1_1_256_sp_generic;
-        ret = "scrypt: using scrypt-generic, SSE2 unavailable";
-    }
-#endif // USE_SSE2_ALWAYS
-    return ret;
+	scrypt_1024_1_1_256_sp_lanes<scrypt_v8, 8>(input, output, scratchpad);
 }
+#endif // USE_SCRYPT_LANES
+
+typedef void (*scrypt_lanes_fn)(const char *input, char *output, char *scratchpad);
+
+struct scrypt_impl {
+	const char *name;
+	int lanes;
+	scrypt_lanes_fn fn;
+};
+
+static scrypt_impl scrypt_select()
+{
+	scrypt_impl impl = {"generic", 1, &scrypt_1024_1_1_256_sp_generic};
+#if defined(USE_SCRYPT_LANES)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		impl.name = "avx2 8-way";
+		impl.lanes = 8;
+		impl.fn = &scrypt_1024_1_1_256_sp_avx2_8way;
+	} else if (__builtin_cpu_supports("sse2")) {
+		impl.name = "sse2 4-way";
+		impl.lanes = 4;
+		impl.fn = &scrypt_1024_1_1_256_sp_sse2_4way;
+	}
 #endif
+	return impl;
+}
+
+static const scrypt_impl& scrypt_selected()
+{
+	static const scrypt_impl impl = scrypt_select();
+	return impl;
+}
+
+int scrypt_batch_lanes()
+{
+	return scrypt_selected().lanes;
+}
+
+std::string scrypt_detect()
+{
+	return std::string("scrypt: using ") + scrypt_selected().name + " batch hashing";
+}
+
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t nCount)
+{
+	const scrypt_impl& impl = scrypt_selected();
+	std::vector<char> scratchpad((size_t)impl.lanes * 131072 + 63);
+	size_t i = 0;
+
+	for (; i + impl.lanes <= nCount && impl.lanes > 1; i += impl.lanes)
+		impl.fn(&input[80 * i], &output[32 * i], scratchpad.data());
+#if defined(USE_SCRYPT_LANES)
+	/* An AVX2 capable CPU also has SSE2 for a shorter tail. */
+	if (impl.lanes == 8 && i + 4 <= nCount) {
+		scrypt_1024_1_1_256_sp_sse2_4way(&input[80 * i], &output[32 * i], scratchpad.data());
+		i += 4;
+	}
+#endif
+	for (; i < nCount; i++)
+		scrypt_1024_1_1_256_sp(&input[80 * i], &output[32 * i], scratchpad.data());
+}
 
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
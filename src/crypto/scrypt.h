@@ -2,27 +2,27 @@
 #define SCRYPT_H
 #include <stdlib.h>
 #include <stdint.h>
+#include <string>
 
 static const int SCRYPT_SCRATCHPAD_SIZE = 131072 + 63;
 
 void scrypt_1024_1_1_256(const char *input, char *output);
 void scrypt_1024_1_1_256_sp_generic(const char *input, char *output, char *scratchpad);
 
-#if defined(USE_SSE2)
-#include <string>
-#if defined(_M_X64) || defined(__x86_64__) || defined(_M_AMD64) || (defined(MAC_OSX) && defined(__i386__))
-#define USE_SSE2_ALWAYS 1
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_sse2((input), (output), (scratchpad))
-#else
-#define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_detected((input), (output), (scratchpad))
-#endif
-
-std::string scrypt_detect_sse2();
-void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchpad);
-extern void (*scrypt_1024_1_1_256_sp_detected)(const char *input, char *output, char *scratchpad);
-#else
 #define scrypt_1024_1_1_256_sp(input, output, scratchpad) scrypt_1024_1_1_256_sp_generic((input), (output), (scratchpad))
-#endif
+
+/**
+ * Hash nCount 80 byte inputs stored back to back into nCount 32 byte
+ * outputs. Hashes are interleaved 8 (AVX2) or 4 (SSE2) at a time when the
+ * CPU supports it, which is much faster than hashing them one by one.
+ */
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t nCount);
+
+/** Number of hashes scrypt_1024_1_1_256_batch computes at once on this CPU */
+int scrypt_batch_lanes();
+
+/** Describe the scrypt implementation selected for this CPU */
+std::string scrypt_detect();
 
 void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
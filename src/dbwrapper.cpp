@@ -6,7 +6,14 @@
 
 #include "util.h"
 #include "random.h"
+#include "sync.h"
+#include "utilstrencodings.h"
 
+#include <memory>
+#include <set>
+#include <stdio.h>
+
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
 #include <leveldb/cache.h>
@@ -15,14 +22,86 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+namespace {
+
+//! Open databases, for GetDBStats
+CCriticalSection cs_dbs;
+std::set<const CDBWrapper*> setDBs;
+
+}
+
+bool LevelDBHasSnappy()
+{
+    // LevelDB silently stores blocks uncompressed when it lacks snappy, so
+    // compress a block of zeros in memory and see whether it shrinks
+    static const bool fSnappy = [] {
+        std::unique_ptr<leveldb::Env> penv(leveldb::NewMemEnv(leveldb::Env::Default()));
+        leveldb::Options options;
+        options.env = penv.get();
+        options.create_if_missing = true;
+        options.compression = leveldb::kSnappyCompression;
+        leveldb::DB* pdbRaw = NULL;
+        if (!leveldb::DB::Open(options, "snappy", &pdbRaw).ok())
+            return false;
+        std::unique_ptr<leveldb::DB> pdb(pdbRaw);
+        const size_t nValueSize = 1 << 16;
+        if (!pdb->Put(leveldb::WriteOptions(), "a", std::string(nValueSize, '\0')).ok())
+            return false;
+        pdb->CompactRange(NULL, NULL);
+        leveldb::Range range("a", "b");
+        uint64_t nSize = 0;
+        pdb->GetApproximateSizes(&range, 1, &nSize);
+        return nSize < nValueSize / 2;
+    }();
+    return fSnappy;
+}
+
+CDBProfile::CDBProfile(const std::string& strNameIn) : strName(strNameIn), fCompression(false), nBlockSize(4096), nMaxOpenFiles(64), nBloomBits(10), nWriteBufferSize(0)
+{
+}
+
+bool ParseDBProfile(const std::string& str, CDBProfile& profile, std::string& strError)
+{
+    std::vector<std::string> vSettings;
+    boost::split(vSettings, str, boost::is_any_of(","));
+    for (const std::string& strSetting : vSettings) {
+        size_t nPos = strSetting.find('=');
+        int64_t nValue;
+        if (nPos == std::string::npos || !ParseInt64(strSetting.substr(nPos + 1), &nValue)) {
+            strError = strprintf("invalid setting '%s'", strSetting);
+            return false;
+        }
+        const std::string strKey = strSetting.substr(0, nPos);
+        if (strKey == "compression" && nValue == 1 && !LevelDBHasSnappy()) {
+            strError = "compression=1 needs LevelDB built with snappy";
+            return false;
+        } else if (strKey == "compression" && (nValue == 0 || nValue == 1)) {
+            profile.fCompression = nValue;
+        } else if (strKey == "blocksize" && nValue >= 1024 && nValue <= (4 << 20)) {
+            profile.nBlockSize = nValue;
+        } else if (strKey == "maxopenfiles" && nValue >= 16 && nValue <= 50000) {
+            profile.nMaxOpenFiles = nValue;
+        } else if (strKey == "bloombits" && nValue >= 0 && nValue <= 32) {
+            profile.nBloomBits = nValue;
+        } else if (strKey == "writebuffer" && nValue >= 1 && nValue <= 1024) {
+            profile.nWriteBufferSize = nValue << 20;
+        } else {
+            strError = strprintf("invalid setting '%s'", strSetting);
+            return false;
+        }
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBProfile& profile)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.write_buffer_size = profile.nWriteBufferSize ? profile.nWriteBufferSize : nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = profile.nBloomBits ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.block_size = profile.nBlockSize;
+    options.max_open_files = profile.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -31,14 +110,14 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const CDBProfile& profileIn) : profile(profileIn), pathDB(path), nDBCacheSize(nCacheSize)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -74,10 +153,17 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(cs_dbs);
+    setDBs.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(cs_dbs);
+        setDBs.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -88,6 +174,15 @@ CDBWrapper::~CDBWrapper()
     options.env = NULL;
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper& db) : pdb(db.pdb), psnapshot(db.pdb->GetSnapshot())
+{
+}
+
+CDBSnapshot::~CDBSnapshot()
+{
+    pdb->ReleaseSnapshot(psnapshot);
+}
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
@@ -122,6 +217,43 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBStats CDBWrapper::GetStats() const
+{
+    CDBStats stats;
+    stats.profile = profile;
+    stats.path = pathDB;
+    stats.nCacheSize = nDBCacheSize;
+
+    std::string strValue;
+    stats.nMemoryUsage = pdb->GetProperty("leveldb.approximate-memory-usage", &strValue) ? atoi64(strValue) : 0;
+
+    const leveldb::Range range("", std::string(8, '\xff'));
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    stats.nDiskSize = nSize;
+
+    // One line per level after a three line header
+    if (pdb->GetProperty("leveldb.stats", &strValue)) {
+        std::vector<std::string> vLines;
+        boost::split(vLines, strValue, boost::is_any_of("\n"));
+        for (size_t i = 3; i < vLines.size(); i++) {
+            CDBLevelStats level;
+            if (sscanf(vLines[i].c_str(), "%d %d %lf %lf %lf %lf", &level.nLevel, &level.nFiles, &level.dSizeMB, &level.dTimeSec, &level.dReadMB, &level.dWriteMB) == 6)
+                stats.vLevels.push_back(level);
+        }
+    }
+    return stats;
+}
+
+std::vector<CDBStats> GetDBStats()
+{
+    std::vector<CDBStats> vStats;
+    LOCK(cs_dbs);
+    for (const CDBWrapper* pdb : setDBs)
+        vStats.push_back(pdb->GetStats());
+    return vStats;
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
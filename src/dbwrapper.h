@@ -26,8 +26,62 @@ public:
     dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+/** LevelDB settings of one database, see ParseDBProfile */
+struct CDBProfile
+{
+    //! database the profile is for, as named in -dbprofile
+    std::string strName;
+    //! snappy-compress blocks; has no effect unless LevelDB was built with snappy
+    bool fCompression;
+    //! approximate uncompressed size of a block, the unit of reads and caching
+    size_t nBlockSize;
+    int nMaxOpenFiles;
+    //! bits per key of the bloom filters, 0 for none
+    int nBloomBits;
+    //! size of the memtable, 0 for a quarter of the database cache
+    size_t nWriteBufferSize;
+
+    explicit CDBProfile(const std::string& strNameIn = "");
+};
+
+/**
+ * Apply settings of the form "key=value,key=value" to profile. The keys are
+ * compression (0 or 1, refused if !LevelDBHasSnappy()), blocksize (bytes),
+ * maxopenfiles, bloombits and writebuffer (MiB).
+ */
+bool ParseDBProfile(const std::string& str, CDBProfile& profile, std::string& strError);
+
+/** Whether LevelDB was built with snappy and can compress */
+bool LevelDBHasSnappy();
+
+/** Compaction statistics of one level, as LevelDB reports them */
+struct CDBLevelStats
+{
+    int nLevel;
+    int nFiles;
+    double dSizeMB;
+    double dTimeSec;  //!< spent compacting into this level
+    double dReadMB;   //!< read by those compactions
+    double dWriteMB;  //!< written by those compactions
+};
+
+struct CDBStats
+{
+    CDBProfile profile;
+    boost::filesystem::path path;
+    size_t nCacheSize;
+    //! block cache and memtables
+    size_t nMemoryUsage;
+    uint64_t nDiskSize;
+    //! levels that have files or had compactions
+    std::vector<CDBLevelStats> vLevels;
+};
+
 class CDBWrapper;
 
+/** Statistics of all open databases */
+std::vector<CDBStats> GetDBStats();
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -56,11 +110,19 @@ private:
     CDataStream ssKey;
     CDataStream ssValue;
 
+    size_t size_estimate;
+
 public:
     /**
      * @param[in] _parent   CDBWrapper that this batch is to be submitted to
      */
-    CDBBatch(const CDBWrapper &_parent) : parent(_parent), ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION) { };
+    CDBBatch(const CDBWrapper &_parent) : parent(_parent), ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), size_estimate(0) { };
+
+    void Clear()
+    {
+        batch.Clear();
+        size_estimate = 0;
+    }
 
     template <typename K, typename V>
     void Write(const K& key, const V& value)
@@ -75,6 +137,14 @@ public:
         leveldb::Slice slValue(ssValue.data(), ssValue.size());
 
         batch.Put(slKey, slValue);
+        // LevelDB serializes writes as:
+        // - byte: header
+        // - varint: key length (1 byte up to 127B, 2 bytes up to 16383B, ...)
+        // - byte[]: key
+        // - varint: value length
+        // - byte[]: value
+        // The formula below assumes the key and value are both less than 16k.
+        size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
         ssKey.clear();
         ssValue.clear();
     }
@@ -87,8 +157,16 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         batch.Delete(slKey);
+        // LevelDB serializes erases as:
+        // - byte: header
+        // - varint: key length
+        // - byte[]: key
+        // The formula below assumes the key is less than 16kB.
+        size_estimate += 2 + (slKey.size() > 127) + slKey.size();
         ssKey.clear();
     }
+
+    size_t SizeEstimate() const { return size_estimate; }
 };
 
 class CDBIterator
@@ -154,8 +232,28 @@ public:
 
 };
 
+/**
+ * A consistent point-in-time view of a CDBWrapper. Iterators created from the
+ * same snapshot see the same data, whatever is written in the meantime.
+ */
+class CDBSnapshot
+{
+    friend class CDBWrapper;
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* psnapshot;
+
+    CDBSnapshot(const CDBSnapshot&);
+    CDBSnapshot& operator=(const CDBSnapshot&);
+
+public:
+    explicit CDBSnapshot(const CDBWrapper& db);
+    ~CDBSnapshot();
+};
+
 class CDBWrapper
 {
+    friend class CDBSnapshot;
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
@@ -190,6 +288,11 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! settings and location reported by GetStats
+    CDBProfile profile;
+    boost::filesystem::path pathDB;
+    size_t nDBCacheSize;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -198,8 +301,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] profile     LevelDB settings to open the database with.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBProfile& profile = CDBProfile());
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -277,15 +381,29 @@ public:
         return WriteBatch(batch, true);
     }
 
-    CDBIterator *NewIterator()
+    /**
+     * @param[in] fFillCache  Keep the blocks read in the block cache, for
+     *                        iterators used as point lookups rather than scans
+     */
+    CDBIterator *NewIterator(bool fFillCache = false)
+    {
+        return new CDBIterator(*this, pdb->NewIterator(fFillCache ? readoptions : iteroptions));
+    }
+
+    //! Iterate over the database as it was when snapshot was taken
+    CDBIterator *NewIterator(const CDBSnapshot& snapshot)
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.psnapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
     }
 
     /**
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    CDBStats GetStats() const;
 };
 
 #endif // BITCOIN_DBWRAPPER_H
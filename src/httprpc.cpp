@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -190,7 +191,43 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq);
+            // Handlers may stream their result into the reply. Nothing is sent
+            // before the first block is full, so small results and errors are
+            // still replied to as a whole.
+            bool fStreaming = false;
+            CJSONStreamWriter writer([req, &fStreaming](const std::string& strChunk) {
+                if (!fStreaming) {
+                    req->WriteHeader("Content-Type", "application/json");
+                    req->WriteReplyStart(HTTP_OK);
+                    fStreaming = true;
+                }
+                if (!req->WriteReplyChunk(strChunk))
+                    throw std::runtime_error("HTTP client disconnected");
+            });
+            writer.BeginObject();
+            writer.Key("result");
+            jreq.pstream = &writer;
+
+            UniValue result;
+            try {
+                result = tableRPC.execute(jreq);
+                if (!writer.ExpectsValue()) {
+                    writer.KeyValue("error", NullUniValue);
+                    writer.KeyValue("id", jreq.id);
+                    writer.EndObject();
+                    writer.Flush();
+                    req->WriteReplyChunk("\n");
+                    req->WriteReplyEnd();
+                    return true;
+                }
+            } catch (...) {
+                if (fStreaming) {
+                    LogPrintf("%s: %s failed after its reply was started\n", __func__, jreq.strMethod);
+                    req->WriteReplyAbort();
+                    return false;
+                }
+                throw;
+            }
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
@@ -539,13 +539,86 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+
+/** State of a chunked reply, shared by the worker writing it and the event thread sending it */
+struct HTTPReplyStream
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    //! Bytes given to WriteReplyChunk that are not written to the socket yet
+    size_t nQueued;
+    //! Bytes of those passed to libevent since its output buffer was last empty
+    size_t nSent;
+    //! The client went away, nothing more is sent
+    bool fClosed;
+
+    // Only used by the event thread
+    struct evhttp_request* req;
+    //! Argument of the close callback set on the connection of req, if any
+    std::shared_ptr<HTTPReplyStream>* pWatch;
+    //! req was freed together with its connection
+    bool fFreed;
+
+    HTTPReplyStream(struct evhttp_request* _req) : nQueued(0), nSent(0), fClosed(false), req(_req), pWatch(NULL), fFreed(false) {}
+
+    void Close()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        fClosed = true;
+        cond.notify_all();
+    }
+};
+
+/** Connection of a chunked reply closed, which happens before its requests are freed */
+static void http_reply_stream_close_cb(struct evhttp_connection* evcon, void* arg)
+{
+    std::shared_ptr<HTTPReplyStream>* pWatch = (std::shared_ptr<HTTPReplyStream>*)arg;
+    std::shared_ptr<HTTPReplyStream> stream = *pWatch;
+    // A request libevent was not done with was taken off the connection
+    // first, and is only freed once the reply is ended.
+    stream->fFreed = evhttp_request_get_connection(stream->req) == evcon;
+    stream->pWatch = NULL;
+    delete pWatch;
+    stream->Close();
+}
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+/** Everything passed to libevent so far was written to the socket */
+static void http_reply_stream_drained_cb(struct evhttp_connection* evcon, void* arg)
+{
+    HTTPReplyStream& stream = **(std::shared_ptr<HTTPReplyStream>*)arg;
+    std::unique_lock<std::mutex> lock(stream.cs);
+    stream.nQueued -= stream.nSent;
+    stream.nSent = 0;
+    stream.cond.notify_all();
+}
+#endif
+
+/** Stop watching the connection of a chunked reply that is about to be ended */
+static void http_reply_stream_unwatch(HTTPReplyStream& stream)
+{
+    if (!stream.pWatch)
+        return;
+    struct evhttp_connection* evcon = evhttp_request_get_connection(stream.req);
+    if (evcon)
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+    delete stream.pWatch;
+    stream.pWatch = NULL;
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyStarted(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyStarted && !replySent) {
+        // The status was sent already, the client has to learn from the
+        // connection that the body is not complete
+        LogPrintf("%s: Unfinished reply\n", __func__);
+        WriteReplyAbort();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -598,7 +671,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyStarted && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -610,6 +683,109 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !replyStarted && req);
+    stream = std::make_shared<HTTPReplyStream>(req);
+    std::shared_ptr<HTTPReplyStream> streamStart = stream;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [streamStart, nStatus]() {
+        struct evhttp_connection* evcon = evhttp_request_get_connection(streamStart->req);
+        if (!evcon) {
+            streamStart->Close();
+            return;
+        }
+        evhttp_send_reply_start(streamStart->req, nStatus, NULL);
+        // The connection may be freed with the request on it before the
+        // reply is ended, the events queued for it must know.
+        streamStart->pWatch = new std::shared_ptr<HTTPReplyStream>(streamStart);
+        evhttp_connection_set_closecb(evcon, http_reply_stream_close_cb, streamStart->pWatch);
+    });
+    ev->trigger(0);
+    replyStarted = true;
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(replyStarted && !replySent && stream);
+    {
+        // Wait for the client to take what was sent, so that a large reply
+        // is not buffered whole. The server timeout closes the connection of
+        // a client that stops reading.
+        std::unique_lock<std::mutex> lock(stream->cs);
+        while (!stream->fClosed && stream->nQueued >= MAX_HTTP_REPLY_BUFFER)
+            stream->cond.wait(lock);
+        if (stream->fClosed)
+            return false;
+        stream->nQueued += strChunk.size();
+    }
+    // Events are handled in the order they are triggered, so the chunks go
+    // out in order.
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    std::shared_ptr<HTTPReplyStream> streamChunk = stream;
+    size_t nSize = strChunk.size();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [streamChunk, evb, nSize]() {
+        if (streamChunk->pWatch && evhttp_request_get_connection(streamChunk->req)) {
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+            {
+                std::unique_lock<std::mutex> lock(streamChunk->cs);
+                streamChunk->nSent += nSize;
+            }
+            evhttp_send_reply_chunk_with_cb(streamChunk->req, evb, http_reply_stream_drained_cb, streamChunk->pWatch);
+#else
+            // Without a callback for written data, only the events are limited
+            evhttp_send_reply_chunk(streamChunk->req, evb);
+            std::unique_lock<std::mutex> lock(streamChunk->cs);
+            streamChunk->nQueued -= nSize;
+            streamChunk->cond.notify_all();
+#endif
+        } else {
+            streamChunk->Close();
+        }
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+    return true;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(replyStarted && !replySent && req);
+    std::shared_ptr<HTTPReplyStream> streamEnd = stream;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [streamEnd]() {
+        if (streamEnd->fFreed)
+            return;
+        http_reply_stream_unwatch(*streamEnd);
+        // Also frees a request that was taken off its connection
+        evhttp_send_reply_end(streamEnd->req);
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+void HTTPRequest::WriteReplyAbort()
+{
+    assert(replyStarted && !replySent && req);
+    std::shared_ptr<HTTPReplyStream> streamAbort = stream;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [streamAbort]() {
+        if (streamAbort->fFreed)
+            return;
+        struct evhttp_connection* evcon = evhttp_request_get_connection(streamAbort->req);
+        if (evcon && streamAbort->pWatch) {
+            // Frees the request with the connection, see http_reply_stream_close_cb
+            evhttp_connection_free(evcon);
+        } else {
+            http_reply_stream_unwatch(*streamAbort);
+            evhttp_send_reply_end(streamAbort->req);
+        }
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
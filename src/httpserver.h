@@ -8,15 +8,19 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Bytes of a chunked reply that may wait to be sent before WriteReplyChunk blocks */
+static const size_t MAX_HTTP_REPLY_BUFFER=1024*1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyStream;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -55,6 +59,9 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyStarted;
+    //! Shared with the event thread while a reply started with WriteReplyStart is sent
+    std::shared_ptr<HTTPReplyStream> stream;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -110,6 +117,37 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a HTTP reply whose body is sent in parts, with WriteReplyChunk
+     * (chunked transfer encoding for HTTP/1.1 clients). The headers are sent
+     * with this call.
+     *
+     * @note Call WriteReplyEnd once all of the body was written. Neither
+     * WriteReply nor WriteReplyStart may be called again.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Send the next part of the body of a reply started with WriteReplyStart.
+     * Blocks while more than MAX_HTTP_REPLY_BUFFER bytes wait for the client.
+     * Returns false once the client went away, after which nothing is sent.
+     */
+    bool WriteReplyChunk(const std::string& strChunk);
+
+    /**
+     * Finish a reply started with WriteReplyStart. As with WriteReply, do not
+     * call any other HTTPRequest methods after this.
+     */
+    void WriteReplyEnd();
+
+    /**
+     * Give up on a reply started with WriteReplyStart by closing the
+     * connection, so the client cannot take the part it got for the whole
+     * reply. As with WriteReply, do not call any other HTTPRequest methods
+     * after this.
+     */
+    void WriteReplyAbort();
 };
 
 /** Event handler closure.
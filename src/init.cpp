@@ -16,6 +16,7 @@
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/scrypt.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -30,6 +31,7 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "snapshot.h"
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
@@ -233,6 +235,8 @@ void Shutdown()
         pcoinsTip = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
+        delete pcoinsbuffer;
+        pcoinsbuffer = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
         delete pblocktree;
@@ -324,6 +328,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf(_("Write the chainstate to disk in a background thread while blocks keep being validated; the coins being written take up to another -dbcache of memory (default: %u)"), DEFAULT_BACKGROUND_FLUSH));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -337,9 +342,13 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbprofile=<db>:<settings>", _("Set LevelDB settings of database <db> (chainstate or blockindex, which holds the transaction index), as comma separated key=value pairs: compression (0 or 1, needs LevelDB built with snappy, default: 0), blocksize (bytes, default: 4096), maxopenfiles (default: 64), bloombits (0 for no bloom filters, default: 10) and writebuffer (MiB, default: a quarter of the database cache). Can be specified multiple times"));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Bootstrap an empty data directory from a chainstate snapshot written by dumptxoutset. The node runs on it at once while the blocks below the snapshot are downloaded and validated in the background"));
+    strUsage += HelpMessageOpt("-loadtxoutsethash=<hash>", _("Snapshot hash that the -loadtxoutset snapshot must have (required)"));
+    strUsage += HelpMessageOpt("-mmapblocks", strprintf(_("Read blocks from memory-mapped block files, for nodes serving many random block and transaction lookups (default: %u)"), DEFAULT_MMAPBLOCKS));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
@@ -358,6 +367,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindexcache=<n>", strprintf(_("Keep up to <n> transactions looked up through the transaction index in memory (default: %u)"), DEFAULT_TXINDEX_CACHE));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -423,6 +433,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-trustverifiedblocks", strprintf("Skip proof-of-work re-checks when reading blocks that are already fully validated (default: %u)", DEFAULT_TRUST_VERIFIED_BLOCKS));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
@@ -450,6 +461,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
+        strUsage += HelpMessageOpt("-powcachesize=<n>", strprintf("Limit size of the checked proof-of-work cache to <n> MiB, 0 to disable (default: %u)", DEFAULT_POW_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
@@ -885,6 +897,17 @@ bool AppInitParameterInteraction()
             return InitError(_("Prune mode is incompatible with -txindex."));
     }
 
+    // a snapshot chainstate has no transactions below the snapshot to index or reindex
+    if (IsArgSet("-loadtxoutset")) {
+        // the snapshot is used before the blocks below it are validated, so its hash has to come from elsewhere
+        if (!IsArgSet("-loadtxoutsethash"))
+            return InitError(_("-loadtxoutset requires -loadtxoutsethash."));
+        if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
+            return InitError(_("-loadtxoutset is incompatible with -txindex."));
+        if (GetBoolArg("-reindex", false) || GetBoolArg("-reindex-chainstate", false))
+            return InitError(_("-loadtxoutset is incompatible with -reindex and -reindex-chainstate."));
+    }
+
     // Make sure enough file descriptors are available
     int nBind = std::max(
                 (mapMultiArgs.count("-bind") ? mapMultiArgs.at("-bind").size() : 0) +
@@ -938,6 +961,14 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fTrustVerifiedBlocks = GetBoolArg("-trustverifiedblocks", DEFAULT_TRUST_VERIFIED_BLOCKS);
+    fMmapBlocks = GetBoolArg("-mmapblocks", DEFAULT_MMAPBLOCKS);
+    nTxIndexCacheSize = std::max(0, (int)GetArg("-txindexcache", DEFAULT_TXINDEX_CACHE));
+    if (fMmapBlocks && sizeof(void*) < 8) {
+        // Every finished block file stays mapped, which would exhaust a 32-bit address space
+        InitWarning(_("-mmapblocks is not supported on 32-bit systems and has been disabled."));
+        fMmapBlocks = false;
+    }
 
     // SolarCoin: solarcoin.conf args
     fPrintProofOfStake = GetBoolArg("-printproofofstake", false);
@@ -1184,12 +1215,19 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    InitPoWVerifiedCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // The calling thread joins each of these pools as its last worker
+        for (int i=0; i<std::min(nScriptCheckThreads-1, MAX_HEADERCHECK_THREADS); i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
+        for (int i=0; i<std::min(nScriptCheckThreads-1, MAX_PREFETCH_THREADS); i++)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
     }
+    LogPrintf("%s\n", scrypt_detect());
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1401,6 +1439,19 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    CDBProfile chainstateProfile("chainstate");
+    CDBProfile blockIndexProfile("blockindex");
+    if (mapMultiArgs.count("-dbprofile")) {
+        for (const std::string& strArg : mapMultiArgs.at("-dbprofile")) {
+            size_t nPos = strArg.find(':');
+            std::string strName = strArg.substr(0, nPos);
+            CDBProfile* pprofile = strName == chainstateProfile.strName ? &chainstateProfile : strName == blockIndexProfile.strName ? &blockIndexProfile : NULL;
+            std::string strError = "unknown database";
+            if (nPos == std::string::npos || !pprofile || !ParseDBProfile(strArg.substr(nPos + 1), *pprofile, strError))
+                return InitError(strprintf(_("Invalid -dbprofile '%s': %s"), strArg, strError));
+        }
+    }
+
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
@@ -1432,13 +1483,31 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
+                delete pcoinsbuffer;
                 delete pblocktree;
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
-                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
+                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, blockIndexProfile);
+                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState, chainstateProfile);
+                // Convert a chainstate from before per-output coin records
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+                pcoinsbuffer = new CCoinsViewFlushBuffer(pcoinsdbview);
+                pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsbuffer);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
+                // SolarCoin: bootstrap a fresh data directory from a chainstate snapshot
+                if (IsArgSet("-loadtxoutset") && pcoinsdbview->GetBestBlock().IsNull()) {
+                    uiInterface.InitMessage(_("Loading chainstate snapshot..."));
+                    CSnapshotStats stats;
+                    if (!LoadSnapshot(GetArg("-loadtxoutset", ""), uint256S(GetArg("-loadtxoutsethash", "")), *pblocktree, *pcoinsdbview, stats, strLoadError)) {
+                        if (ShutdownRequested())
+                            return false;
+                        return InitError(strLoadError);
+                    }
+                }
+
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
                     //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
@@ -1470,7 +1539,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
-                if (fHavePruned && !fPruneMode) {
+                if (fHavePruned && !fPruneMode && !fSnapshotChainstate) {
                     strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
@@ -1545,6 +1614,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    if (GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH))
+        threadGroup.create_thread(&ThreadFlushCoins);
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1564,6 +1636,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // if pruning, unset the service bit and perform the initial blockstore prune
     // after any wallet rescanning has taken place.
+    if (fSnapshotChainstate && !fSnapshotValidated && !fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK, blocks below the chainstate snapshot are missing\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+    }
     if (fPruneMode) {
         LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
         nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
@@ -1610,6 +1686,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
+    // SolarCoin: validate the blocks below a snapshot chainstate while running on it
+    if (fSnapshotChainstate && !fSnapshotValidated)
+        threadGroup.create_thread(&ThreadSnapshotValidation);
+
     // Wait for genesis block to be processed
     {
         boost::unique_lock<boost::mutex> lock(cs_GenesisWait);
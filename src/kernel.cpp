@@ -10,14 +10,14 @@
 #include <rpc/server.h>
 #include <txdb.h>
 #include <timedata.h>
+#include <hash.h>
 #include <kernel.h>
+#include <memusage.h>
 #include <pow.h>
+#include <random.h>
 
 using namespace std;
 
-int nAverageStakeWeightHeightCached = 0;
-double dAverageStakeWeightCached = 0;
-
 typedef std::map<int, unsigned int> MapModifierCheckpoints;
 
 // Hard checkpoints of stake modifiers to ensure they are deterministic
@@ -253,9 +253,115 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStake
     return true;
 }
 
+CKernelModifierIndex kernelModifierIndex;
+
+void CKernelModifierIndex::Connect(const CBlockIndex* pindex)
+{
+    // Drop anything at or above this height in case we missed a disconnect
+    Disconnect(pindex);
+    if (!pindex->GeneratedStakeModifier())
+        return;
+    int64_t nTimeMax = pindex->GetBlockTime();
+    if (!vEntries.empty())
+        nTimeMax = std::max(nTimeMax, vEntries.back().nTimeMax);
+    vEntries.push_back(CEntry{pindex, nTimeMax});
+}
+
+void CKernelModifierIndex::Disconnect(const CBlockIndex* pindex)
+{
+    while (!vEntries.empty() && vEntries.back().pindex->nHeight >= pindex->nHeight)
+        vEntries.pop_back();
+}
+
+void CKernelModifierIndex::Rebuild(const CBlockIndex* pindexTip)
+{
+    vEntries.clear();
+    std::vector<const CBlockIndex*> vBlocks;
+    for (const CBlockIndex* pindex = pindexTip; pindex; pindex = pindex->pprev) {
+        if (pindex->GeneratedStakeModifier())
+            vBlocks.push_back(pindex);
+    }
+    vEntries.reserve(vBlocks.size());
+    for (std::vector<const CBlockIndex*>::reverse_iterator it = vBlocks.rbegin(); it != vBlocks.rend(); ++it)
+        Connect(*it);
+}
+
+const CBlockIndex* CKernelModifierIndex::Find(const CBlockIndex* pindexFrom, int64_t nTargetTime) const
+{
+    // Entries strictly above the kernel's block
+    std::vector<CEntry>::const_iterator first = std::upper_bound(vEntries.begin(), vEntries.end(), pindexFrom->nHeight,
+        [](int nHeight, const CEntry& entry) { return nHeight < entry.pindex->nHeight; });
+    if (first == vEntries.end())
+        return nullptr;
+
+    // Block times are not monotonic. The running maximum is, so as long as no
+    // earlier entry already reached the target, the first entry whose running
+    // maximum reaches it is also the first whose own time does.
+    if (first == vEntries.begin() || (first - 1)->nTimeMax < nTargetTime) {
+        std::vector<CEntry>::const_iterator it = std::lower_bound(first, vEntries.end(), nTargetTime,
+            [](const CEntry& entry, int64_t nTime) { return entry.nTimeMax < nTime; });
+        return it == vEntries.end() ? nullptr : it->pindex;
+    }
+    for (std::vector<CEntry>::const_iterator it = first; it != vEntries.end(); ++it) {
+        if (it->pindex->GetBlockTime() >= nTargetTime)
+            return it->pindex;
+    }
+    return nullptr;
+}
+
+CStakeSeenFilter stakeSeenFilter;
+
+CStakeSeenFilter::CStakeSeenFilter() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())), nPruneHeight(0), nTipHeight(0) {}
+
+uint64_t CStakeSeenFilter::GetKey(const COutPoint& prevout, unsigned int nTime) const
+{
+    return CSipHasher(k0, k1).Write(prevout.hash.begin(), 32).Write(((uint64_t)prevout.n << 32) | nTime).Finalize();
+}
+
+void CStakeSeenFilter::Insert(const COutPoint& prevout, unsigned int nTime, int nHeight)
+{
+    if (prevout.IsNull() || nHeight < nPruneHeight || nHeight > nTipHeight + STAKE_SEEN_FINALITY_DEPTH)
+        return;
+    std::pair<boost::unordered_map<uint64_t, int, CKeyHasher>::iterator, bool> ret = mapSeen.insert(std::make_pair(GetKey(prevout, nTime), nHeight));
+    if (!ret.second)
+        ret.first->second = std::max(ret.first->second, nHeight);
+}
+
+bool CStakeSeenFilter::Contains(const std::pair<COutPoint, unsigned int>& stake) const
+{
+    return mapSeen.count(GetKey(stake.first, stake.second)) > 0;
+}
+
+void CStakeSeenFilter::Prune(int nTipHeightIn)
+{
+    nTipHeight = nTipHeightIn;
+    int nHeight = nTipHeight - STAKE_SEEN_FINALITY_DEPTH;
+    if (nHeight < nPruneHeight + STAKE_SEEN_PRUNE_INTERVAL)
+        return;
+    nPruneHeight = nHeight;
+    for (boost::unordered_map<uint64_t, int, CKeyHasher>::iterator it = mapSeen.begin(); it != mapSeen.end(); ) {
+        if (it->second < nPruneHeight)
+            it = mapSeen.erase(it);
+        else
+            ++it;
+    }
+}
+
+void CStakeSeenFilter::Clear()
+{
+    mapSeen.clear();
+    nPruneHeight = 0;
+    nTipHeight = 0;
+}
+
+size_t CStakeSeenFilter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(mapSeen);
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake, const Consensus::Params& params)
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake, const Consensus::Params& params)
 {
     nStakeModifier = 0;
     if (!mapBlockIndex.count(hashBlockFrom))
@@ -266,42 +372,55 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval(params);
     int64_t nStakeModifierTargetTime = nStakeModifierTime + nStakeModifierSelectionInterval;
 
-    const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex *pNext = chainActive.Next(pindex);
-
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < nStakeModifierTargetTime)
+    // The kernel's block must be on the active chain for the modifier walk to be defined
+    const CBlockIndex* pindex = chainActive.Contains(pindexFrom) ? kernelModifierIndex.Find(pindexFrom, nStakeModifierTargetTime) : nullptr;
+    if (pindex == nullptr)
     {
-        if (pNext == nullptr)
+        // reached best block; may happen if node is behind on block chain
+        const CBlockIndex* pindexTip = chainActive.Tip();
+        if (fPrintProofOfStake || (pindexTip->GetBlockTime() + params.nStakeMinAge - nStakeModifierSelectionInterval > GetAdjustedTime()))
         {
-            // reached best block; may happen if node is behind on block chain
-            if (fPrintProofOfStake || (pindex->GetBlockTime() + params.nStakeMinAge - nStakeModifierSelectionInterval > GetAdjustedTime()))
-            {
-                LogPrintf("%s: reached best block %s at height %d from block %s\n", __func__,
-                    pindex->GetBlockHash().ToString().c_str(), pindex->nHeight, hashBlockFrom.ToString().c_str());
-                return false;
-            }
-            else
-            {
-                if (fDebug || GetBoolArg("-printstakemodifier", false))
-                    LogPrintf("%s: Nothing! Ending modifier=%u height=%d time=%u target=%u\n", __func__,
-                        nStakeModifier, nStakeModifierHeight, nStakeModifierTime, nStakeModifierTargetTime);
-                return false;
-            }
+            LogPrintf("%s: reached best block %s at height %d from block %s\n", __func__,
+                pindexTip->GetBlockHash().ToString().c_str(), pindexTip->nHeight, hashBlockFrom.ToString().c_str());
         }
-        pindex = pNext;
-        pNext = chainActive.Next(pindex);
-        //LogPrintf("DEBUG: pindex=%s\n", pindex->ToVerboseString());
-        if (pindex && pindex->GeneratedStakeModifier())
+        else if (fDebug || GetBoolArg("-printstakemodifier", false))
         {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
+            LogPrintf("%s: Nothing! Ending modifier=%u height=%d time=%u target=%u\n", __func__,
+                nStakeModifier, nStakeModifierHeight, nStakeModifierTime, nStakeModifierTargetTime);
         }
+        return false;
     }
+    nStakeModifierHeight = pindex->nHeight;
+    nStakeModifierTime = pindex->GetBlockTime();
     nStakeModifier = pindex->nStakeModifier;
     return true;
 }
 
+// Kernel hash of a stake input at nTimeTx. Needs no chain access, so the
+// staker can evaluate it from worker threads.
+uint256 GetStakeKernelHash(uint64_t nStakeModifier, const CStakeInputInfo& stakeInput, unsigned int nPrevoutN, unsigned int nTimeTx)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier;
+    ss << stakeInput.nTimeBlockFrom << stakeInput.nTxOffset << stakeInput.nTimeTx << nPrevoutN << nTimeTx;
+    return Hash(ss.begin(), ss.end());
+}
+
+// Kernel hash target of a stake input at nTimeTx given the average stake weight
+arith_uint256 GetStakeKernelTarget(unsigned int nBits, const CStakeInputInfo& stakeInput, unsigned int nTimeTx, double dAverageStakeWeight, const Consensus::Params& params)
+{
+    arith_uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    int64_t nValueIn = stakeInput.nValue;
+    int64_t timeWeight = GetWeight((int64_t)stakeInput.nTimeTx, (int64_t)nTimeTx, params);
+    int64_t nCoinDayWeight = nValueIn * timeWeight / COIN / (24 * 60 * 60);
+
+    // Stake Time factored weight
+    int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, nCoinDayWeight, dAverageStakeWeight, params);
+    arith_uint256 bnStakeTimeWeight = arith_uint256(nValueIn) * factoredTimeWeight / COIN / (24 * 60 * 60);
+    return bnStakeTimeWeight * bnTargetPerCoinDay;
+}
+
 // SolarCoin kernel protocol PoST
 // coinstake must meet hash target according to the protocol:
 // kernel (input 0) must meet the formula
@@ -323,36 +442,33 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params)
+bool CheckStakeTimeKernelHash(unsigned int nBits, const CStakeInputInfo& stakeInput, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params)
 {
-    if (nTimeTx < txPrev.nTime) {  // Transaction timestamp violation
+    if (nTimeTx < stakeInput.nTimeTx) {  // Transaction timestamp violation
         LogPrintf("%s(): nTime violation\n", __func__);
         return false;
     }
 
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    unsigned int nTimeBlockFrom = stakeInput.nTimeBlockFrom;
     if (nTimeBlockFrom + params.nStakeMinAge > nTimeTx) { // Min age requirement
         LogPrintf("%s(): min age violation\n", __func__);
         return false;
     }
 
-    arith_uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    uint256 hashBlockFrom = blockFrom.GetHash();
+    const uint256& hashBlockFrom = stakeInput.hashBlockFrom;
 
-    CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlockFrom);
+    if (mi == mapBlockIndex.end())
+        return error("%s(): block from not indexed", __func__);
+    CBlockIndex* pindexFrom = mi->second;
     int heightBlockFrom = pindexFrom->nHeight;
-    int64_t timeWeight = GetWeight((int64_t)txPrev.nTime, (int64_t)nTimeTx, params);
-    int64_t nCoinDayWeight = nValueIn * timeWeight / COIN / (24 * 60 * 60);
+    int64_t timeWeight = GetWeight((int64_t)stakeInput.nTimeTx, (int64_t)nTimeTx, params);
+    int64_t nCoinDayWeight = stakeInput.nValue * timeWeight / COIN / (24 * 60 * 60);
 
-    // Stake Time factored weight
-    int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, nCoinDayWeight, pindexPrev, params);
-    arith_uint256 bnStakeTimeWeight = arith_uint256(nValueIn) * factoredTimeWeight / COIN / (24 * 60 * 60);
-    targetProofOfStake = ArithToUint256(bnStakeTimeWeight * bnTargetPerCoinDay);
+    // Target scaled by the stake time factored weight
+    targetProofOfStake = ArithToUint256(GetStakeKernelTarget(nBits, stakeInput, nTimeTx, GetAverageStakeWeight(pindexPrev, params), params));
 
     // Calculate hash
-    CDataStream ss(SER_GETHASH, 0);
     uint64_t nStakeModifier = 0;
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
@@ -362,10 +478,7 @@ bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsig
         return false;
     }
 
-    ss << nStakeModifier;
-
-    ss << nTimeBlockFrom << nTxOffset << txPrev.nTime << prevout.n << nTimeTx;
-    hashProofOfStake = Hash(ss.begin(), ss.end());
+    hashProofOfStake = GetStakeKernelHash(nStakeModifier, stakeInput, prevout.n, nTimeTx);
 
     if (fPrintProofOfStake)
     {
@@ -373,11 +486,11 @@ bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsig
             nStakeModifier, nStakeModifierHeight,
             nStakeModifierTime,
             heightBlockFrom,
-            blockFrom.GetBlockTime(),
+            nTimeBlockFrom,
             timeWeight, nCoinDayWeight);
         LogPrintf("%s(): check modifier=%016x nTimeBlockFrom=%u nTxOffset=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s targetProof=%s\n", __func__,
             nStakeModifier,
-            nTimeBlockFrom, nTxOffset, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, stakeInput.nTxOffset, stakeInput.nTimeTx, prevout.n, nTimeTx,
             hashProofOfStake.ToString().c_str(), targetProofOfStake.ToString().c_str());
     }
 
@@ -392,28 +505,84 @@ bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsig
     return true;
 }
 
-// Check kernel hash target and coinstake signature
-bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params)
+// SolarCoin: Find the transaction of an output unspent in view in its block of
+// the active chain, which also gives its kernel offset.
+static bool GetStakeInputInfoFromView(const COutPoint& prevout, CStakeInputInfo& stakeInput, const CCoinsViewCache& view, const Consensus::Params& params)
 {
-    if (!tx.IsCoinStake())
-        return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
+    AssertLockHeld(cs_main);
+    const CCoins* coins = view.AccessCoins(prevout.hash);
+    if (!coins || !coins->IsAvailable(prevout.n))
+        return false;
+    CBlockIndex* pindex = chainActive[coins->nHeight];
+    CBlock block;
+    if (!pindex || !ReadBlockFromDisk(block, pindex, params))
+        return false;
+    unsigned int nTxOffset = 80 + GetSizeOfCompactSize(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        if (tx->GetHash() == prevout.hash) {
+            stakeInput = CStakeInputInfo(pindex->GetBlockHash(), block.GetBlockTime(), nTxOffset, tx->nTime, tx->vout[prevout.n].nValue);
+            return true;
+        }
+        nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return false;
+}
+
+// SolarCoin: Get the kernel fields of a previous output. The stake input index
+// holds the unspent outputs and answers with a single key lookup; outputs
+// confirmed before the index existed or spent on the active chain (as staked
+// by a competing branch) fall back to reading the transaction and block,
+// found through pview when given. Only ConnectBlock and DisconnectTip change
+// the index, this never writes to it.
+bool GetStakeInputInfo(const COutPoint& prevout, CStakeInputInfo& stakeInput, const Consensus::Params& params, const CCoinsViewCache* pview)
+{
+    // SolarCoin: a snapshot load fills the stake index for the coins below the snapshot
+    if ((fTxIndex || fSnapshotChainstate) && pblocktree->ReadStakeIndex(prevout, stakeInput) && mapBlockIndex.count(stakeInput.hashBlockFrom))
+        return true;
+
+    // SolarCoin: a view below the tip (background validation of a snapshot) has coins the tip has spent
+    if (pview && GetStakeInputInfoFromView(prevout, stakeInput, *pview, params))
+        return true;
 
-    // Kernel (input 0) must match the stake hash target per coin age (nBits)
-    const CTxIn& txIn = tx.vin[0];
-    const uint256& hashTx = txIn.prevout.hash;
     uint256 hashBlock;
     CTransactionRef txPrevRef;
 
     // First try finding the previous transaction in database
     unsigned int nTxOffset = 0;
-    if (!GetTransaction(hashTx, txPrevRef, nTxOffset, params, hashBlock, true)) {
+    if (!GetTransaction(prevout.hash, txPrevRef, nTxOffset, params, hashBlock, true)) {
         LogPrintf("%s(): INFO: read txPrev failed\n", __func__);  // previous transaction not in main chain, may occur during initial download
         return false;
     }
-    // Add the block header offset
-    nTxOffset += 80;
 
     const CTransaction& txPrev = *txPrevRef;
+    if (prevout.n >= txPrev.vout.size())
+        return error("%s(): prevout %s out of range", __func__, prevout.ToString());
+
+    // Read block header
+    CBlockHeader block;
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end() || !ReadBlockHeaderFromDisk(block, mi->second)) {
+        return fDebug ? error("%s() : read block failed", __func__) : false; // unable to read block of previous transaction
+    }
+
+    // Add the block header offset
+    stakeInput = CStakeInputInfo(hashBlock, block.GetBlockTime(), nTxOffset + 80, txPrev.nTime, txPrev.vout[prevout.n].nValue);
+
+    return true;
+}
+
+// Check kernel hash target and coinstake signature
+bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params, CBlockIndex* pindexPrev, const CCoinsViewCache* pview)
+{
+    if (!tx.IsCoinStake())
+        return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString().c_str());
+
+    // Kernel (input 0) must match the stake hash target per coin age (nBits)
+    const CTxIn& txIn = tx.vin[0];
+
+    CStakeInputInfo stakeInput;
+    if (!GetStakeInputInfo(txIn.prevout, stakeInput, params, pview))
+        return false;
 
     // TODO: Verify signature
     //if (!VerifySignature(txPrev, tx, 0, 0)) {
@@ -421,14 +590,9 @@ bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hash
     //    return false;
     //}
 
-    // Read block header
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-    if(!ReadBlockFromDisk(block, pblockindex, params, false)) {
-        return fDebug ? error("CheckProofOfStake() : read block failed") : false; // unable to read block of previous transaction
-    }
-
-    if (!CheckStakeTimeKernelHash(nBits, block, nTxOffset, txPrev, txIn.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, chainActive.Tip()->pprev, fDebug, params)) {
+    if (!pindexPrev)
+        pindexPrev = chainActive.Tip();
+    if (!CheckStakeTimeKernelHash(nBits, stakeInput, txIn.prevout, tx.nTime, hashProofOfStake, targetProofOfStake, pindexPrev->pprev, fDebug, params)) {
         LogPrintf("%s(): INFO: check kernel failed on coinstake %s, hashProof=%s\n", __func__, tx.GetHash().ToString(), hashProofOfStake.ToString()); // may occur during initial download or if behind on block chain sync
         return false;
     }
@@ -467,9 +631,14 @@ bool CheckStakeModifierCheckpoints(int nHeight, unsigned int nStakeModifierCheck
 
 // get stake time factored weight for reward and hash PoST
 int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    return GetStakeTimeFactoredWeight(timeWeight, nCoinDayWeight, GetAverageStakeWeight(pindexPrev, params), params);
+}
+
+int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, double dAverageStakeWeight, const Consensus::Params& params)
 {
     int64_t factoredTimeWeight;
-    double weightFraction = (nCoinDayWeight+1) / GetAverageStakeWeight(pindexPrev, params);
+    double weightFraction = (nCoinDayWeight+1) / dAverageStakeWeight;
     if (weightFraction > 0.45)
     {
         factoredTimeWeight = params.nStakeMinAge+1;
@@ -482,20 +651,13 @@ int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, C
     return factoredTimeWeight;
 }
 
-// get average stake weight of last 60 blocks PoST
-double GetAverageStakeWeight(CBlockIndex* pindexPrev, const Consensus::Params& params)
+// SolarCoin: average of the kernel rates of the 60 blocks up to pindexPrev.
+// Each ancestor caches its own kernel rate, so this is 60 lookups rather
+// than 60 walks of 72 blocks. The sum is kept in the original order since
+// the result feeds the kernel target and must round identically.
+static double ComputeAverageStakeWeight(CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
-    double weightSum = 0.0, weightAve = 0.0;
-    if (chainActive.Height() < 1)
-        return weightAve;
-
-    // Use cached weight if it's still valid
-    if (pindexPrev->nHeight == nAverageStakeWeightHeightCached)
-    {
-        return dAverageStakeWeightCached;
-    }
-    nAverageStakeWeightHeightCached = pindexPrev->nHeight;
-
+    double weightSum = 0.0;
     int i;
     CBlockIndex* currentBlockIndex = pindexPrev;
     for (i = 0; currentBlockIndex && i < 60; i++)
@@ -504,12 +666,29 @@ double GetAverageStakeWeight(CBlockIndex* pindexPrev, const Consensus::Params& p
         weightSum += tempWeight;
         currentBlockIndex = currentBlockIndex->pprev;
     }
-    weightAve = (weightSum/i)+21;
+    return (weightSum/i)+21;
+}
+
+// get average stake weight of last 60 blocks PoST
+double GetAverageStakeWeight(CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    double weightAve = 0.0;
+    if (chainActive.Height() < 1)
+        return weightAve;
 
-    // Cache the stake weight value
-    dAverageStakeWeightCached = weightAve;
+    // Use the weight cached on the block index when it was added
+    if (pindexPrev->dAverageStakeWeight >= 0)
+        return pindexPrev->dAverageStakeWeight;
 
-    return weightAve;
+    return ComputeAverageStakeWeight(pindexPrev, params);
+}
+
+void SetStakeWeightCache(CBlockIndex* pindex, const Consensus::Params& params)
+{
+    AssertLockHeld(cs_main);
+    // The kernel rate goes first, the average includes this block's own
+    pindex->dKernelPS = GetPoSKernelPS(pindex, params);
+    pindex->dAverageStakeWeight = ComputeAverageStakeWeight(pindex, params);
 }
 
 // ppcoin: total coin age spent in transaction, in the unit of coin-days.
@@ -529,37 +708,22 @@ bool GetCoinAge(const CTransaction& tx, uint64_t& nCoinAge, const Consensus::Par
 
     for (unsigned int i=0; i < tx.vin.size(); i++) {
         const CTxIn& txIn = tx.vin[i];
-        const uint256& hashTx = txIn.prevout.hash;
-        uint256 hashBlock;
-        CTransactionRef txPrevRef;
-
-        // First try finding the previous transaction in database
-        unsigned int nTxOffset = 0;
-        if (!GetTransaction(hashTx, txPrevRef, nTxOffset, params, hashBlock, true)) {
-            LogPrintf("%s(): INFO: read txPrev failed\n", __func__);  // previous transaction not in main chain, may occur during initial download
-            return false;
-        }
 
-        const CTransaction& txPrev = *txPrevRef;
+        CStakeInputInfo stakeInput;
+        if (!GetStakeInputInfo(txIn.prevout, stakeInput, params))
+            return false;
 
-        if (tx.nTime < txPrev.nTime)
+        if (tx.nTime < stakeInput.nTimeTx)
             return false;  // Transaction timestamp violation
 
-        // Read block header
-        CBlock block;
-        CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-        if(!ReadBlockFromDisk(block, pblockindex, params, false)) {
-            return fDebug ? error("GetStakeTime() : read block failed") : false; // unable to read block of previous transaction
-        }
-
-        if (block.GetBlockTime() + params.nStakeMinAge > tx.nTime)
+        if (stakeInput.nTimeBlockFrom + params.nStakeMinAge > tx.nTime)
             continue; // only count coins meeting min age requirement
 
-        int64_t nValueIn = txPrev.vout[txIn.prevout.n].nValue;
-        bnCentSecond += arith_uint256(nValueIn) * (tx.nTime - txPrev.nTime) / CENT;
+        int64_t nValueIn = stakeInput.nValue;
+        bnCentSecond += arith_uint256(nValueIn) * (tx.nTime - stakeInput.nTimeTx) / CENT;
 
         if (fDebug || GetBoolArg("-printcoinage", false))
-            LogPrintf("coin age nValueIn=%ld nTimeDiff=%ld bnCentSecond=%s\n", nValueIn, tx.nTime - txPrev.nTime, bnCentSecond.ToString());
+            LogPrintf("coin age nValueIn=%ld nTimeDiff=%ld bnCentSecond=%s\n", nValueIn, tx.nTime - stakeInput.nTimeTx, bnCentSecond.ToString());
     }
 
     arith_uint256 bnCoinDay = bnCentSecond * CENT / COIN / (24 * 60 * 60);
@@ -577,7 +741,7 @@ bool GetCoinAge(const CTransaction& tx, uint64_t& nCoinAge, const Consensus::Par
 // guaranteed to be in main chain by sync-checkpoint. This rule is
 // introduced to help nodes establish a consistent view of the coin
 // age (trust score) of competing branches. PoST
-bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params)
+bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params, const CCoinsViewCache* pview)
 {
     arith_uint256 bnStakeTime = 0;  // coin age in the unit of cent-seconds
     nStakeTime = 0;
@@ -587,34 +751,19 @@ bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pin
 
     for (unsigned int i=0; i < tx.vin.size(); i++) {
         const CTxIn& txIn = tx.vin[i];
-        const uint256& hashTx = txIn.prevout.hash;
-        uint256 hashBlock;
-        CTransactionRef txPrevRef;
-
-        // First try finding the previous transaction in database
-        unsigned int nTxOffset = 0;
-        if (!GetTransaction(hashTx, txPrevRef, nTxOffset, params, hashBlock, true)) {
-            LogPrintf("%s(): INFO: read txPrev failed\n", __func__);  // previous transaction not in main chain, may occur during initial download
-            return false;
-        }
 
-        const CTransaction& txPrev = *txPrevRef;
+        CStakeInputInfo stakeInput;
+        if (!GetStakeInputInfo(txIn.prevout, stakeInput, params, pview))
+            return false;
 
-        if (tx.nTime < txPrev.nTime)
+        if (tx.nTime < stakeInput.nTimeTx)
             return false;  // Transaction timestamp violation
 
-        // Read block header
-        CBlock block;
-        CBlockIndex* pblockindex = mapBlockIndex[hashBlock];
-        if(!ReadBlockFromDisk(block, pblockindex, params, false)) {
-            return fDebug ? error("GetStakeTime() : read block failed") : false; // unable to read block of previous transaction
-        }
-
-        if (block.GetBlockTime() + params.nStakeMinAge > tx.nTime)
+        if (stakeInput.nTimeBlockFrom + params.nStakeMinAge > tx.nTime)
             continue; // only count coins meeting min age requirement
 
-        int64_t nValueIn = txPrev.vout[txIn.prevout.n].nValue;
-        int64_t timeWeight = tx.nTime - txPrev.nTime;
+        int64_t nValueIn = stakeInput.nValue;
+        int64_t timeWeight = tx.nTime - stakeInput.nTimeTx;
 
         // Prevent really large stake weights by maxing at 30 days weight (2.0.2 restriction)
         if (timeWeight > 30 * (24 * 60 * 60))
@@ -640,6 +789,11 @@ double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params)
     double dStakeKernelsTriedAvg = 0;
     int nStakesHandled = 0, nStakesTime = 0;
 
+    if (!pindexPrev)
+        return 0;
+    if (pindexPrev->dKernelPS >= 0)
+        return pindexPrev->dKernelPS;
+
     CBlockIndex* pindexPrevStake = nullptr;
 
     while (pindexPrev && nStakesHandled < nPoSInterval)
@@ -659,5 +813,5 @@ double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params)
         pindexPrev = pindexPrev->pprev;
     }
 
-   return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
+    return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
 }
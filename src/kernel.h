@@ -4,28 +4,122 @@
 #ifndef PPCOIN_KERNEL_H
 #define PPCOIN_KERNEL_H
 
+#include <arith_uint256.h>
 #include <consensus/params.h>
 #include <primitives/block.h>
 
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+class CCoinsViewCache;
+struct CStakeInputInfo;
+
 // MODIFIER_INTERVAL_RATIO:
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
 
 int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd, const Consensus::Params& params);
 bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier, const Consensus::Params& params);
-bool CheckStakeTimeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params);
-bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params);
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake, const Consensus::Params& params);
+uint256 GetStakeKernelHash(uint64_t nStakeModifier, const CStakeInputInfo& stakeInput, unsigned int nPrevoutN, unsigned int nTimeTx);
+arith_uint256 GetStakeKernelTarget(unsigned int nBits, const CStakeInputInfo& stakeInput, unsigned int nTimeTx, double dAverageStakeWeight, const Consensus::Params& params);
+bool CheckStakeTimeKernelHash(unsigned int nBits, const CStakeInputInfo& stakeInput, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, uint256& targetProofOfStake, CBlockIndex* pindexPrev, bool fPrintProofOfStake, const Consensus::Params& params);
+/** Kernel fields of a previous output; pview lets it find outputs the active tip has already spent. */
+bool GetStakeInputInfo(const COutPoint& prevout, CStakeInputInfo& stakeInput, const Consensus::Params& params, const CCoinsViewCache* pview = NULL);
+/** Check a coinstake kernel on top of pindexPrev (the active tip by default), its inputs found as GetStakeInputInfo does. */
+bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params, CBlockIndex* pindexPrev = NULL, const CCoinsViewCache* pview = NULL);
 bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
 unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex, const Consensus::Params& params);
 bool CheckStakeModifierCheckpoints(int nHeight, unsigned int nStakeModifierChecksum);
+/** Average stake weight of the 60 blocks up to pindexPrev, from the block index cache when it is set. */
 double GetAverageStakeWeight(CBlockIndex* pindexPrev, const Consensus::Params& params);
+/** Fill the stake weight cache of a block index entry as it is added or loaded. Requires cs_main. */
+void SetStakeWeightCache(CBlockIndex* pindex, const Consensus::Params& params);
 int64_t GetStakeModifierSelectionIntervalSection(int nSection, const Consensus::Params& params);
 int64_t GetStakeModifierSelectionInterval(const Consensus::Params& params);
 int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, CBlockIndex* pindexPrev, const Consensus::Params& params);
+int64_t GetStakeTimeFactoredWeight(int64_t timeWeight, int64_t nCoinDayWeight, double dAverageStakeWeight, const Consensus::Params& params);
 bool GetCoinAge(const CTransaction& tx, uint64_t& nCoinAge, const Consensus::Params& params);
-bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params);
+bool GetStakeTime(const CTransaction& tx, uint64_t& nStakeTime, CBlockIndex* pindexPrev, const Consensus::Params& params, const CCoinsViewCache* pview = NULL);
+/** Stake kernels tried per second over the 72 PoST blocks up to pindexPrev, from the block index cache when it is set. */
 double GetPoSKernelPS(CBlockIndex* pindexPrev, const Consensus::Params& params);
 
+/**
+ * SolarCoin: blocks of the active chain that generated a stake modifier,
+ * in height order. Lets GetKernelStakeModifier find the modifier a
+ * selection interval after a kernel's block with a binary search instead
+ * of walking the chain forward. Maintained by ConnectTip/DisconnectTip
+ * under cs_main.
+ */
+class CKernelModifierIndex
+{
+private:
+    struct CEntry {
+        const CBlockIndex* pindex;
+        int64_t nTimeMax; // highest block time of this and all earlier entries
+    };
+    std::vector<CEntry> vEntries;
+
+public:
+    void Connect(const CBlockIndex* pindex);
+    void Disconnect(const CBlockIndex* pindex);
+    void Rebuild(const CBlockIndex* pindexTip);
+    void Clear() { vEntries.clear(); }
+
+    /** First modifier generating block above pindexFrom with a time of at least nTargetTime, or NULL */
+    const CBlockIndex* Find(const CBlockIndex* pindexFrom, int64_t nTargetTime) const;
+};
+
+extern CKernelModifierIndex kernelModifierIndex;
+
+//! Stakes seen more than this many blocks below the tip are dropped from the duplicate-stake filter
+static const int STAKE_SEEN_FINALITY_DEPTH = 1024;
+//! Blocks the pruning floor must advance before the filter is scanned again
+static const int STAKE_SEEN_PRUNE_INTERVAL = 64;
+
+/**
+ * SolarCoin: (prevout, nTime) stakes of recent proof-of-stake blocks, used by
+ * ProcessNewBlock to reject duplicate stakes before checking the kernel.
+ * Stakes are keyed by a salted 64-bit hash instead of the pair itself, and
+ * those more than STAKE_SEEN_FINALITY_DEPTH blocks below the tip are pruned,
+ * as a fork that deep is not followed anyway. Stakes of headers more than
+ * STAKE_SEEN_FINALITY_DEPTH blocks above the tip are not recorded either, so
+ * headers-first sync does not grow the filter with the whole header chain;
+ * they are recorded when their block is connected. Requires cs_main.
+ */
+class CStakeSeenFilter
+{
+private:
+    struct CKeyHasher {
+        size_t operator()(uint64_t nKey) const { return nKey; }
+    };
+    //! Height each stake was seen at, by salted hash of the stake
+    boost::unordered_map<uint64_t, int, CKeyHasher> mapSeen;
+    const uint64_t k0, k1;
+    //! Stakes below this height are not recorded
+    int nPruneHeight;
+    //! Height of the tip the filter was last pruned at
+    int nTipHeight;
+
+    uint64_t GetKey(const COutPoint& prevout, unsigned int nTime) const;
+
+public:
+    CStakeSeenFilter();
+
+    /** Record a stake, unless nHeight is outside STAKE_SEEN_FINALITY_DEPTH of the tip */
+    void Insert(const COutPoint& prevout, unsigned int nTime, int nHeight);
+    bool Contains(const std::pair<COutPoint, unsigned int>& stake) const;
+    /** Drop stakes more than STAKE_SEEN_FINALITY_DEPTH blocks below nTipHeightIn */
+    void Prune(int nTipHeightIn);
+    void Clear();
+
+    size_t Size() const { return mapSeen.size(); }
+    size_t DynamicMemoryUsage() const;
+};
+
+extern CStakeSeenFilter stakeSeenFilter;
+
 // This is needed because the foreach macro can't get over the comma in pair<t1, t2>
 #define PAIRTYPE(t1, t2)    std::pair<t1, t2>
 
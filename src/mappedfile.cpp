@@ -0,0 +1,78 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+
+#include "util.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
+CMappedFile::CMappedFile(const fs::path& path) : pbegin(NULL), nSize(0), hMapping(NULL)
+{
+    HANDLE hFile = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        LogPrintf("%s: unable to open %s\n", __func__, path.string());
+        return;
+    }
+    LARGE_INTEGER nFileSize;
+    if (GetFileSizeEx(hFile, &nFileSize) && nFileSize.QuadPart > 0) {
+        hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping) {
+            pbegin = static_cast<const char*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+            if (pbegin) {
+                nSize = nFileSize.QuadPart;
+            } else {
+                CloseHandle(hMapping);
+                hMapping = NULL;
+            }
+        }
+    }
+    CloseHandle(hFile);
+    if (!pbegin)
+        LogPrintf("%s: unable to map %s\n", __func__, path.string());
+}
+
+CMappedFile::~CMappedFile()
+{
+    if (pbegin)
+        UnmapViewOfFile(pbegin);
+    if (hMapping)
+        CloseHandle(hMapping);
+}
+#else
+CMappedFile::CMappedFile(const fs::path& path) : pbegin(NULL), nSize(0)
+{
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        LogPrintf("%s: unable to open %s\n", __func__, path.string());
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            pbegin = static_cast<const char*>(p);
+            nSize = st.st_size;
+        }
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (!pbegin)
+        LogPrintf("%s: unable to map %s\n", __func__, path.string());
+}
+
+CMappedFile::~CMappedFile()
+{
+    if (pbegin)
+        munmap(const_cast<char*>(pbegin), nSize);
+}
+#endif
@@ -0,0 +1,39 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAPPEDFILE_H
+#define BITCOIN_MAPPEDFILE_H
+
+#include "fs.h"
+
+#include <stddef.h>
+
+/**
+ * Read-only memory mapping of a whole file. The file must not be written to
+ * or truncated while it is mapped. IsNull() is true if mapping failed, in
+ * which case callers should fall back to stdio.
+ */
+class CMappedFile
+{
+private:
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+    const char* pbegin;
+    size_t nSize;
+#ifdef WIN32
+    void* hMapping;
+#endif
+
+public:
+    explicit CMappedFile(const fs::path& path);
+    ~CMappedFile();
+
+    bool IsNull() const { return pbegin == NULL; }
+    const char* data() const { return pbegin; }
+    size_t size() const { return nSize; }
+};
+
+#endif // BITCOIN_MAPPEDFILE_H
@@ -164,8 +164,10 @@ private:
 
 public:
     BlockAssembler(const CChainParams& chainparams);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
+    /** Construct a new block template with coinbase to scriptPubKeyIn.
+     *  A proof-of-stake template has an empty coinbase and no witness
+     *  commitment; the staker adds both along with the coinstake. */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true, bool fProofOfStake=false);
 
 private:
     // utility functions
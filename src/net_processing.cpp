@@ -22,6 +22,7 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "random.h"
+#include "snapshot.h"
 #include "tinyformat.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -618,6 +619,32 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     }
 }
 
+/** SolarCoin: add the blocks below a snapshot chainstate that its background validation needs next
+ *  and the peer can serve to vBlocks, in height order, until it has at most count entries. */
+void FindSnapshotBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks) {
+    int nValidatedHeight, nSnapshotHeight;
+    if (count == 0 || !GetSnapshotValidationProgress(nValidatedHeight, nSnapshotHeight))
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != NULL);
+    ProcessBlockAvailability(nodeid);
+
+    // Only from peers whose chain runs through the whole window
+    int nWindowEnd = std::min<int>(nSnapshotHeight, nValidatedHeight + BLOCK_DOWNLOAD_WINDOW);
+    if (state->pindexBestKnownBlock == NULL || state->pindexBestKnownBlock->GetAncestor(nWindowEnd) != chainActive[nWindowEnd])
+        return;
+
+    for (int nHeight = nValidatedHeight + 1; nHeight <= nWindowEnd; nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) && mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
+            vBlocks.push_back(pindex);
+            if (vBlocks.size() == count)
+                return;
+        }
+    }
+}
+
 } // anon namespace
 
 // DEBUG: 0.15.1
@@ -2090,7 +2117,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // If pruning, don't inv blocks unless we have on disk and are likely to still have
             // for some reasonable time window (1 hour) that block relay might require.
             const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / chainparams.GetConsensus().nTargetSpacing;
-            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave))
+            if ((fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA)) || (fPruneMode && pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave))
             {
                 LogPrint("net", " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
@@ -3700,6 +3727,18 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                 }
             }
         }
+        // SolarCoin: then the blocks below a snapshot chainstate, for its background validation
+        if (!pto->fClient && (pto->nServices & NODE_NETWORK) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            std::vector<const CBlockIndex*> vToDownload;
+            FindSnapshotBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload);
+            BOOST_FOREACH(const CBlockIndex *pindex, vToDownload) {
+                uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
+                vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
+                MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
+                LogPrint("net", "Requesting block %s (%d) below the snapshot peer=%d\n", pindex->GetBlockHash().ToString(),
+                    pindex->nHeight, pto->id);
+            }
+        }
 
         //
         // Message: getdata (non-blocks)
@@ -80,11 +80,17 @@ int GetBlockRatePerHour(const Consensus::Params& params)
     return nRate;
 }
 
+// Stake subsidy of nStakeTime coin-days at a yearly interest rate in percent PoST
+int64_t GetProofOfStakeTimeSubsidy(int64_t nStakeTime, double dInterestRate)
+{
+    int64_t nInterestRate = dInterestRate*CENT;
+    return nStakeTime * nInterestRate * 33 / (365 * 33 + 8);
+}
+
 // Stakers coin reward based on coin stake time factor and targeted inflation rate PoST
 int64_t GetProofOfStakeTimeReward(int64_t nStakeTime, int64_t nFees, CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
-    int64_t nInterestRate = GetCurrentInterestRate(pindexPrev, params)*CENT;
-    int64_t nSubsidy = nStakeTime * nInterestRate * 33 / (365 * 33 + 8);
+    int64_t nSubsidy = GetProofOfStakeTimeSubsidy(nStakeTime, GetCurrentInterestRate(pindexPrev, params));
 
     if (fDebug && GetBoolArg("-printcreation", false))
         LogPrintf("%s(): create=%s nStakeTime=%ld\n", __func__, FormatMoney(nSubsidy).c_str(), nStakeTime);
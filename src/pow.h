@@ -19,6 +19,7 @@ double GetCurrentInflationRate(double nAverageWeight);
 double GetCurrentInterestRate(CBlockIndex* pindexPrev, const Consensus::Params& params);
 int64_t GetCurrentCoinSupply(CBlockIndex* pindexPrev, const Consensus::Params& params);
 int GetBlockRatePerHour(const Consensus::Params& params);
+int64_t GetProofOfStakeTimeSubsidy(int64_t nStakeTime, double dInterestRate);
 int64_t GetProofOfStakeTimeReward(int64_t nStakeTime, int64_t nFees, CBlockIndex* pindexPrev, const Consensus::Params& params);
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake, const Consensus::Params& params);
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
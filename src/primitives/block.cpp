@@ -7,6 +7,7 @@
 #include "chain.h"
 #include "primitives/transaction.h"
 #include "key.h"
+#include "script/script.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 #include "stdlib.h"
@@ -57,112 +58,34 @@ int64_t GetBlockWeight(const CBlock& block)
     return ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * (WITNESS_SCALE_FACTOR - 1) + ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
 }
 
-/* TODO: Staking 
-
-// solarcoin: attempt to generate suitable proof-of-stake
-bool CBlock::SignBlock(CWallet& wallet, int64_t nFees)
-
+void GetPoWHashes(const std::vector<const CBlockHeader*>& vHeaders, std::vector<uint256>& vHashes)
 {
-    // if we are trying to sign
-    //    something except proof-of-stake block template
-    const CTransaction& tx = (const CTransaction&)vtx[0];
-    if (!tx.vout[0].IsEmpty())
-        return false;
-
-    // if we are trying to sign
-    //    a complete proof-of-stake block
-    if (IsProofOfStake())
-        return true;
-
-    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // startup timestamp
-
-    CKey key;
-    CTransaction txCoinStake;
-
-    int64_t nSearchTime = txCoinStake.nTime; // search to current time
-
-    if (nSearchTime > nLastCoinStakeSearchTime)
-    {
-        if (wallet.CreateCoinStakeTime(wallet, nBits, nSearchTime - nLastCoinStakeSearchTime, nFees, txCoinStake, key))
-        {
-            if (txCoinStake.nTime >= max(pindexBest->GetMedianTimePast()+1, PastDrift(pindexBest->GetBlockTime())))
-            {
-                // make sure coinstake would meet timestamp protocol
-                //    as it would be the same as the block timestamp
-                vtx[0].nTime = nTime = txCoinStake.nTime;
-                nTime = max(pindexBest->GetMedianTimePast()+1, GetMaxTransactionTime());
-                nTime = max(GetBlockTime(), PastDrift(pindexBest->GetBlockTime()));
-
-                // we have to make sure that we have no future timestamps in
-                //    our transactions set
-                for (vector<CTransaction>::iterator it = vtx.begin(); it != vtx.end();)
-                    if (it->nTime > nTime) { it = vtx.erase(it); } else { ++it; }
-
-                vtx.insert(vtx.begin() + 1, txCoinStake);
-                // TODO: hashMerkleRoot = BuildMerkleTree();
-
-                // append a signature to our block
-                return key.Sign(GetHash(), vchBlockSig);
-            }
-        }
-        nLastCoinStakeSearchInterval = nSearchTime - nLastCoinStakeSearchTime;
-        nLastCoinStakeSearchTime = nSearchTime;
-    }
-
-    return false;
+    // Same 80 bytes GetPoWHash() hashes, laid out back to back
+    std::vector<char> vInput(80 * vHeaders.size());
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        memcpy(&vInput[80 * i], BEGIN(vHeaders[i]->nVersion), 80);
+    std::vector<char> vOutput(32 * vHeaders.size());
+    scrypt_1024_1_1_256_batch(vInput.data(), vOutput.data(), vHeaders.size());
+    vHashes.resize(vHeaders.size());
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        memcpy(vHashes[i].begin(), &vOutput[32 * i], 32);
 }
 
 // ppcoin: check block signature
-bool CBlock::CheckBlockSignature(bool fProofOfStake) const
+bool CBlock::CheckBlockSignature() const
 {
-    if (GetHash() == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet))
-        return vchBlockSig.empty();
-
-    vector<valtype> vSolutions;
-    txnouttype whichType;
-
-    if(fProofOfStake)
-    {
-        const CTxOut& txout = vtx[1].vout[1];
-
-        if (!Solver(txout.scriptPubKey, whichType, vSolutions))
-            return false;
-        if (whichType == TX_PUBKEY)
-        {
-            valtype& vchPubKey = vSolutions[0];
-            CKey key;
-            if (!key.SetPubKey(vchPubKey))
-                return false;
-            if (vchBlockSig.empty())
-                return false;
-            return key.Verify(GetHash(), vchBlockSig);
-        }
-    }
-    else
-    {
-        for(unsigned int i = 0; i < vtx[0].vout.size(); i++)
-        {
-            const CTxOut& txout = vtx[0].vout[i];
-
-            if (!Solver(txout.scriptPubKey, whichType, vSolutions))
-                return false;
-
-            if (whichType == TX_PUBKEY)
-            {
-                // Verify
-                valtype& vchPubKey = vSolutions[0];
-                CKey key;
-                if (!key.SetPubKey(vchPubKey))
-                    continue;
-                if (vchBlockSig.empty())
-                    continue;
-                if(!key.Verify(GetHash(), vchBlockSig))
-                    continue;
+    if (!IsProofOfStake() || vchBlockSig.empty())
+        return false;
 
-                return true;
-            }
-        }
-    }
-    return false;
+    // The second output of the coinstake pays to a public key, see the staker
+    const CScript& scriptPubKey = vtx[1]->vout[1].scriptPubKey;
+    CScript::const_iterator pc = scriptPubKey.begin();
+    opcodetype opcode;
+    valtype vchPubKey;
+    if (!scriptPubKey.GetOp(pc, opcode, vchPubKey))
+        return false;
+    CPubKey pubkey(vchPubKey);
+    if (!pubkey.IsValid() || !scriptPubKey.GetOp(pc, opcode) || opcode != OP_CHECKSIG || pc != scriptPubKey.end())
+        return false;
+    return pubkey.Verify(GetHash(), vchBlockSig);
 }
-*/
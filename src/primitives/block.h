@@ -16,7 +16,6 @@
 #include "utilstrencodings.h"
 
 class CBlockIndex;
-class CWallet;
 
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
@@ -185,8 +184,7 @@ public:
     // ppcoin: two types of block: proof-of-work or proof-of-stake
     bool IsProofOfStake() const
     {
-        const CTransaction& tx = *vtx[1];
-        return (vtx.size() > 1 && tx.IsCoinStake());
+        return (vtx.size() > 1 && vtx[1]->IsCoinStake());
     }
 
     bool IsProofOfWork() const
@@ -196,12 +194,11 @@ public:
 
     std::pair<COutPoint, unsigned int> GetProofOfStake() const
     {
-        const CTransaction& tx = *vtx[1];
-        return IsProofOfStake() ? std::make_pair(tx.vin[0].prevout, tx.nTime) : std::make_pair(COutPoint(), (unsigned int)0);
+        return IsProofOfStake() ? std::make_pair(vtx[1]->vin[0].prevout, vtx[1]->nTime) : std::make_pair(COutPoint(), (unsigned int)0);
     }
 
-    bool SignBlock(CWallet& wallet, int64_t nFees);
-    bool CheckBlockSignature(bool fProofOfStake) const;
+    /** Whether vchBlockSig signs the block hash with the key the coinstake pays to */
+    bool CheckBlockSignature() const;
 };
 
 /** Describes a place in the block chain to another node such that if the
@@ -240,4 +237,7 @@ struct CBlockLocator
 /** Compute the consensus-critical block weight (see BIP 141). */
 int64_t GetBlockWeight(const CBlock& tx);
 
+/** SolarCoin: scrypt proof-of-work hashes of several headers at once, see scrypt_1024_1_1_256_batch. */
+void GetPoWHashes(const std::vector<const CBlockHeader*>& vHeaders, std::vector<uint256>& vHashes);
+
 #endif // BITCOIN_PRIMITIVES_BLOCK_H
@@ -9,6 +9,7 @@
 #include "primitives/transaction.h"
 #include "validation.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -56,11 +57,40 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails = false);
+extern void blockToJSON(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails = false);
 extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSON(CJSONStreamWriter& writer, bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
-extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern UniValue blockheaderToJSON(const CBlockIndex* blockindex, const CChainSnapshot& chain);
+extern bool IsBlockPruned(const CBlockIndex* blockindex);
+
+/**
+ * Reply with a JSON document that write puts into the stream as it is
+ * generated. If the client goes away or writing fails midway, the connection
+ * is closed instead of the reply being ended.
+ */
+static bool StreamJSONReply(HTTPRequest* req, const std::function<void(CJSONStreamWriter&)>& write)
+{
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReplyStart(HTTP_OK);
+    CJSONStreamWriter writer([req](const std::string& strChunk) {
+        if (!req->WriteReplyChunk(strChunk))
+            throw std::runtime_error("HTTP client disconnected");
+    });
+    try {
+        write(writer);
+        writer.Flush();
+    } catch (...) {
+        LogPrintf("%s: reply to %s failed after it was started\n", __func__, req->GetURI());
+        req->WriteReplyAbort();
+        return false;
+    }
+    req->WriteReplyChunk("\n");
+    req->WriteReplyEnd();
+    return true;
+}
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string message)
 {
@@ -145,18 +175,15 @@ static bool rest_headers(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
     std::vector<const CBlockIndex *> headers;
     headers.reserve(count);
-    {
-        LOCK(cs_main);
-        BlockMap::const_iterator it = mapBlockIndex.find(hash);
-        const CBlockIndex *pindex = (it != mapBlockIndex.end()) ? it->second : NULL;
-        while (pindex != NULL && chainActive.Contains(pindex)) {
-            headers.push_back(pindex);
-            if (headers.size() == (unsigned long)count)
-                break;
-            pindex = chainActive.Next(pindex);
-        }
+    const CBlockIndex *pindex = LookupBlockIndex(hash);
+    while (pindex != NULL && chain->Contains(pindex)) {
+        headers.push_back(pindex);
+        if (headers.size() == (unsigned long)count)
+            break;
+        pindex = chain->Next(pindex);
     }
 
     CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
@@ -181,7 +208,7 @@ static bool rest_headers(HTTPRequest* req,
     case RF_JSON: {
         UniValue jsonHeaders(UniValue::VARR);
         BOOST_FOREACH(const CBlockIndex *pindex, headers) {
-            jsonHeaders.push_back(blockheaderToJSON(pindex));
+            jsonHeaders.push_back(blockheaderToJSON(pindex, *chain));
         }
         std::string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
@@ -210,19 +237,16 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
-    CBlockIndex* pblockindex = NULL;
-    {
-        LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
-        pblockindex = mapBlockIndex[hash];
-        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+    CBlock block;
+    if (!ReadChainBlockFromDisk(block, pblockindex, *chain, Params().GetConsensus())) {
+        if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
-
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
@@ -244,11 +268,9 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
+        return StreamJSONReply(req, [&](CJSONStreamWriter& writer) {
+            blockToJSON(writer, block, pblockindex, *chain, showTxDetails);
+        });
     }
 
     default: {
@@ -333,12 +355,9 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        std::string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
+        return StreamJSONReply(req, [](CJSONStreamWriter& writer) {
+            mempoolToJSON(writer, true);
+        });
     }
     default: {
         return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
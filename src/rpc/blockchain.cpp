@@ -8,11 +8,15 @@
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
+#include "coinstats.h"
 #include "consensus/validation.h"
+#include "dbwrapper.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
+#include "snapshot.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -36,6 +40,20 @@ struct CUpdatedBlock
     int height;
 };
 
+/** Block index fields that change after the entry is added, copied together under cs_main */
+struct CBlockIndexState
+{
+    arith_uint256 nChainWork;
+    bool fPruned; //!< block data pruned, as opposed to never received
+
+    explicit CBlockIndexState(const CBlockIndex* pindex)
+    {
+        LOCK(cs_main);
+        nChainWork = pindex->nChainWork;
+        fPruned = fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0;
+    }
+};
+
 static std::mutex cs_blockchange;
 static std::condition_variable cond_blockchange;
 static CUpdatedBlock latestblock;
@@ -74,14 +92,20 @@ double GetDifficulty(const CBlockIndex* blockindex)
     return dDiff;
 }
 
-UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+bool IsBlockPruned(const CBlockIndex* blockindex)
 {
+    return CBlockIndexState(blockindex).fPruned;
+}
+
+UniValue blockheaderToJSON(const CBlockIndex* blockindex, const CChainSnapshot& chain)
+{
+    const CBlockIndexState state(blockindex);
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain.Contains(blockindex))
+        confirmations = chain.Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", blockindex->nVersion));
@@ -92,24 +116,35 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("nonce", (uint64_t)blockindex->nNonce));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    result.push_back(Pair("chainwork", state.nChainWork.GetHex()));
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pskip = chainActive.Next(blockindex);
+    const CBlockIndex *pskip = chain.Next(blockindex);
     if (pskip)
         result.push_back(Pair("nextblockhash", pskip->GetBlockHash().GetHex()));
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+static UniValue blockTxToJSON(const CTransaction& tx, bool txDetails)
 {
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToJSON(tx, uint256(), objTx);
+    return objTx;
+}
+
+/** The fields of blockToJSON, with an empty "tx" array unless fTxs is set */
+static UniValue blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails, bool fTxs)
+{
+    const CBlockIndexState state(blockindex);
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    if (chain.Contains(blockindex))
+        confirmations = chain.Height() - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
@@ -119,16 +154,9 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     UniValue txs(UniValue::VARR);
-    for(const auto& tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(*tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx->GetHash().GetHex());
+    if (fTxs) {
+        for (const auto& tx : block.vtx)
+            txs.push_back(blockTxToJSON(*tx, txDetails));
     }
     result.push_back(Pair("tx", txs));
     result.push_back(Pair("time", block.GetBlockTime()));
@@ -136,16 +164,42 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("nonce", (uint64_t)block.nNonce));
     result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    result.push_back(Pair("chainwork", state.nChainWork.GetHex()));
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pskip = chainActive.Next(blockindex);
+    const CBlockIndex *pskip = chain.Next(blockindex);
     if (pskip)
         result.push_back(Pair("nextblockhash", pskip->GetBlockHash().GetHex()));
     return result;
 }
 
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails = false)
+{
+    return blockFieldsToJSON(block, blockindex, chain, txDetails, true);
+}
+
+void blockToJSON(CJSONStreamWriter& writer, const CBlock& block, const CBlockIndex* blockindex, const CChainSnapshot& chain, bool txDetails = false)
+{
+    // Only the transactions are large, they are written one at a time
+    UniValue result = blockFieldsToJSON(block, blockindex, chain, txDetails, false);
+    const std::vector<std::string>& keys = result.getKeys();
+    const std::vector<UniValue>& values = result.getValues();
+    writer.BeginObject();
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] != "tx") {
+            writer.KeyValue(keys[i], values[i]);
+            continue;
+        }
+        writer.Key(keys[i]);
+        writer.BeginArray();
+        for (const auto& tx : block.vtx)
+            writer.Value(blockTxToJSON(*tx, txDetails));
+        writer.EndArray();
+    }
+    writer.EndObject();
+}
+
 UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -411,6 +465,32 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+void mempoolToJSON(CJSONStreamWriter& writer, bool fVerbose = false)
+{
+    if (fVerbose)
+    {
+        LOCK(mempool.cs);
+        writer.BeginObject();
+        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+        {
+            UniValue info(UniValue::VOBJ);
+            entryToJSON(info, e);
+            writer.KeyValue(e.GetTx().GetHash().ToString(), info);
+        }
+        writer.EndObject();
+    }
+    else
+    {
+        vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        writer.BeginArray();
+        BOOST_FOREACH(const uint256& hash, vtxid)
+            writer.Value(hash.ToString());
+        writer.EndArray();
+    }
+}
+
 UniValue getrawmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -439,6 +519,10 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     if (request.params.size() > 0)
         fVerbose = request.params[0].get_bool();
 
+    if (request.pstream) {
+        mempoolToJSON(*request.pstream, fVerbose);
+        return NullUniValue;
+    }
     return mempoolToJSON(fVerbose);
 }
 
@@ -662,8 +746,6 @@ UniValue getblockheader(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockheader", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -671,11 +753,13 @@ UniValue getblockheader(const JSONRPCRequest& request)
     if (request.params.size() > 1)
         fVerbose = request.params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    // Block index entries never change their header fields and the snapshot
+    // is immutable, blockheaderToJSON takes cs_main only to copy the rest.
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if (!fVerbose)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -684,7 +768,7 @@ UniValue getblockheader(const JSONRPCRequest& request)
         return strHex;
     }
 
-    return blockheaderToJSON(pblockindex);
+    return blockheaderToJSON(pblockindex, *chain);
 }
 
 UniValue getblock(const JSONRPCRequest& request)
@@ -728,8 +812,6 @@ UniValue getblock(const JSONRPCRequest& request)
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -737,17 +819,17 @@ UniValue getblock(const JSONRPCRequest& request)
     if (request.params.size() > 1)
         fVerbose = request.params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    std::shared_ptr<const CChainSnapshot> chain = GetChainSnapshot();
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    if (!ReadChainBlockFromDisk(block, pblockindex, *chain, Params().GetConsensus())) {
+        if (IsBlockPruned(pblockindex))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    }
 
     if (!fVerbose)
     {
@@ -757,23 +839,14 @@ UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex);
+    if (request.pstream) {
+        blockToJSON(*request.pstream, block, pblockindex, *chain);
+        return NullUniValue;
+    }
+    return blockToJSON(block, pblockindex, *chain);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nSerializedSize;
-    uint256 hashSerialized;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
-};
-
-//! Calculate statistics about the unspent transaction output set
+//! Calculate statistics about the unspent transaction output set, hashing it in database order
 static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 {
     std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
@@ -865,29 +938,53 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, except with the muhash hash_type: its first call scans the set in\n"
+            "parallel, later calls are answered from statistics kept up to date as blocks are connected and disconnected.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"   (string, optional, default=hash_serialized) Which UTXO set hash to calculate:\n"
+            "                 \"hash_serialized\" (sequential scan on every call) or \"muhash\" (order independent, cached)\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size (only with hash_serialized)\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash (only with hash_serialized)\n"
+            "  \"muhash\": \"hash\",            (string) The MuHash3072 of the unspent outputs (only with muhash)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    std::string strHashType = "hash_serialized";
+    if (request.params.size() > 0 && !request.params[0].isNull())
+        strHashType = request.params[0].get_str();
+    if (strHashType != "muhash" && strHashType != "hash_serialized")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + strHashType);
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
+    if (strHashType == "muhash") {
+        if (!coinsStatsCache.GetStats(pcoinsTip, stats))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        ret.push_back(Pair("height", (int64_t)stats.nHeight));
+        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+        ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        return ret;
+    }
+
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsTip, stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
@@ -903,6 +1000,52 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the unspent transaction output set, the block index up to the current tip and the stake\n"
+            "data of the unspent outputs to a snapshot file, which a new node can load with -loadtxoutset.\n"
+            "Note this call may take some time, it is much faster with -txindex.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory. It must not exist.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",             (string) the absolute path of the snapshot\n"
+            "  \"height\":n,                 (numeric) the block height of the snapshot\n"
+            "  \"bestblock\": \"hex\",         (string) the block hash of the snapshot\n"
+            "  \"transactions\": n,          (numeric) the number of transactions\n"
+            "  \"txouts\": n,                (numeric) the number of unspent outputs\n"
+            "  \"hash_serialized\": \"hash\",  (string) the same hash gettxoutsetinfo reports at this block\n"
+            "  \"snapshot_hash\": \"hash\"     (string) the hash of the snapshot file, for -loadtxoutsethash\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CSnapshotStats stats;
+    std::string strError;
+    FlushStateToDisk();
+    if (!DumpSnapshot(pcoinsTip, path, stats, strError))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("height", stats.nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+    ret.push_back(Pair("snapshot_hash", stats.hashSnapshot.GetHex()));
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -941,8 +1084,6 @@ UniValue gettxout(const JSONRPCRequest& request)
             + HelpExampleRpc("gettxout", "\"txid\", 1")
         );
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = request.params[0].get_str();
@@ -952,22 +1093,27 @@ UniValue gettxout(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
+    // The coins cache is only safe to use under cs_main, but nothing after the
+    // lookup needs it.
     CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
-            return NullUniValue;
+    const CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        if (fMempool) {
+            LOCK(mempool.cs);
+            CCoinsViewMemPool view(pcoinsTip, mempool);
+            if (!view.GetCoins(hash, coins))
+                return NullUniValue;
+            mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        } else {
+            if (!pcoinsTip->GetCoins(hash, coins))
+                return NullUniValue;
+        }
+        pindex = mapBlockIndex.find(pcoinsTip->GetBestBlock())->second;
     }
     if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
         return NullUniValue;
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
     if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
@@ -1260,6 +1406,56 @@ UniValue mempoolInfoToJSON()
     return ret;
 }
 
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the size and compaction statistics of the open LevelDB databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                (json object) Database name, such as chainstate or blockindex\n"
+            "    \"path\": \"xxxx\",        (string) Location of the database\n"
+            "    \"disk_size\": xxxxx,     (numeric) Approximate bytes used on disk\n"
+            "    \"levels\": [             (array) Levels that have files or had compactions\n"
+            "      {\n"
+            "        \"level\": n,         (numeric) Level number\n"
+            "        \"files\": n,         (numeric) Number of table files\n"
+            "        \"size_mb\": x.x,     (numeric) Size of the table files in MB\n"
+            "        \"time_sec\": x.x,    (numeric) Time spent compacting into this level since the database was opened\n"
+            "        \"read_mb\": x.x,     (numeric) MB read by those compactions\n"
+            "        \"written_mb\": x.x   (numeric) MB written by those compactions\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    for (const CDBStats& stats : GetDBStats()) {
+        UniValue levels(UniValue::VARR);
+        for (const CDBLevelStats& level : stats.vLevels) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("level", level.nLevel));
+            obj.push_back(Pair("files", level.nFiles));
+            obj.push_back(Pair("size_mb", level.dSizeMB));
+            obj.push_back(Pair("time_sec", level.dTimeSec));
+            obj.push_back(Pair("read_mb", level.dReadMB));
+            obj.push_back(Pair("written_mb", level.dWriteMB));
+            levels.push_back(obj);
+        }
+        UniValue db(UniValue::VOBJ);
+        db.push_back(Pair("path", stats.path.string()));
+        db.push_back(Pair("disk_size", stats.nDiskSize));
+        db.push_back(Pair("levels", levels));
+        ret.push_back(Pair(stats.profile.strName.empty() ? stats.path.string() : stats.profile.strName, db));
+    }
+    return ret;
+}
+
 UniValue getmempoolinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -1405,6 +1601,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
+    { "blockchain",         "getdbstats",             &getdbstats,             true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
@@ -1412,7 +1609,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {"hash_type"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,  {"path"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
 
@@ -0,0 +1,91 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+CJSONStreamWriter::CJSONStreamWriter(const Sink& sinkIn, size_t nFlushSizeIn) : sink(sinkIn), nFlushSize(nFlushSizeIn), fAfterKey(false)
+{
+    strBuffer.reserve(nFlushSize);
+}
+
+void CJSONStreamWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (vFirst.empty())
+        return;
+    if (!vFirst.back())
+        strBuffer += ',';
+    vFirst.back() = false;
+}
+
+void CJSONStreamWriter::MaybeFlush()
+{
+    if (strBuffer.size() >= nFlushSize)
+        Flush();
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    Separate();
+    strBuffer += '{';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    strBuffer += '}';
+    vFirst.pop_back();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    Separate();
+    strBuffer += '[';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    strBuffer += ']';
+    vFirst.pop_back();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::Key(const std::string& key)
+{
+    assert(!fAfterKey);
+    Separate();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    strBuffer += value.write();
+    MaybeFlush();
+}
+
+void CJSONStreamWriter::KeyValue(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    Value(value);
+}
+
+void CJSONStreamWriter::Flush()
+{
+    if (strBuffer.empty())
+        return;
+    sink(strBuffer);
+    strBuffer.clear();
+}
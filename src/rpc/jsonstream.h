@@ -0,0 +1,63 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/** Size of the blocks a CJSONStreamWriter passes to its sink */
+static const size_t DEFAULT_JSON_FLUSH_SIZE = 64 * 1024;
+
+/**
+ * Writes a JSON document piece by piece, passing the text to a sink in blocks
+ * of about nFlushSize bytes, so that large replies (blocks, the mempool) do not
+ * have to be built as a UniValue tree and a string first. Small parts can
+ * still be given as UniValue. The output is the same as UniValue::write() of
+ * the whole document.
+ */
+class CJSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+
+    CJSONStreamWriter(const Sink& sinkIn, size_t nFlushSizeIn = DEFAULT_JSON_FLUSH_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write the key of the next member of the current object */
+    void Key(const std::string& key);
+
+    /** Write a value, either the element of an array or the member after Key */
+    void Value(const UniValue& value);
+
+    /** Key(key) followed by Value(value) */
+    void KeyValue(const std::string& key, const UniValue& value);
+
+    /** Pass everything written so far to the sink */
+    void Flush();
+
+    /** Whether a key was written whose value is still missing */
+    bool ExpectsValue() const { return fAfterKey; }
+
+private:
+    Sink sink;
+    size_t nFlushSize;
+    std::string strBuffer;
+    //! For every open object or array, whether its next member is the first
+    std::vector<bool> vFirst;
+    bool fAfterKey;
+
+    void Separate();
+    void MaybeFlush();
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -5,7 +5,9 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "dbwrapper.h"
 #include "init.h"
+#include "kernel.h"
 #include "validation.h"
 #include "net.h"
 #include "netbase.h"
@@ -467,6 +469,34 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCStakeSeenMemoryInfo()
+{
+    LOCK(cs_main);
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", (uint64_t)stakeSeenFilter.Size()));
+    obj.push_back(Pair("usage", (uint64_t)stakeSeenFilter.DynamicMemoryUsage()));
+    return obj;
+}
+
+static UniValue RPCLevelDBMemoryInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    for (const CDBStats& stats : GetDBStats()) {
+        UniValue profile(UniValue::VOBJ);
+        profile.push_back(Pair("compression", stats.profile.fCompression));
+        profile.push_back(Pair("blocksize", (uint64_t)stats.profile.nBlockSize));
+        profile.push_back(Pair("maxopenfiles", stats.profile.nMaxOpenFiles));
+        profile.push_back(Pair("bloombits", stats.profile.nBloomBits));
+        profile.push_back(Pair("writebuffer", (uint64_t)(stats.profile.nWriteBufferSize ? stats.profile.nWriteBufferSize : stats.nCacheSize / 4)));
+        UniValue db(UniValue::VOBJ);
+        db.push_back(Pair("cache", (uint64_t)stats.nCacheSize));
+        db.push_back(Pair("usage", (uint64_t)stats.nMemoryUsage));
+        db.push_back(Pair("profile", profile));
+        obj.push_back(Pair(stats.profile.strName.empty() ? stats.path.string() : stats.profile.strName, db));
+    }
+    return obj;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -485,6 +515,23 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"stakeseen\": {            (json object) Information about the duplicate-stake filter\n"
+            "    \"entries\": xxxxx,       (numeric) Number of recent stakes recorded\n"
+            "    \"usage\": xxxxx,         (numeric) Number of bytes used\n"
+            "  },\n"
+            "  \"leveldb\": {              (json object) Information about the open databases\n"
+            "    \"name\": {               (json object) Database name, such as chainstate or blockindex\n"
+            "      \"cache\": xxxxx,       (numeric) Bytes of -dbcache given to the database\n"
+            "      \"usage\": xxxxx,       (numeric) Bytes used by its block cache and write buffers\n"
+            "      \"profile\": {          (json object) Settings, see -dbprofile\n"
+            "        \"compression\": true|false,\n"
+            "        \"blocksize\": xxxxx,\n"
+            "        \"maxopenfiles\": xxxxx,\n"
+            "        \"bloombits\": xxxxx,\n"
+            "        \"writebuffer\": xxxxx\n"
+            "      }\n"
+            "    }, ...\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -493,6 +540,8 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
         );
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+    obj.push_back(Pair("stakeseen", RPCStakeSeenMemoryInfo()));
+    obj.push_back(Pair("leveldb", RPCLevelDBMemoryInfo()));
     return obj;
 }
 
@@ -32,6 +32,7 @@ namespace RPCServer
 }
 
 class CBlockIndex;
+class CJSONStreamWriter;
 class CNetAddr;
 
 /** Wrapper for UniValue::VType, which includes typeAny:
@@ -52,8 +53,13 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /**
+     * If not NULL, a handler with a large result may write it here, as the
+     * value of "result" in the reply, and return NullUniValue instead.
+     */
+    CJSONStreamWriter* pstream;
 
-    JSONRPCRequest() { id = NullUniValue; params = NullUniValue; fHelp = false; }
+    JSONRPCRequest() { id = NullUniValue; params = NullUniValue; fHelp = false; pstream = NULL; }
     void parse(const UniValue& valRequest);
 };
 
@@ -0,0 +1,556 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "hash.h"
+#include "init.h"
+#include "kernel.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "warnings.h"
+
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Block index entries or transactions written to the databases at once by LoadSnapshot
+const size_t SNAPSHOT_LOAD_BATCH = 10000;
+//! Memory the coins cache of the background validation may use before it is flushed
+const size_t SNAPSHOT_VALIDATION_CACHE = 64 << 20;
+
+//! Height of the last block connected by the background validation (cs_main)
+int nSnapshotValidatedHeight = -1;
+//! Height of the snapshot while its background validation is pending, -1 otherwise (cs_main)
+int nSnapshotPendingHeight = -1;
+
+/** What a future kernel needs from a transaction besides its outputs, see CStakeInputInfo */
+struct CSnapshotTxInfo
+{
+    unsigned int nTxOffset; // offset of the transaction from the start of the block (including header)
+    unsigned int nTimeTx;
+
+    CSnapshotTxInfo() : nTxOffset(0), nTimeTx(0) {}
+    CSnapshotTxInfo(unsigned int nTxOffsetIn, unsigned int nTimeTxIn) : nTxOffset(nTxOffsetIn), nTimeTx(nTimeTxIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nTxOffset));
+        READWRITE(nTimeTx);
+    }
+};
+
+/** CAutoFile that hashes everything written to it */
+class CHashedAutoFile
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    explicit CHashedAutoFile(CAutoFile& fileIn) : file(fileIn), hasher(SER_GETHASH, 0) {}
+
+    int GetType() const { return file.GetType(); }
+    int GetVersion() const { return file.GetVersion(); }
+
+    void write(const char* pch, size_t nSize)
+    {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+    }
+
+    template<typename T>
+    CHashedAutoFile& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/** Add a transaction's coins to the hash and counts gettxoutsetinfo reports */
+void AddCoinsStats(CHashWriter& ss, const uint256& txid, const CCoins& coins, CSnapshotStats& stats)
+{
+    stats.nTransactions++;
+    ss << txid;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        const CTxOut& out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i + 1);
+            ss << out;
+        }
+    }
+    ss << VARINT(0);
+}
+
+bool GetSnapshotTxInfo(const uint256& txid, const CCoins& coins, const CBlockIndex* pindex, CBlock& block, const CBlockIndex*& pindexBlock, CSnapshotTxInfo& info)
+{
+    // The stake index has it for every output with -txindex or after a snapshot load
+    if (fTxIndex || fSnapshotChainstate) {
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            CStakeInputInfo stakeInput;
+            if (coins.IsAvailable(i) && pblocktree->ReadStakeIndex(COutPoint(txid, i), stakeInput)) {
+                info = CSnapshotTxInfo(stakeInput.nTxOffset, stakeInput.nTimeTx);
+                return true;
+            }
+        }
+    }
+
+    // Otherwise find it in its block, consecutive transactions often share one
+    if (pindexBlock != pindex) {
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+            return false;
+        pindexBlock = pindex;
+    }
+    unsigned int nTxOffset = 80 + GetSizeOfCompactSize(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        if (tx->GetHash() == txid) {
+            info = CSnapshotTxInfo(nTxOffset, tx->nTime);
+            return true;
+        }
+        nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return false;
+}
+
+/** hash_serialized of the coins in view at its best block, as DumpSnapshot computes it */
+uint256 GetCoinsHash(CCoinsView* view)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << pcursor->GetBestBlock();
+    CSnapshotStats stats;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        uint256 txid;
+        CCoins coins;
+        if (!pcursor->GetKey(txid) || !pcursor->GetValue(coins))
+            throw std::runtime_error("unable to read coin database");
+        AddCoinsStats(ss, txid, coins, stats);
+        pcursor->Next();
+    }
+    return ss.GetHash();
+}
+
+/** Connect a block below the snapshot to the background coins and check what the snapshot brought along for it */
+bool ConnectSnapshotBlock(const CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+
+    // The kernel as ProcessNewBlock checks it, on top of the block's parent
+    if (block.IsProofOfStake()) {
+        uint256 hashProofOfStake, targetProofOfStake;
+        if (!CheckProofOfStake(*block.vtx[1], block.nBits, hashProofOfStake, targetProofOfStake, chainparams.GetConsensus(), pindex->pprev, &view))
+            return state.DoS(100, error("%s: kernel check failed", __func__), REJECT_INVALID, "bad-cs-kernel");
+        // Nodes that saw the block more than once never recorded it, so neither may the snapshot
+        if (!pindex->hashProofOfStake.IsNull() && pindex->hashProofOfStake != hashProofOfStake)
+            return state.DoS(100, error("%s: proof-of-stake hash does not match the snapshot", __func__), REJECT_INVALID, "bad-snapshot-proofhash");
+    }
+
+    // ConnectBlock computes the mint and money supply again, they have to come out the same
+    const int64_t nMint = pindex->nMint;
+    const uint64_t nMoneySupply = pindex->nMoneySupply;
+    if (!ConnectBlock(block, state, pindex, view, chainparams))
+        return false;
+    if (pindex->nMint != nMint || pindex->nMoneySupply != nMoneySupply)
+        return state.DoS(100, error("%s: money supply does not match the snapshot", __func__), REJECT_INVALID, "bad-snapshot-supply");
+    return true;
+}
+
+/** Stop the node, the chainstate it runs on cannot be trusted or validated */
+void AbortSnapshotValidation(const std::string& strMessage)
+{
+    SetMiscWarning(strMessage);
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(
+        _("Error: Validating the blocks below the chainstate snapshot failed, see debug.log for details. Restart with -reindex to discard the snapshot"),
+        "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+}
+
+} // namespace
+
+bool DumpSnapshot(CCoinsView* view, const fs::path& path, CSnapshotStats& stats, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+
+    CSnapshotMetadata metadata;
+    memcpy(metadata.pchMessageStart, chainparams.MessageStart(), sizeof(metadata.pchMessageStart));
+    metadata.hashBlock = pcursor->GetBestBlock();
+    std::vector<const CBlockIndex*> vChain;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(metadata.hashBlock);
+        if (it == mapBlockIndex.end()) {
+            strError = "Best block of the coin database not found";
+            return false;
+        }
+        metadata.nHeight = it->second->nHeight;
+        vChain.resize(metadata.nHeight + 1);
+        for (const CBlockIndex* pindex = it->second; pindex; pindex = pindex->pprev)
+            vChain[pindex->nHeight] = pindex;
+    }
+    stats.hashBlock = metadata.hashBlock;
+    stats.nHeight = metadata.nHeight;
+
+    fs::path pathTmp = path.string() + ".incomplete";
+    FILE* filestr = fsbridge::fopen(pathTmp, "wb");
+    if (!filestr) {
+        strError = strprintf("Unable to open %s for writing", pathTmp.string());
+        return false;
+    }
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    CHashedAutoFile hashed(file);
+
+    try {
+        hashed << metadata;
+        {
+            LOCK(cs_main);
+            for (const CBlockIndex* pindex : vChain) {
+                CDiskBlockIndex diskindex(pindex);
+                // Block and undo data stay behind
+                diskindex.nStatus = pindex->nStatus & (BLOCK_VALID_MASK | BLOCK_OPT_WITNESS);
+                hashed << diskindex;
+            }
+        }
+
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << metadata.hashBlock;
+        CBlock block;
+        const CBlockIndex* pindexBlock = NULL;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            CCoins coins;
+            if (!pcursor->GetKey(txid) || !pcursor->GetValue(coins))
+                throw std::runtime_error("unable to read coin database");
+            CSnapshotTxInfo info;
+            if (coins.nHeight < 0 || coins.nHeight > metadata.nHeight ||
+                !GetSnapshotTxInfo(txid, coins, vChain[coins.nHeight], block, pindexBlock, info))
+                throw std::runtime_error(strprintf("unable to find transaction %s", txid.ToString()));
+            hashed << txid << coins << info;
+            AddCoinsStats(ss, txid, coins, stats);
+            pcursor->Next();
+        }
+        stats.hashSerialized = ss.GetHash();
+        hashed << uint256() << stats.nTransactions << stats.hashSerialized;
+
+        stats.hashSnapshot = hashed.GetHash();
+        file << stats.hashSnapshot;
+        FileCommit(file.Get());
+        file.fclose();
+    } catch (const std::exception& e) {
+        file.fclose();
+        fs::remove(pathTmp);
+        strError = strprintf("Error writing %s: %s", pathTmp.string(), e.what());
+        return false;
+    }
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("Unable to rename %s to %s", pathTmp.string(), path.string());
+        return false;
+    }
+    LogPrintf("%s: wrote %u transactions at height %d to %s, snapshot hash %s\n", __func__,
+        stats.nTransactions, stats.nHeight, path.string(), stats.hashSnapshot.ToString());
+    return true;
+}
+
+bool LoadSnapshot(const fs::path& path, const uint256& hashExpected, CBlockTreeDB& blocktree, CCoinsViewDB& coinsdb, CSnapshotStats& stats, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+
+    // The file's own hash only catches corruption, which snapshot it is has to be known beforehand
+    if (hashExpected.IsNull()) {
+        strError = _("-loadtxoutset requires the expected snapshot hash");
+        return false;
+    }
+
+    // Only a fresh data directory or one with an interrupted load is accepted
+    bool fResume = false;
+    blocktree.ReadFlag("snapshotchainstate", fResume);
+    if (!fResume && !blocktree.IsEmpty()) {
+        strError = _("-loadtxoutset requires an empty data directory");
+        return false;
+    }
+
+    try {
+        // Check the file against its hash before writing anything
+        {
+            uint64_t nSize = fs::file_size(path);
+            CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull() || nSize < 32) {
+                strError = strprintf(_("Unable to read chainstate snapshot %s"), path.string());
+                return false;
+            }
+            CHashWriter hasher(SER_GETHASH, 0);
+            std::vector<char> vBuffer(1 << 20);
+            for (uint64_t nRemaining = nSize - 32; nRemaining > 0; ) {
+                size_t nRead = std::min<uint64_t>(nRemaining, vBuffer.size());
+                file.read(vBuffer.data(), nRead);
+                hasher.write(vBuffer.data(), nRead);
+                nRemaining -= nRead;
+                if (ShutdownRequested())
+                    return false;
+            }
+            uint256 hashStored;
+            file >> hashStored;
+            stats.hashSnapshot = hasher.GetHash();
+            if (stats.hashSnapshot != hashStored) {
+                strError = strprintf(_("Chainstate snapshot %s is corrupt"), path.string());
+                return false;
+            }
+            if (stats.hashSnapshot != hashExpected) {
+                strError = strprintf(_("Chainstate snapshot hash %s does not match -loadtxoutsethash"), stats.hashSnapshot.ToString());
+                return false;
+            }
+        }
+        LogPrintf("%s: loading %s, snapshot hash %s\n", __func__, path.string(), stats.hashSnapshot.ToString());
+
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            strError = strprintf(_("Unable to read chainstate snapshot %s"), path.string());
+            return false;
+        }
+        CSnapshotMetadata metadata;
+        file >> metadata;
+        if (memcmp(metadata.pchMessageStart, chainparams.MessageStart(), sizeof(metadata.pchMessageStart)) != 0)
+            throw std::runtime_error("snapshot is for a different network");
+        if (metadata.nVersion != SNAPSHOT_VERSION)
+            throw std::runtime_error(strprintf("unsupported snapshot version %d", metadata.nVersion));
+        if (metadata.nHeight < 0)
+            throw std::runtime_error("invalid snapshot height");
+        stats.hashBlock = metadata.hashBlock;
+        stats.nHeight = metadata.nHeight;
+
+        if (!blocktree.WriteFlag("snapshotchainstate", true) || !blocktree.WriteFlag("prunedblockfiles", true))
+            throw std::runtime_error("unable to write block database");
+
+        // Block index of the chain up to the snapshot, linked and checked against the checkpoints
+        const MapCheckpoints& checkpoints = chainparams.Checkpoints().mapCheckpoints;
+        std::vector<std::pair<uint256, unsigned int> > vBlocks; // hash and time by height
+        vBlocks.reserve(metadata.nHeight + 1);
+        std::vector<CDiskBlockIndex> vIndex;
+        for (int nHeight = 0; nHeight <= metadata.nHeight; nHeight++) {
+            CDiskBlockIndex diskindex;
+            file >> diskindex;
+            const uint256 hash = diskindex.GetBlockHash();
+            // ConnectBlock does not raise the validity of the genesis block
+            if (diskindex.nHeight != nHeight || diskindex.nTx == 0 ||
+                diskindex.hashPrev != (nHeight > 0 ? vBlocks.back().first : uint256()) ||
+                !diskindex.IsValid(nHeight > 0 ? BLOCK_VALID_SCRIPTS : BLOCK_VALID_TRANSACTIONS) || (diskindex.nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)))
+                throw std::runtime_error(strprintf("invalid block index entry at height %d", nHeight));
+            if (nHeight == 0 && hash != chainparams.GetConsensus().hashGenesisBlock)
+                throw std::runtime_error("snapshot has the wrong genesis block");
+            MapCheckpoints::const_iterator itCheckpoint = checkpoints.find(nHeight);
+            if (itCheckpoint != checkpoints.end() && itCheckpoint->second != hash)
+                throw std::runtime_error(strprintf("snapshot does not match the checkpoint at height %d", nHeight));
+            vBlocks.push_back(std::make_pair(hash, diskindex.nTime));
+            vIndex.push_back(diskindex);
+            if (vIndex.size() >= SNAPSHOT_LOAD_BATCH || nHeight == metadata.nHeight) {
+                if (!blocktree.WriteBlockIndex(vIndex))
+                    throw std::runtime_error("unable to write block database");
+                vIndex.clear();
+            }
+        }
+        if (vBlocks.back().first != metadata.hashBlock)
+            throw std::runtime_error("snapshot block hash mismatch");
+
+        // Coins, and the stake index entries of their outputs
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << metadata.hashBlock;
+        CCoinsMap mapCoins;
+        std::vector<std::pair<COutPoint, CStakeInputInfo> > vStakeInputs;
+        uint256 txidPrev;
+        while (true) {
+            uint256 txid;
+            file >> txid;
+            if (txid.IsNull())
+                break;
+            if (stats.nTransactions > 0 && !(txidPrev < txid))
+                throw std::runtime_error("snapshot transactions are out of order");
+            CCoins coins;
+            CSnapshotTxInfo info;
+            file >> coins >> info;
+            if (coins.IsPruned() || coins.nHeight < 0 || coins.nHeight > metadata.nHeight)
+                throw std::runtime_error(strprintf("invalid coins for transaction %s", txid.ToString()));
+            AddCoinsStats(ss, txid, coins, stats);
+
+            const std::pair<uint256, unsigned int>& blockFrom = vBlocks[coins.nHeight];
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (coins.IsAvailable(i) && !coins.vout[i].IsEmpty())
+                    vStakeInputs.push_back(std::make_pair(COutPoint(txid, i),
+                        CStakeInputInfo(blockFrom.first, blockFrom.second, info.nTxOffset, info.nTimeTx, coins.vout[i].nValue)));
+            }
+            CCoinsCacheEntry& entry = mapCoins[txid];
+            entry.coins.swap(coins);
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            txidPrev = txid;
+
+            if (mapCoins.size() >= SNAPSHOT_LOAD_BATCH) {
+                if (!blocktree.WriteStakeIndex(vStakeInputs) || !coinsdb.BatchWrite(mapCoins, uint256()))
+                    throw std::runtime_error("unable to write chainstate database");
+                vStakeInputs.clear();
+                if (ShutdownRequested())
+                    return false;
+            }
+        }
+        uint64_t nTransactions;
+        uint256 hashSerialized;
+        file >> nTransactions >> hashSerialized;
+        stats.hashSerialized = ss.GetHash();
+        if (nTransactions != stats.nTransactions || hashSerialized != stats.hashSerialized)
+            throw std::runtime_error("snapshot coins do not match their hash");
+
+        // The coin database only becomes usable once its best block is written
+        if (!blocktree.WriteSnapshotBase(CSnapshotBase(metadata.hashBlock, metadata.nHeight, stats.hashSerialized)) ||
+            !blocktree.WriteStakeIndex(vStakeInputs) || !coinsdb.BatchWrite(mapCoins, metadata.hashBlock))
+            throw std::runtime_error("unable to write chainstate database");
+    } catch (const std::exception& e) {
+        strError = strprintf(_("Unable to load chainstate snapshot %s: %s"), path.string(), e.what());
+        return false;
+    }
+
+    LogPrintf("%s: loaded %u transactions with %u outputs at height %d, hash_serialized %s\n", __func__,
+        stats.nTransactions, stats.nTransactionOutputs, stats.nHeight, stats.hashSerialized.ToString());
+    return true;
+}
+
+bool GetSnapshotValidationProgress(int& nValidatedHeight, int& nSnapshotHeight)
+{
+    AssertLockHeld(cs_main);
+    if (nSnapshotPendingHeight < 0)
+        return false;
+    nValidatedHeight = nSnapshotValidatedHeight;
+    nSnapshotHeight = nSnapshotPendingHeight;
+    return true;
+}
+
+bool IsSnapshotValidationBlock(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    return nSnapshotPendingHeight >= 0 && pindex->nHeight > nSnapshotValidatedHeight && pindex->nHeight <= nSnapshotPendingHeight &&
+        !(pindex->nStatus & BLOCK_HAVE_DATA) && chainActive.Contains(pindex);
+}
+
+void ThreadSnapshotValidation()
+{
+    RenameThread("solarcoin-snapcheck");
+    const CChainParams& chainparams = Params();
+
+    CSnapshotBase base;
+    {
+        LOCK(cs_main);
+        if (!pblocktree->ReadSnapshotBase(base)) {
+            AbortSnapshotValidation("The snapshot the chainstate was loaded from is not recorded, it cannot be validated");
+            return;
+        }
+    }
+
+    // Built from genesis next to chainstate/, progress survives restarts
+    const fs::path path = GetDataDir() / "chainstate_background";
+    std::unique_ptr<CCoinsViewDB> pcoinsdb(new CCoinsViewDB(path, nMaxCoinsDBCache << 20));
+    std::unique_ptr<CCoinsViewCache> pcoins(new CCoinsViewCache(pcoinsdb.get()));
+    int nHeight = -1; // of the last block connected
+    {
+        LOCK(cs_main);
+        const uint256 hashBest = pcoins->GetBestBlock();
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end() && chainActive.Contains(it->second) && it->second->nHeight <= base.nHeight)
+            nHeight = it->second->nHeight;
+        nSnapshotValidatedHeight = nHeight;
+        nSnapshotPendingHeight = base.nHeight;
+    }
+    if (nHeight < 0 && !pcoins->GetBestBlock().IsNull()) {
+        LogPrintf("%s: discarding a background chainstate that is not below the snapshot\n", __func__);
+        pcoins.reset();
+        pcoinsdb.reset(new CCoinsViewDB(path, nMaxCoinsDBCache << 20, false, true));
+        pcoins.reset(new CCoinsViewCache(pcoinsdb.get()));
+    }
+    LogPrintf("%s: validating the blocks below the chainstate snapshot, heights %d to %d\n", __func__, nHeight + 1, base.nHeight);
+
+    try {
+        // The blocks are downloaded for it in height order, see IsSnapshotValidationBlock
+        while (nHeight < base.nHeight) {
+            bool fConnected = false;
+            {
+                LOCK(cs_main);
+                const CBlockIndex* pindexSnapshot = chainActive[base.nHeight];
+                if (!pindexSnapshot || pindexSnapshot->GetBlockHash() != base.hashBlock) {
+                    AbortSnapshotValidation("The active chain no longer contains the chainstate snapshot");
+                    return;
+                }
+                CBlockIndex* pindex = chainActive[nHeight + 1];
+                if (pindex->nStatus & BLOCK_FAILED_MASK) {
+                    AbortSnapshotValidation(strprintf("Block %s at height %d below the chainstate snapshot is invalid",
+                        pindex->GetBlockHash().ToString(), pindex->nHeight));
+                    return;
+                }
+                if (pindex->nStatus & BLOCK_HAVE_DATA) {
+                    CBlock block;
+                    if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+                        throw std::runtime_error(strprintf("unable to read block %s", pindex->GetBlockHash().ToString()));
+                    CValidationState state;
+                    if (!ConnectSnapshotBlock(block, pindex, *pcoins, chainparams, state)) {
+                        if (state.IsError())
+                            throw std::runtime_error(FormatStateMessage(state));
+                        AbortSnapshotValidation(strprintf("Block %s at height %d below the chainstate snapshot failed validation: %s",
+                            pindex->GetBlockHash().ToString(), pindex->nHeight, FormatStateMessage(state)));
+                        return;
+                    }
+                    nSnapshotValidatedHeight = ++nHeight;
+                    fConnected = true;
+                }
+            }
+            if (!fConnected)
+                MilliSleep(500);
+            else if (pcoins->DynamicMemoryUsage() > SNAPSHOT_VALIDATION_CACHE && !pcoins->Flush())
+                throw std::runtime_error("unable to write background chainstate");
+        }
+
+        // Same coins at the snapshot block, so the chainstate built on the snapshot is the one validation would have built
+        if (!pcoins->Flush())
+            throw std::runtime_error("unable to write background chainstate");
+        const uint256 hashSerialized = GetCoinsHash(pcoinsdb.get());
+        if (hashSerialized != base.hashSerialized) {
+            AbortSnapshotValidation(strprintf("The blocks below the chainstate snapshot lead to coins with hash_serialized %s, the snapshot has %s",
+                hashSerialized.ToString(), base.hashSerialized.ToString()));
+            return;
+        }
+        {
+            LOCK(cs_main);
+            if (!pblocktree->WriteFlag("snapshotvalidated", true))
+                throw std::runtime_error("unable to write block database");
+            fSnapshotValidated = true;
+            nSnapshotPendingHeight = -1;
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Keep the progress for the next start
+        try {
+            pcoins->Flush();
+        } catch (const std::exception&) {
+        }
+        throw;
+    } catch (const std::exception& e) {
+        AbortSnapshotValidation(strprintf("Validation of the blocks below the chainstate snapshot stopped: %s", e.what()));
+        return;
+    }
+
+    pcoins.reset();
+    pcoinsdb.reset();
+    fs::remove_all(path);
+    LogPrintf("%s: the blocks below the chainstate snapshot are valid and lead to its coins, hash_serialized %s\n", __func__, base.hashSerialized.ToString());
+}
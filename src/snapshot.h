@@ -0,0 +1,98 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SNAPSHOT_H
+#define BITCOIN_SNAPSHOT_H
+
+#include "fs.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+class CBlockIndex;
+class CBlockTreeDB;
+class CCoinsView;
+class CCoinsViewDB;
+
+//! Version of the chainstate snapshot format written by DumpSnapshot
+static const int SNAPSHOT_VERSION = 1;
+
+/** Header of a chainstate snapshot file */
+class CSnapshotMetadata
+{
+public:
+    unsigned char pchMessageStart[4]; //!< network the snapshot belongs to
+    int nVersion;
+    uint256 hashBlock;                //!< block the coins are at
+    int nHeight;
+
+    CSnapshotMetadata() : nVersion(SNAPSHOT_VERSION), nHeight(0)
+    {
+        memset(pchMessageStart, 0, sizeof(pchMessageStart));
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(nVersion);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+    }
+};
+
+/** What DumpSnapshot wrote or LoadSnapshot read */
+struct CSnapshotStats
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint256 hashSerialized; //!< same as gettxoutsetinfo's hash_serialized at hashBlock
+    uint256 hashSnapshot;   //!< double SHA256 of the file, stored at its end
+
+    CSnapshotStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0) {}
+};
+
+/**
+ * Write the coins of view (which must be flushed) to a snapshot file at path,
+ * together with the block index of the chain up to its best block and the
+ * kernel offset and timestamp of every transaction with unspent outputs.
+ * Transactions are found through the stake index with -txindex, and by
+ * reading their block otherwise.
+ */
+bool DumpSnapshot(CCoinsView* view, const fs::path& path, CSnapshotStats& stats, std::string& strError);
+
+/**
+ * Bootstrap an empty block tree and coin database from a snapshot written by
+ * DumpSnapshot. The blocks below the snapshot are treated as pruned until
+ * ThreadSnapshotValidation has validated them, so until then the coins are
+ * only as good as hashExpected: the file hash has to match it before anything
+ * is written. An interrupted load can be resumed by loading the same snapshot
+ * again.
+ */
+bool LoadSnapshot(const fs::path& path, const uint256& hashExpected, CBlockTreeDB& blocktree, CCoinsViewDB& coinsdb, CSnapshotStats& stats, std::string& strError);
+
+/**
+ * Validate the blocks below a snapshot chainstate while the node runs on it.
+ * They are downloaded in height order and connected from genesis to a second
+ * coin database (chainstate_background/), checking their kernels, rewards and
+ * money supply like ConnectBlock does. At the snapshot block its coins have
+ * to hash to the snapshot's hash_serialized; the chainstate then counts as
+ * validated and the second database is removed. Any failure shuts the node
+ * down, as the chain it runs on cannot be trusted.
+ */
+void ThreadSnapshotValidation();
+
+/** Height of the last block ThreadSnapshotValidation connected and of the snapshot, false if it is not pending. Requires cs_main. */
+bool GetSnapshotValidationProgress(int& nValidatedHeight, int& nSnapshotHeight);
+
+/** Whether pindex is a block below the snapshot that ThreadSnapshotValidation still needs. Requires cs_main. */
+bool IsSnapshotValidationBlock(const CBlockIndex* pindex);
+
+#endif // BITCOIN_SNAPSHOT_H
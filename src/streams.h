@@ -138,6 +138,50 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from a borrowed, read-only range of bytes,
+ * such as a memory-mapped file. The range must outlive the reader.
+ */
+class CSpanReader
+{
+private:
+    const int nType;
+    const int nVersion;
+
+    const char* pbegin;
+    const char* pend;
+
+public:
+    CSpanReader(int nTypeIn, int nVersionIn, const char* pbeginIn, size_t nSizeIn) : nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pend(pbeginIn + nSizeIn) {}
+
+    int GetType() const          { return nType; }
+    int GetVersion() const       { return nVersion; }
+    size_t size() const          { return pend - pbegin; }
+    bool empty() const           { return pbegin == pend; }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore(): end of data");
+        pbegin += nSize;
+    }
+
+    template<typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -0,0 +1,152 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arenamap.h"
+
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! Puts all keys into few probe sequences, so that collisions and tombstones are common
+struct PoorHasher
+{
+    size_t operator()(uint32_t key) const { return (size_t)(key % 5) << (sizeof(size_t) * 8 - 8); }
+};
+
+template <typename Hash>
+void CheckEqual(const arenamap<uint32_t, std::string, Hash>& map, const std::map<uint32_t, std::string>& real)
+{
+    BOOST_CHECK_EQUAL(map.size(), real.size());
+    size_t nCount = 0;
+    for (const auto& entry : map) {
+        auto it = real.find(entry.first);
+        BOOST_CHECK(it != real.end() && it->second == entry.second);
+        nCount++;
+    }
+    BOOST_CHECK_EQUAL(nCount, real.size());
+}
+
+template <typename Hash>
+void RandomOperations()
+{
+    arenamap<uint32_t, std::string, Hash> map;
+    std::map<uint32_t, std::string> real;
+    for (int i = 0; i < 20000; i++) {
+        uint32_t key = insecure_rand() % 1000;
+        switch (insecure_rand() % 4) {
+        case 0: {
+            std::string value = std::to_string(insecure_rand());
+            bool fInserted = map.emplace(key, value).second;
+            BOOST_CHECK_EQUAL(fInserted, real.emplace(key, value).second);
+            break;
+        }
+        case 1:
+            BOOST_CHECK_EQUAL(map.erase(key), real.erase(key));
+            break;
+        case 2: {
+            auto it = map.find(key);
+            BOOST_CHECK_EQUAL(it != map.end(), real.count(key) > 0);
+            if (it != map.end())
+                BOOST_CHECK(it->second == real[key]);
+            break;
+        }
+        case 3:
+            map[key] += "x";
+            real[key] += "x";
+            break;
+        }
+        if (i % 1000 == 0)
+            CheckEqual(map, real);
+    }
+    CheckEqual(map, real);
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(arenamap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(arenamap_random)
+{
+    RandomOperations<std::hash<uint32_t> >();
+    RandomOperations<PoorHasher>();
+}
+
+BOOST_AUTO_TEST_CASE(arenamap_stable_entries)
+{
+    arenamap<uint32_t, std::string, PoorHasher> map;
+    std::map<uint32_t, const std::string*> addresses;
+    for (uint32_t i = 0; i < 500; i++) {
+        addresses[i] = &map.emplace(i, std::to_string(i)).first->second;
+    }
+    BOOST_CHECK(map.bucket_count() >= 512);
+    for (const auto& entry : addresses) {
+        auto it = map.find(entry.first);
+        BOOST_CHECK(it != map.end() && &it->second == entry.second);
+    }
+
+    // An iterator from before the table was rebuilt still erases its entry
+    arenamap<uint32_t, std::string, PoorHasher>::iterator itOld = map.find(3);
+    for (uint32_t i = 500; i < 2000; i++)
+        map.emplace(i, std::to_string(i));
+    arenamap<uint32_t, std::string, PoorHasher>::iterator itNext = map.erase(itOld);
+    BOOST_CHECK(map.find(3) == map.end());
+    BOOST_CHECK(itNext == map.end() || itNext->first != 3);
+    BOOST_CHECK_EQUAL(map.size(), 1999U);
+}
+
+BOOST_AUTO_TEST_CASE(arenamap_erase_iterating)
+{
+    arenamap<uint32_t, std::string> map;
+    for (uint32_t i = 0; i < 1000; i++)
+        map.emplace(i, std::to_string(i));
+    size_t nVisited = 0;
+    for (auto it = map.begin(); it != map.end();) {
+        nVisited++;
+        if (it->first % 2)
+            map.erase(it++);
+        else
+            ++it;
+    }
+    BOOST_CHECK_EQUAL(nVisited, 1000U);
+    BOOST_CHECK_EQUAL(map.size(), 500U);
+    for (auto it = map.begin(); it != map.end();)
+        it = map.erase(it);
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(arenamap_memory)
+{
+    arenamap<uint32_t, std::string> map;
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+    for (uint32_t i = 0; i < 1000; i++)
+        map.emplace(i, std::string());
+    size_t nUsage = memusage::DynamicUsage(map);
+    BOOST_CHECK(nUsage >= 1000 * sizeof(std::pair<const uint32_t, std::string>));
+
+    // Erased entries are reused rather than allocated again
+    for (uint32_t i = 0; i < 1000; i++)
+        map.erase(i);
+    for (uint32_t i = 1000; i < 2000; i++)
+        map.emplace(i, std::string());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), nUsage);
+
+    arenamap<uint32_t, std::string> other;
+    other.swap(map);
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(other), nUsage);
+    BOOST_CHECK_EQUAL(other.size(), 1000U);
+
+    other.clear();
+    BOOST_CHECK(other.empty());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(other), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include "coins.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -79,7 +80,7 @@ public:
         // Manually recompute the dynamic usage of the whole data, and compare it.
         size_t ret = memusage::DynamicUsage(cacheCoins);
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+            ret += it->second.DynamicMemoryUsage();
         }
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
@@ -873,4 +874,247 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+    CDBWrapper& GetDB() { return db; }
+};
+
+CMutableTransaction CreateCoinsTestTx(unsigned int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = (i + 1) * COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_per_output)
+{
+    CCoinsViewDBTest base;
+    CMutableTransaction tx = CreateCoinsTestTx(3);
+    const uint256 txid = tx.GetHash();
+
+    // Add the outputs, then spend the middle one in a later flush
+    {
+        CCoinsViewCache cache(&base);
+        cache.ModifyNewCoins(txid, false)->FromTx(CTransaction(tx), 10);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    {
+        CCoinsViewCache cache(&base);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(1));
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins coins;
+    BOOST_CHECK(base.HaveCoins(txid));
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK(coins.IsAvailable(0));
+    BOOST_CHECK(!coins.IsAvailable(1));
+    BOOST_CHECK(coins.IsAvailable(2));
+    BOOST_CHECK_EQUAL(coins.vout.size(), 3U);
+    BOOST_CHECK_EQUAL(coins.nHeight, 10);
+    BOOST_CHECK(coins.vout[2] == tx.vout[2]);
+
+    // The cursor assembles the remaining records into one transaction
+    std::unique_ptr<CCoinsViewCursor> pcursor(base.Cursor());
+    uint256 key;
+    CCoins cursorCoins;
+    BOOST_CHECK(pcursor->Valid());
+    BOOST_CHECK(pcursor->GetKey(key) && key == txid);
+    BOOST_CHECK(pcursor->GetValue(cursorCoins) && cursorCoins == coins);
+    pcursor->Next();
+    BOOST_CHECK(!pcursor->Valid());
+
+    // Spending the last outputs removes the transaction
+    {
+        CCoinsViewCache cache(&base);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            BOOST_CHECK(modifier->Spend(0));
+            BOOST_CHECK(modifier->Spend(2));
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!base.HaveCoins(txid));
+    BOOST_CHECK(!base.GetCoins(txid, coins));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_point_reads)
+{
+    CCoinsViewDBTest base;
+    CMutableTransaction tx = CreateCoinsTestTx(2);
+    const uint256 txid = tx.GetHash();
+    {
+        CCoinsViewCache cache(&base);
+        cache.ModifyNewCoins(txid, false)->FromTx(CTransaction(tx), 3);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(base.GetDB().Exists(std::make_pair('T', txid)));
+
+    // Lookups go by the summary record, never by a scan for output records:
+    // an output record without one is not found
+    const uint256 txidStray = GetRandHash();
+    BOOST_CHECK(base.GetDB().Write(std::make_pair('C', std::make_pair(txidStray, (unsigned char)0)), CCoins(CTransaction(tx), 3)));
+    CCoins coins;
+    BOOST_CHECK(!base.HaveCoins(txidStray));
+    BOOST_CHECK(!base.GetCoins(txidStray, coins));
+
+    // Spending all outputs erases the summary with them
+    {
+        CCoinsViewCache cache(&base);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            BOOST_CHECK(modifier->Spend(0));
+            BOOST_CHECK(modifier->Spend(1));
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!base.GetDB().Exists(std::make_pair('T', txid)));
+    BOOST_CHECK(!base.HaveCoins(txid));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_upgrade)
+{
+    CCoinsViewDBTest base;
+    CMutableTransaction tx = CreateCoinsTestTx(3);
+    const uint256 txid = tx.GetHash();
+    CCoins coins(CTransaction(tx), 7);
+    BOOST_CHECK(coins.Spend(0));
+
+    // A record in the old one-per-transaction layout is invisible until upgraded
+    BOOST_CHECK(base.GetDB().Write(std::make_pair('c', txid), coins));
+    BOOST_CHECK(!base.HaveCoins(txid));
+    BOOST_CHECK(base.Upgrade());
+    BOOST_CHECK(!base.GetDB().Exists(std::make_pair('c', txid)));
+
+    CCoins upgraded;
+    BOOST_CHECK(base.GetCoins(txid, upgraded));
+    BOOST_CHECK(upgraded == coins);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    CMutableTransaction tx = CreateCoinsTestTx(2);
+    const uint256 txid = tx.GetHash();
+
+    // Coins read by someone else are cached clean, as if fetched by the cache
+    CCoins coins(CTransaction(tx), 5);
+    cache.AddFetchedCoins(txid, coins);
+    BOOST_CHECK(cache.HaveCoinsInCache(txid));
+    BOOST_CHECK(cache.AccessCoins(txid)->IsAvailable(1));
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txid)->nHeight, 5);
+    cache.SelfTest();
+
+    // An entry already in the cache is kept
+    CCoins other(CTransaction(tx), 6);
+    cache.AddFetchedCoins(txid, other);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txid)->nHeight, 5);
+    cache.SelfTest();
+
+    // Nothing is written back on flush
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoins(txid));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_cursors)
+{
+    CCoinsViewDBTest base;
+    std::set<uint256> setTxid;
+    const uint256 hashBlock = GetRandHash();
+    {
+        CCoinsViewCache cache(&base);
+        for (int i = 0; i < 50; i++) {
+            CMutableTransaction tx = CreateCoinsTestTx(1 + i % 3);
+            cache.ModifyNewCoins(tx.GetHash(), false)->FromTx(CTransaction(tx), i);
+            setTxid.insert(tx.GetHash());
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    std::vector<std::unique_ptr<CCoinsViewCursor> > vCursors;
+    BOOST_CHECK(base.Cursors(7, vCursors));
+    BOOST_CHECK_EQUAL(vCursors.size(), 7U);
+
+    // The shards see the state of when they were created, in ascending and
+    // disjoint txid ranges that together cover all transactions
+    {
+        CCoinsViewCache cache(&base);
+        cache.ModifyNewCoins(GetRandHash(), false)->FromTx(CTransaction(CreateCoinsTestTx(1)), 60);
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    std::vector<uint256> vTxid;
+    for (const auto& pcursor : vCursors) {
+        BOOST_CHECK(pcursor->GetBestBlock() == hashBlock);
+        for (; pcursor->Valid(); pcursor->Next()) {
+            uint256 txid;
+            BOOST_CHECK(pcursor->GetKey(txid));
+            vTxid.push_back(txid);
+        }
+    }
+    BOOST_CHECK(std::vector<uint256>(setTxid.begin(), setTxid.end()) == vTxid);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_flush_buffer)
+{
+    CCoinsViewDBTest base;
+    CCoinsViewFlushBuffer buffer(&base);
+    CMutableTransaction tx = CreateCoinsTestTx(2);
+    const uint256 txid = tx.GetHash();
+    const uint256 hashBlock1 = GetRandHash();
+    const uint256 hashBlock2 = GetRandHash();
+
+    // Without a writer thread a flush is written before it returns
+    {
+        CCoinsViewCache cache(&buffer);
+        cache.ModifyNewCoins(txid, false)->FromTx(CTransaction(tx), 1);
+        cache.SetBestBlock(hashBlock1);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(base.GetBestBlock() == hashBlock1);
+    BOOST_CHECK(base.HaveCoins(txid));
+
+    // With one, reads see the flushed state whether or not it is written yet
+    boost::thread writer(&CCoinsViewFlushBuffer::ThreadWrite, &buffer);
+    {
+        CCoinsViewCache cache(&buffer);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(0));
+        cache.SetBestBlock(hashBlock2);
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins coins;
+    BOOST_CHECK(buffer.GetBestBlock() == hashBlock2);
+    BOOST_CHECK(buffer.GetCoins(txid, coins));
+    BOOST_CHECK(!coins.IsAvailable(0));
+    BOOST_CHECK(coins.IsAvailable(1));
+
+    BOOST_CHECK(buffer.Sync());
+    BOOST_CHECK(base.GetBestBlock() == hashBlock2);
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK(!coins.IsAvailable(0));
+    BOOST_CHECK(coins.IsAvailable(1));
+
+    // A flush after the writer stopped is written by the flushing thread
+    writer.interrupt();
+    writer.join();
+    {
+        CCoinsViewCache cache(&buffer);
+        BOOST_CHECK(cache.ModifyCoins(txid)->Spend(1));
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!base.HaveCoins(txid));
+    BOOST_CHECK(!buffer.HasFailed());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
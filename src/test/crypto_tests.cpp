@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypto/aes.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
+#include "crypto/scrypt.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
@@ -439,4 +441,92 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+BOOST_AUTO_TEST_CASE(scrypt_batch) {
+    // Every lane and every tail length must match the single-lane hash
+    const size_t nMax = 3 * scrypt_batch_lanes() + 3;
+    std::vector<char> input(80 * nMax), output(32 * nMax);
+    for (size_t i = 0; i < input.size(); i++)
+        input[i] = insecure_rand();
+    for (size_t nCount = 0; nCount <= nMax; nCount++) {
+        std::fill(output.begin(), output.end(), 0);
+        scrypt_1024_1_1_256_batch(input.data(), output.data(), nCount);
+        for (size_t i = 0; i < nCount; i++) {
+            char hash[32];
+            scrypt_1024_1_1_256(&input[80 * i], hash);
+            BOOST_CHECK(memcmp(&output[32 * i], hash, 32) == 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests) {
+    unsigned char data[3][32];
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 32; j++)
+            data[i][j] = insecure_rand();
+
+    unsigned char hash[MuHash3072::OUTPUT_SIZE], hash2[MuHash3072::OUTPUT_SIZE];
+
+    // The hash does not depend on the order of insertion
+    MuHash3072 a, b;
+    a.Insert(data[0], 32).Insert(data[1], 32).Insert(data[2], 32);
+    b.Insert(data[2], 32).Insert(data[0], 32).Insert(data[1], 32);
+    a.Finalize(hash);
+    b.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash, hash2, sizeof(hash)) == 0);
+
+    // Removing an element undoes inserting it, whatever came in between
+    MuHash3072 c, d;
+    c.Insert(data[0], 32).Insert(data[1], 32);
+    d.Insert(data[1], 32).Insert(data[2], 32).Insert(data[0], 32).Remove(data[2], 32);
+    c.Finalize(hash);
+    d.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash, hash2, sizeof(hash)) == 0);
+
+    // Different sets hash differently
+    MuHash3072 e;
+    e.Insert(data[0], 32);
+    e.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash, hash2, sizeof(hash)) != 0);
+
+    // Hashes of disjoint sets combine to the hash of their union
+    MuHash3072 f, g;
+    f.Insert(data[0], 32);
+    g.Insert(data[1], 32).Insert(data[2], 32);
+    f *= g;
+    a.Finalize(hash);
+    f.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash, hash2, sizeof(hash)) == 0);
+    f /= g;
+    e.Finalize(hash);
+    f.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash, hash2, sizeof(hash)) == 0);
+
+    // The empty set
+    MuHash3072 empty, h;
+    h.Insert(data[1], 32).Remove(data[1], 32);
+    empty.Finalize(hash);
+    h.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash, hash2, sizeof(hash)) == 0);
+
+    // Reduction close to the modulus: (p - 6)^2 = 36 (mod p)
+    Num3072 x;
+    for (int i = 0; i < Num3072::LIMBS; i++)
+        x.limbs[i] = 0xffffffff;
+    x.limbs[0] = 0xffffffff - 1103717 - 5;
+    x.Multiply(x);
+    BOOST_CHECK_EQUAL(x.limbs[0], 36U);
+    for (int i = 1; i < Num3072::LIMBS; i++)
+        BOOST_CHECK_EQUAL(x.limbs[i], 0U);
+
+    // Inversion
+    Num3072 y;
+    y.limbs[0] = 12345;
+    y.limbs[17] = 678;
+    Num3072 z = y.GetInverse();
+    z.Multiply(y);
+    BOOST_CHECK_EQUAL(z.limbs[0], 1U);
+    for (int i = 1; i < Num3072::LIMBS; i++)
+        BOOST_CHECK_EQUAL(z.limbs[i], 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
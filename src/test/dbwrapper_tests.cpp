@@ -122,6 +122,77 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_snapshot)
+{
+    boost::filesystem::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, true);
+
+    char key = 'j';
+    uint256 in = GetRandHash();
+    BOOST_CHECK(dbw.Write(key, in));
+
+    CDBSnapshot snapshot(dbw);
+    uint256 in2 = GetRandHash();
+    BOOST_CHECK(dbw.Write(key, in2));
+    BOOST_CHECK(dbw.Write('k', in2));
+
+    // An iterator from the snapshot sees neither the overwrite nor the new key
+    std::unique_ptr<CDBIterator> it(dbw.NewIterator(snapshot));
+    it->Seek(key);
+    char key_res;
+    uint256 val_res;
+    BOOST_CHECK(it->GetKey(key_res));
+    BOOST_CHECK(it->GetValue(val_res));
+    BOOST_CHECK_EQUAL(key_res, key);
+    BOOST_CHECK_EQUAL(val_res.ToString(), in.ToString());
+    it->Next();
+    BOOST_CHECK_EQUAL(it->Valid(), false);
+
+    BOOST_CHECK(dbw.Read(key, val_res));
+    BOOST_CHECK_EQUAL(val_res.ToString(), in2.ToString());
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_profile)
+{
+    CDBProfile profile("test");
+    std::string strError;
+    BOOST_CHECK(ParseDBProfile("compression=0,blocksize=16384,maxopenfiles=1000,bloombits=0,writebuffer=8", profile, strError));
+    BOOST_CHECK(!profile.fCompression);
+    BOOST_CHECK_EQUAL(profile.nBlockSize, 16384U);
+    BOOST_CHECK_EQUAL(profile.nMaxOpenFiles, 1000);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 0);
+    BOOST_CHECK_EQUAL(profile.nWriteBufferSize, 8U << 20);
+    BOOST_CHECK(!ParseDBProfile("blocksize=16", profile, strError));
+    BOOST_CHECK(!ParseDBProfile("bloombits", profile, strError));
+    BOOST_CHECK(!ParseDBProfile("cache=1", profile, strError));
+    // Compression is refused rather than silently ignored without snappy
+    BOOST_CHECK_EQUAL(ParseDBProfile("compression=1", profile, strError), LevelDBHasSnappy());
+    BOOST_CHECK_EQUAL(profile.fCompression, LevelDBHasSnappy());
+
+    // A database opened with the profile reports it, and is no longer
+    // reported once closed
+    boost::filesystem::path ph = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, profile);
+        for (int i = 0; i < 1000; i++)
+            BOOST_CHECK(dbw.Write(i, GetRandHash()));
+
+        bool fFound = false;
+        for (const CDBStats& stats : GetDBStats()) {
+            if (stats.path != ph)
+                continue;
+            fFound = true;
+            BOOST_CHECK_EQUAL(stats.profile.strName, "test");
+            BOOST_CHECK_EQUAL(stats.profile.nBlockSize, 16384U);
+            BOOST_CHECK_EQUAL(stats.nCacheSize, 1U << 20);
+            BOOST_CHECK(stats.nMemoryUsage > 0);
+        }
+        BOOST_CHECK(fFound);
+    }
+    for (const CDBStats& stats : GetDBStats())
+        BOOST_CHECK(stats.path != ph);
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
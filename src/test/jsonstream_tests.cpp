@@ -0,0 +1,80 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include "test/test_bitcoin.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(jsonstream_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(jsonstream_matches_univalue)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("a\"b", 1));
+    inner.push_back(Pair("list", UniValue(UniValue::VARR)));
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("hash", "00ff"));
+    UniValue txs(UniValue::VARR);
+    for (int i = 0; i < 50; i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("n", i));
+        entry.push_back(Pair("inner", inner));
+        txs.push_back(entry);
+    }
+    expected.push_back(Pair("tx", txs));
+    expected.push_back(Pair("empty", UniValue(UniValue::VOBJ)));
+    expected.push_back(Pair("null", NullUniValue));
+
+    std::vector<std::string> vChunks;
+    CJSONStreamWriter writer([&vChunks](const std::string& strChunk) { vChunks.push_back(strChunk); }, 64);
+    writer.BeginObject();
+    writer.KeyValue("hash", "00ff");
+    writer.Key("tx");
+    BOOST_CHECK(writer.ExpectsValue());
+    writer.BeginArray();
+    BOOST_CHECK(!writer.ExpectsValue());
+    for (int i = 0; i < 50; i++) {
+        writer.BeginObject();
+        writer.KeyValue("n", i);
+        writer.KeyValue("inner", inner);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginObject();
+    writer.EndObject();
+    writer.KeyValue("null", NullUniValue);
+    writer.EndObject();
+    writer.Flush();
+
+    // The text was passed on in blocks as it was written
+    BOOST_CHECK(vChunks.size() > 10);
+    std::string strJSON;
+    for (const std::string& strChunk : vChunks) {
+        BOOST_CHECK(!strChunk.empty());
+        strJSON += strChunk;
+    }
+    BOOST_CHECK_EQUAL(strJSON, expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_buffered)
+{
+    // Nothing reaches the sink before a block is full
+    std::string strOut;
+    CJSONStreamWriter writer([&strOut](const std::string& strChunk) { strOut += strChunk; });
+    writer.BeginArray();
+    writer.Value(1);
+    writer.Value("x");
+    writer.EndArray();
+    BOOST_CHECK(strOut.empty());
+    writer.Flush();
+    BOOST_CHECK_EQUAL(strOut, "[1,\"x\"]");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,154 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "kernel.h"
+#include "key.h"
+#include "random.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+#include "validation.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#define KERNEL_CHAIN_LENGTH 5000
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+// The forward walk GetKernelStakeModifier used to do over chainActive
+static const CBlockIndex* WalkToModifier(const std::vector<CBlockIndex>& vIndex, int nTipHeight, const CBlockIndex* pindexFrom, int64_t nTargetTime)
+{
+    for (int i = pindexFrom->nHeight + 1; i <= nTipHeight; i++) {
+        if (vIndex[i].GeneratedStakeModifier() && vIndex[i].GetBlockTime() >= nTargetTime)
+            return &vIndex[i];
+    }
+    return NULL;
+}
+
+BOOST_AUTO_TEST_CASE(kernel_modifier_index_find)
+{
+    std::vector<CBlockIndex> vIndex(KERNEL_CHAIN_LENGTH);
+    int64_t nTime = 1000000;
+    for (int i = 0; i < KERNEL_CHAIN_LENGTH; i++) {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        // Mostly increasing timestamps with the occasional step backwards
+        nTime += 60 - (insecure_rand() % 90);
+        vIndex[i].nTime = nTime;
+        if (i == 0 || insecure_rand() % 4 == 0)
+            vIndex[i].nFlags |= CBlockIndex::BLOCK_STAKE_MODIFIER;
+    }
+
+    CKernelModifierIndex index;
+    index.Rebuild(&vIndex[KERNEL_CHAIN_LENGTH - 1]);
+
+    for (int i = 0; i < 2000; i++) {
+        const CBlockIndex* pindexFrom = &vIndex[insecure_rand() % KERNEL_CHAIN_LENGTH];
+        int64_t nTargetTime = pindexFrom->GetBlockTime() + (insecure_rand() % 20000);
+        BOOST_CHECK(index.Find(pindexFrom, nTargetTime) == WalkToModifier(vIndex, KERNEL_CHAIN_LENGTH - 1, pindexFrom, nTargetTime));
+    }
+
+    // Disconnect the top half, then connect it again block by block
+    const int nMid = KERNEL_CHAIN_LENGTH / 2;
+    index.Disconnect(&vIndex[nMid]);
+    for (int i = 0; i < 500; i++) {
+        const CBlockIndex* pindexFrom = &vIndex[insecure_rand() % KERNEL_CHAIN_LENGTH];
+        int64_t nTargetTime = pindexFrom->GetBlockTime() + (insecure_rand() % 20000);
+        BOOST_CHECK(index.Find(pindexFrom, nTargetTime) == WalkToModifier(vIndex, nMid - 1, pindexFrom, nTargetTime));
+    }
+    for (int i = nMid; i < KERNEL_CHAIN_LENGTH; i++)
+        index.Connect(&vIndex[i]);
+    for (int i = 0; i < 500; i++) {
+        const CBlockIndex* pindexFrom = &vIndex[insecure_rand() % KERNEL_CHAIN_LENGTH];
+        int64_t nTargetTime = pindexFrom->GetBlockTime() + (insecure_rand() % 20000);
+        BOOST_CHECK(index.Find(pindexFrom, nTargetTime) == WalkToModifier(vIndex, KERNEL_CHAIN_LENGTH - 1, pindexFrom, nTargetTime));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_seen_filter_window)
+{
+    CStakeSeenFilter filter;
+    const int nTip = 5000;
+    filter.Prune(nTip);
+
+    // Headers far above the tip are not recorded
+    std::vector<COutPoint> vPrevout;
+    for (int i = 0; i < 3; i++)
+        vPrevout.push_back(COutPoint(GetRandHash(), i));
+    filter.Insert(vPrevout[0], 1000, nTip + STAKE_SEEN_FINALITY_DEPTH);
+    filter.Insert(vPrevout[1], 1000, nTip + STAKE_SEEN_FINALITY_DEPTH + 1);
+    BOOST_CHECK(filter.Contains(std::make_pair(vPrevout[0], 1000U)));
+    BOOST_CHECK(!filter.Contains(std::make_pair(vPrevout[1], 1000U)));
+    BOOST_CHECK_EQUAL(filter.Size(), 1U);
+
+    // Nor are stakes below the pruned height
+    filter.Insert(vPrevout[2], 1000, nTip - STAKE_SEEN_FINALITY_DEPTH - 1);
+    BOOST_CHECK(!filter.Contains(std::make_pair(vPrevout[2], 1000U)));
+
+    // Once the tip has caught up, the stake is recorded
+    filter.Prune(nTip + 1);
+    filter.Insert(vPrevout[1], 1000, nTip + STAKE_SEEN_FINALITY_DEPTH + 1);
+    BOOST_CHECK(filter.Contains(std::make_pair(vPrevout[1], 1000U)));
+}
+
+BOOST_AUTO_TEST_CASE(block_signature)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+
+    // A proof-of-stake block as the staker builds it
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].scriptSig = CScript() << 0 << OP_0; // at height 0, as ContextualCheckBlock expects
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txCoinStake.vout.push_back(CTxOut(0, CScript()));
+    txCoinStake.vout.push_back(CTxOut(10 * COIN, CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG));
+    CBlock block;
+    block.nVersion = CBlockHeader::LEGACY_VERSION_3;
+    block.vtx.push_back(MakeTransactionRef(txCoinBase));
+    block.vtx.push_back(MakeTransactionRef(txCoinStake));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_REQUIRE(block.IsProofOfStake());
+
+    // Blocks below the activation height are not checked
+    Consensus::Params params = Params().GetConsensus();
+    params.BlockSignatureHeight = 1;
+    CValidationState state;
+    BOOST_CHECK(!block.CheckBlockSignature());
+    BOOST_CHECK(ContextualCheckBlock(block, state, params, NULL));
+
+    params.BlockSignatureHeight = 0;
+    BOOST_CHECK(!ContextualCheckBlock(block, state, params, NULL));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-blk-signature");
+    BOOST_CHECK(state.CorruptionPossible());
+
+    BOOST_CHECK(keyOther.Sign(block.GetHash(), block.vchBlockSig));
+    BOOST_CHECK(!block.CheckBlockSignature());
+
+    BOOST_CHECK(key.Sign(block.GetHash(), block.vchBlockSig));
+    BOOST_CHECK(block.CheckBlockSignature());
+    state = CValidationState();
+    BOOST_CHECK(ContextualCheckBlock(block, state, params, NULL));
+
+    // Only a coinstake paying to a public key can sign its block
+    txCoinStake.vout[1].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    block.vtx[1] = MakeTransactionRef(txCoinStake);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(key.Sign(block.GetHash(), block.vchBlockSig));
+    BOOST_CHECK(!block.CheckBlockSignature());
+    state = CValidationState();
+    BOOST_CHECK(!ContextualCheckBlock(block, state, params, NULL));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
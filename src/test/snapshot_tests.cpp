@@ -0,0 +1,109 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "init.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(snapshot_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(snapshot_dump_load)
+{
+    // A coin view at the genesis block holding the genesis coinbase, which is on disk
+    const CBlock& genesis = Params().GenesisBlock();
+    const CTransaction& txGenesis = *genesis.vtx[0];
+    const uint256 txid = txGenesis.GetHash();
+    CCoinsViewDB coinsFrom(1 << 20, true);
+    {
+        CCoinsViewCache cache(&coinsFrom);
+        cache.ModifyNewCoins(txid, true)->FromTx(txGenesis, 0);
+        cache.SetBestBlock(genesis.GetHash());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    fs::path path = GetDataDir() / "utxo.dat";
+    CSnapshotStats stats;
+    std::string strError;
+    BOOST_CHECK(DumpSnapshot(&coinsFrom, path, stats, strError));
+    BOOST_CHECK_EQUAL(stats.nHeight, 0);
+    BOOST_CHECK(stats.hashBlock == genesis.GetHash());
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1U);
+
+    // The block database of the test setup is not empty
+    CSnapshotStats statsLoad;
+    BOOST_CHECK(!LoadSnapshot(path, stats.hashSnapshot, *pblocktree, coinsFrom, statsLoad, strError));
+
+    // Only a snapshot with the expected hash is loaded
+    CBlockTreeDB blocktree(1 << 20, true);
+    CCoinsViewDB coinsTo(1 << 20, true);
+    BOOST_CHECK(!LoadSnapshot(path, uint256(), blocktree, coinsTo, statsLoad, strError));
+    BOOST_CHECK(!LoadSnapshot(path, GetRandHash(), blocktree, coinsTo, statsLoad, strError));
+    BOOST_CHECK(coinsTo.GetBestBlock().IsNull());
+    BOOST_CHECK(LoadSnapshot(path, stats.hashSnapshot, blocktree, coinsTo, statsLoad, strError));
+    BOOST_CHECK(statsLoad.hashSnapshot == stats.hashSnapshot);
+    BOOST_CHECK(statsLoad.hashSerialized == stats.hashSerialized);
+    BOOST_CHECK(coinsTo.GetBestBlock() == genesis.GetHash());
+
+    CCoins coins;
+    CCoins coinsExpected(txGenesis, 0);
+    BOOST_CHECK(coinsTo.GetCoins(txid, coins));
+    BOOST_CHECK(coins == coinsExpected);
+
+    bool fSnapshot = false;
+    BOOST_CHECK(blocktree.ReadFlag("snapshotchainstate", fSnapshot) && fSnapshot);
+    CSnapshotBase base;
+    BOOST_CHECK(blocktree.ReadSnapshotBase(base));
+    BOOST_CHECK(base.hashBlock == genesis.GetHash());
+    BOOST_CHECK(base.hashSerialized == stats.hashSerialized);
+    CStakeInputInfo stakeInput;
+    BOOST_CHECK(blocktree.ReadStakeIndex(COutPoint(txid, 0), stakeInput));
+    BOOST_CHECK(stakeInput.hashBlockFrom == genesis.GetHash());
+    BOOST_CHECK_EQUAL(stakeInput.nTxOffset, 81U);
+    BOOST_CHECK_EQUAL(stakeInput.nTimeTx, txGenesis.nTime);
+
+    // A corrupted file is refused
+    {
+        FILE* file = fsbridge::fopen(path, "r+b");
+        BOOST_CHECK(file);
+        fseek(file, 8, SEEK_SET);
+        fputc(0xff, file);
+        fclose(file);
+    }
+    CBlockTreeDB blocktreeCorrupt(1 << 20, true);
+    CCoinsViewDB coinsCorrupt(1 << 20, true);
+    BOOST_CHECK(!LoadSnapshot(path, stats.hashSnapshot, blocktreeCorrupt, coinsCorrupt, statsLoad, strError));
+    BOOST_CHECK(blocktreeCorrupt.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_background_validation)
+{
+    // The genesis chain of the test setup stands in for the blocks below a snapshot at its tip
+    BOOST_CHECK(pcoinsTip->Flush());
+    CSnapshotStats stats;
+    std::string strError;
+    BOOST_CHECK(DumpSnapshot(pcoinsdbview, GetDataDir() / "utxo.dat", stats, strError));
+    BOOST_CHECK(pblocktree->WriteSnapshotBase(CSnapshotBase(stats.hashBlock, stats.nHeight, stats.hashSerialized)));
+
+    // Connecting them from genesis leads to the snapshot's coins
+    ThreadSnapshotValidation();
+    BOOST_CHECK(!ShutdownRequested());
+    BOOST_CHECK(fSnapshotValidated);
+    bool fValidated = false;
+    BOOST_CHECK(pblocktree->ReadFlag("snapshotvalidated", fValidated) && fValidated);
+    BOOST_CHECK(!fs::exists(GetDataDir() / "chainstate_background"));
+    {
+        LOCK(cs_main);
+        int nValidatedHeight, nSnapshotHeight;
+        BOOST_CHECK(!GetSnapshotValidationProgress(nValidatedHeight, nSnapshotHeight));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -72,6 +72,32 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    std::vector<unsigned char> vch;
+    uint32_t a(1);
+    uint16_t b(2);
+    std::string str("solar");
+    CVectorWriter(SER_DISK, CLIENT_VERSION, vch, 0, a, b, str);
+
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, (const char*)vch.data(), vch.size());
+    BOOST_CHECK_EQUAL(reader.size(), vch.size());
+    uint32_t a2;
+    std::string str2;
+    reader >> a2;
+    reader.ignore(sizeof(b));
+    reader >> str2;
+    BOOST_CHECK_EQUAL(a2, a);
+    BOOST_CHECK_EQUAL(str2, str);
+    BOOST_CHECK(reader.empty());
+
+    // Reads past the end throw and leave the reader where it was
+    CSpanReader shortreader(SER_DISK, CLIENT_VERSION, (const char*)vch.data(), 3);
+    BOOST_CHECK_THROW(shortreader >> a2, std::ios_base::failure);
+    BOOST_CHECK_THROW(shortreader.ignore(4), std::ios_base::failure);
+    BOOST_CHECK_EQUAL(shortreader.size(), 3U);
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
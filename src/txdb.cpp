@@ -6,10 +6,13 @@
 #include "txdb.h"
 
 #include "chainparams.h"
+#include "init.h"
 #include "validation.h"
 #include "hash.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
 
 #include <stdint.h>
 
@@ -17,27 +20,178 @@
 
 using namespace std;
 
+static const char DB_COIN = 'C';
+static const char DB_COIN_TX = 'T';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_STAKEINDEX = 'k';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
+static const char DB_SNAPSHOT_BASE = 'S';
 static const char DB_LAST_BLOCK = 'l';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+namespace {
+
+/** Key of an unspent output record: DB_COIN, txid, VARINT(n) */
+struct CCoinKey
+{
+    char key;
+    COutPoint* outpoint;
+
+    CCoinKey(const COutPoint* ptr) : key(DB_COIN), outpoint(const_cast<COutPoint*>(ptr)) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << outpoint->hash;
+        s << VARINT(outpoint->n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> outpoint->hash;
+        s >> VARINT(outpoint->n);
+    }
+};
+
+/**
+ * Value of an unspent output record:
+ * - VARINT(nVersion)
+ * - VARINT(nHeight * 2 + fCoinBase)
+ * - the output (via CTxOutCompressor)
+ * The transaction fields are repeated in each of its outputs' records.
+ */
+struct CCoinRecord
+{
+    CCoins* pcoins;
+    unsigned int nPos;
+
+    CCoinRecord(const CCoins* pcoinsIn, unsigned int nPosIn) : pcoins(const_cast<CCoins*>(pcoinsIn)), nPos(nPosIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        ::Serialize(s, VARINT(pcoins->nVersion));
+        ::Serialize(s, VARINT((uint32_t)pcoins->nHeight * 2 + (pcoins->fCoinBase ? 1 : 0)));
+        ::Serialize(s, CTxOutCompressor(REF(pcoins->vout[nPos])));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        uint32_t nCode = 0;
+        ::Unserialize(s, VARINT(pcoins->nVersion));
+        ::Unserialize(s, VARINT(nCode));
+        pcoins->nHeight = nCode >> 1;
+        pcoins->fCoinBase = nCode & 1;
+        if (nPos >= pcoins->vout.size())
+            pcoins->vout.resize(nPos + 1);
+        ::Unserialize(s, REF(CTxOutCompressor(pcoins->vout[nPos])));
+    }
+};
+
+/**
+ * Value of the summary record (DB_COIN_TX, txid) that every transaction with
+ * unspent outputs has next to their records: a bitmask of the unspent
+ * outputs. Lookups read it first, so a txid without unspent outputs is
+ * answered by a point read (and the bloom filter), and the output records of
+ * one with them are read by their exact keys.
+ */
+struct CCoinsSummary
+{
+    std::vector<unsigned char> vAvail;
+
+    CCoinsSummary() {}
+
+    explicit CCoinsSummary(const CCoins& coins) {
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (coins.IsAvailable(i)) {
+                vAvail.resize(i / 8 + 1);
+                vAvail[i / 8] |= 1 << (i % 8);
+            }
+        }
+    }
+
+    bool IsAvailable(unsigned int nPos) const {
+        return nPos / 8 < vAvail.size() && (vAvail[nPos / 8] & (1 << (nPos % 8)));
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(vAvail);
+    }
+};
+
+/** Write the summary record of coins, or erase it if none of its outputs are unspent */
+void WriteCoinsSummary(CDBBatch& batch, const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        batch.Erase(std::make_pair(DB_COIN_TX, txid));
+    else
+        batch.Write(std::make_pair(DB_COIN_TX, txid), CCoinsSummary(coins));
+}
+
+/** Txid of the output record at the cursor, or false if the cursor is not at one */
+bool GetCoinKeyTxid(CDBIterator& cursor, uint256& txid)
+{
+    COutPoint outpoint;
+    CCoinKey entry(&outpoint);
+    if (!cursor.Valid() || !cursor.GetKey(entry) || entry.key != DB_COIN)
+        return false;
+    txid = outpoint.hash;
+    return true;
+}
+
+/** Assemble the CCoins of txid from the records starting at the cursor, leaving it past them */
+void ReadCoins(CDBIterator& cursor, const uint256& txid, CCoins& coins, unsigned int& nValueSize)
+{
+    coins.Clear();
+    nValueSize = 0;
+    COutPoint outpoint;
+    CCoinKey entry(&outpoint);
+    while (cursor.Valid() && cursor.GetKey(entry) && entry.key == DB_COIN && outpoint.hash == txid) {
+        CCoinRecord record(&coins, outpoint.n);
+        if (!cursor.GetValue(record))
+            throw std::runtime_error(strprintf("%s: corrupt coin record for %s", __func__, outpoint.ToString()));
+        nValueSize += cursor.GetValueSize();
+        cursor.Next();
+    }
+}
+
+} // namespace
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const CDBProfile& profile) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, profile)
+{
+}
+
+CCoinsViewDB::CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const CDBProfile& profile) : db(path, nCacheSize, fMemory, fWipe, true, profile)
 {
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(std::make_pair(DB_COINS, txid), coins);
+    CCoinsSummary summary;
+    if (!db.Read(std::make_pair(DB_COIN_TX, txid), summary))
+        return false;
+    coins.Clear();
+    COutPoint outpoint(txid, 0);
+    for (outpoint.n = 0; outpoint.n < summary.vAvail.size() * 8; outpoint.n++) {
+        if (!summary.IsAvailable(outpoint.n))
+            continue;
+        CCoinRecord record(&coins, outpoint.n);
+        if (!db.Read(CCoinKey(&outpoint), record))
+            throw std::runtime_error(strprintf("%s: missing coin record for %s", __func__, outpoint.ToString()));
+    }
+    return true;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(std::make_pair(DB_COINS, txid));
+    return db.Exists(std::make_pair(DB_COIN_TX, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -47,16 +201,53 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+size_t CCoinsViewDB::WriteEntry(CDBBatch &batch, const uint256 &txid, const CCoinsCacheEntry &entry) const {
+    size_t outputs = 0;
+    COutPoint outpoint(txid, 0);
+    if (entry.fBaseUnknown) {
+        // Replace every record of this txid, as listed by its summary
+        CCoinsSummary summary;
+        db.Read(std::make_pair(DB_COIN_TX, txid), summary);
+        for (outpoint.n = 0; outpoint.n < summary.vAvail.size() * 8; outpoint.n++) {
+            if (summary.IsAvailable(outpoint.n) && !entry.coins.IsAvailable(outpoint.n)) {
+                batch.Erase(CCoinKey(&outpoint));
+                outputs++;
+            }
+        }
+        for (outpoint.n = 0; outpoint.n < entry.coins.vout.size(); outpoint.n++) {
+            if (entry.coins.IsAvailable(outpoint.n)) {
+                batch.Write(CCoinKey(&outpoint), CCoinRecord(&entry.coins, outpoint.n));
+                outputs++;
+            }
+        }
+    } else {
+        // Only touch the outputs that were spent or added since the entry was loaded
+        unsigned int nSize = std::max(entry.coins.vout.size(), entry.vBaseUnspent.size());
+        for (outpoint.n = 0; outpoint.n < nSize; outpoint.n++) {
+            bool fBase = entry.IsBaseUnspent(outpoint.n);
+            bool fNow = entry.coins.IsAvailable(outpoint.n);
+            if (fBase && !fNow) {
+                batch.Erase(CCoinKey(&outpoint));
+                outputs++;
+            } else if (fNow && !fBase) {
+                batch.Write(CCoinKey(&outpoint), CCoinRecord(&entry.coins, outpoint.n));
+                outputs++;
+            }
+        }
+    }
+    if (outputs > 0 || entry.fBaseUnknown)
+        WriteCoinsSummary(batch, txid, entry.coins);
+    return outputs;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
+    size_t outputs = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(std::make_pair(DB_COINS, it->first));
-            else
-                batch.Write(std::make_pair(DB_COINS, it->first), it->second.coins);
+            outputs += WriteEntry(batch, it->first, it->second);
             changed++;
         }
         count++;
@@ -66,11 +257,150 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u) to coin database...\n", (unsigned int)outputs, (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    CDBBatch batch(db);
+    size_t changed = 0;
+    size_t outputs = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            outputs += WriteEntry(batch, it->first, it->second);
+            changed++;
+        }
+    }
+    if (!hashBlock.IsNull())
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u) to coin database...\n", (unsigned int)outputs, (unsigned int)changed, (unsigned int)mapCoins.size());
+    return db.WriteBatch(batch);
+}
+
+CCoinsViewFlushBuffer::CCoinsViewFlushBuffer(CCoinsViewDB *dbIn) : CCoinsViewBacked(dbIn), db(*dbIn), fPending(false), fWriting(false), fFailed(false), nWriters(0) {
+}
+
+bool CCoinsViewFlushBuffer::GetCoins(const uint256 &txid, CCoins &coins) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = mapFrozen.find(txid);
+        if (it != mapFrozen.end()) {
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    // Not frozen, so the database has the current version whether or not
+    // the frozen map has been committed meanwhile.
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewFlushBuffer::HaveCoins(const uint256 &txid) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = mapFrozen.find(txid);
+        if (it != mapFrozen.end())
+            return !it->second.coins.IsPruned();
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewFlushBuffer::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fPending && !hashFrozen.IsNull())
+            return hashFrozen;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlushBuffer::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!Wait(lock))
+        return false;
+    mapFrozen.swap(mapCoins);
+    hashFrozen = hashBlock;
+    fPending = true;
+    if (nWriters == 0)
+        return Commit(lock);
+    cond.notify_all();
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewFlushBuffer::Cursor() const {
+    const_cast<CCoinsViewFlushBuffer*>(this)->Sync();
+    return base->Cursor();
+}
+
+bool CCoinsViewFlushBuffer::Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const {
+    return const_cast<CCoinsViewFlushBuffer*>(this)->Sync() && base->Cursors(nShards, vCursors);
+}
+
+bool CCoinsViewFlushBuffer::Sync() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return Wait(lock);
+}
+
+bool CCoinsViewFlushBuffer::HasFailed() const {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return fFailed;
+}
+
+bool CCoinsViewFlushBuffer::Wait(boost::unique_lock<boost::mutex> &lock) {
+    // Only the writer thread is meant to be interrupted
+    boost::this_thread::disable_interruption di;
+    while (fPending && !fFailed) {
+        if (nWriters == 0 && !fWriting)
+            Commit(lock);
+        else
+            cond.wait(lock);
+    }
+    return !fFailed;
+}
+
+bool CCoinsViewFlushBuffer::Commit(boost::unique_lock<boost::mutex> &lock) {
+    // Readers keep using mapFrozen while it is written, nothing may change it until then
+    fWriting = true;
+    lock.unlock();
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        fOk = db.WriteCoins(mapFrozen, hashFrozen);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    LogPrint("coindb", "Committed %u cached transactions to coin database in %.2fms\n", (unsigned int)mapFrozen.size(), (GetTimeMicros() - nStart) * 0.001);
+    lock.lock();
+    fWriting = false;
+    if (fOk) {
+        mapFrozen.clear();
+        fPending = false;
+    } else {
+        LogPrintf("%s: failed to write to coin database\n", __func__);
+        fFailed = true;
+    }
+    cond.notify_all();
+    return fOk;
+}
+
+void CCoinsViewFlushBuffer::ThreadWrite() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nWriters++;
+    try {
+        while (true) {
+            while (!fPending || fWriting || fFailed)
+                cond.wait(lock);
+            Commit(lock);
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Later flushes are committed by the flushing thread itself
+        nWriters--;
+        cond.notify_all();
+        throw;
+    }
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, const CDBProfile& profile) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, profile) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -99,17 +429,50 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
-    // Cache key of first record
-    i->pcursor->GetKey(i->keyTmp);
+    i->pcursor->Seek(DB_COIN);
+    // Assemble the first transaction
+    i->Next();
     return i;
 }
 
+bool CCoinsViewDB::Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const
+{
+    nShards = std::max(1, std::min(nShards, 256));
+    std::shared_ptr<CDBSnapshot> snapshot = std::make_shared<CDBSnapshot>(db);
+
+    // The best block has to come from the snapshot too, a flush may have
+    // moved it on since.
+    uint256 hashBestBlock;
+    {
+        std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator(*snapshot));
+        pcursor->Seek(DB_BEST_BLOCK);
+        char chKey;
+        if (pcursor->Valid() && pcursor->GetKey(chKey) && chKey == DB_BEST_BLOCK && !pcursor->GetValue(hashBestBlock))
+            return false;
+    }
+
+    vCursors.clear();
+    for (int i = 0; i < nShards; i++) {
+        CCoinsViewDBCursor *c = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(*snapshot), hashBestBlock);
+        vCursors.emplace_back(c);
+        c->snapshot = snapshot;
+        uint256 txidBegin;
+        *txidBegin.begin() = 256 * i / nShards;
+        if (i + 1 < nShards) {
+            c->fHaveEnd = true;
+            *c->txidEnd.begin() = 256 * (i + 1) / nShards;
+        }
+        c->pcursor->Seek(std::make_pair(DB_COIN, txidBegin));
+        c->Next();
+    }
+    return true;
+}
+
 bool CCoinsViewDBCursor::GetKey(uint256 &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
-        key = keyTmp.second;
+    if (fValid) {
+        key = txidTmp;
         return true;
     }
     return false;
@@ -117,24 +480,83 @@ bool CCoinsViewDBCursor::GetKey(uint256 &key) const
 
 bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
 {
-    return pcursor->GetValue(coins);
+    if (!fValid)
+        return false;
+    coins = coinsTmp;
+    return true;
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
 {
-    return pcursor->GetValueSize();
+    return nValueSize;
 }
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return fValid;
 }
 
 void CCoinsViewDBCursor::Next()
 {
-    pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    // Invalidate after the last record so that Valid() and GetKey() return false
+    fValid = GetCoinKeyTxid(*pcursor, txidTmp) && (!fHaveEnd || txidTmp < txidEnd);
+    if (fValid)
+        ReadCoins(*pcursor, txidTmp, coinsTmp, nValueSize);
+}
+
+bool CCoinsViewDB::Upgrade() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+    if (!pcursor->Valid()) {
+        return true;
+    }
+
+    LogPrintf("Upgrading chainstate database to one record per unspent output...\n");
+    uiInterface.ShowProgress(_("Upgrading chainstate database"), 0);
+    size_t nBatchSize = 1 << 24;
+    CDBBatch batch(db);
+    int nReportDone = 0;
+    size_t nTransactions = 0;
+    std::pair<char, uint256> key;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (!pcursor->GetKey(key) || key.first != DB_COINS) {
+            break;
+        }
+        // Progress by the first byte of the txid, as the records are in txid order
+        int nPercentageDone = (int)(key.second.begin()[0] * 100.0 / 256.0 + 0.5);
+        if (nPercentageDone > nReportDone) {
+            uiInterface.ShowProgress(_("Upgrading chainstate database"), nPercentageDone);
+            nReportDone = nPercentageDone;
+        }
+        CCoins coins;
+        if (!pcursor->GetValue(coins)) {
+            return error("%s: cannot parse CCoins record for %s", __func__, key.second.ToString());
+        }
+        COutPoint outpoint(key.second, 0);
+        for (outpoint.n = 0; outpoint.n < coins.vout.size(); outpoint.n++) {
+            if (coins.IsAvailable(outpoint.n))
+                batch.Write(CCoinKey(&outpoint), CCoinRecord(&coins, outpoint.n));
+        }
+        WriteCoinsSummary(batch, key.second, coins);
+        // The old record goes in the same batch, so an interrupted upgrade resumes cleanly
+        batch.Erase(key);
+        nTransactions++;
+        if (batch.SizeEstimate() > nBatchSize) {
+            if (!db.WriteBatch(batch))
+                return error("%s: failed to write upgraded coins", __func__);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    if (!db.WriteBatch(batch))
+        return error("%s: failed to write upgraded coins", __func__);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Upgraded %u transactions: [%s].\n", (unsigned int)nTransactions, ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -149,6 +571,13 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::WriteBlockIndex(const std::vector<CDiskBlockIndex>& vIndex) {
+    CDBBatch batch(*this);
+    for (const CDiskBlockIndex& diskindex : vIndex)
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, diskindex.GetBlockHash()), diskindex);
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
@@ -160,6 +589,24 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadStakeIndex(const COutPoint &prevout, CStakeInputInfo &info) {
+    return Read(std::make_pair(DB_STAKEINDEX, prevout), info);
+}
+
+bool CBlockTreeDB::WriteStakeIndex(const std::vector<std::pair<COutPoint, CStakeInputInfo> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<COutPoint, CStakeInputInfo> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(std::make_pair(DB_STAKEINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseStakeIndex(const std::vector<COutPoint> &list) {
+    CDBBatch batch(*this);
+    for (std::vector<COutPoint>::const_iterator it=list.begin(); it!=list.end(); it++)
+        batch.Erase(std::make_pair(DB_STAKEINDEX, *it));
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -172,6 +619,14 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteSnapshotBase(const CSnapshotBase &base) {
+    return Write(DB_SNAPSHOT_BASE, base);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(CSnapshotBase &base) {
+    return Read(DB_SNAPSHOT_BASE, base);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -227,10 +682,6 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                     if (pindexNew->nHeight >= 4000 && pindexNew->nHeight < 4020)
                         LogPrintf("DEBUG: txdb: nHeight=%d nMint=%s nMoneySupply=%s nStakeModifier=%d hashProofOfStake=%s\n", pindexNew->nHeight, FormatMoney(pindexNew->nMint).c_str(), FormatMoneySupply(pindexNew->nMoneySupply).c_str(), pindexNew->nStakeModifier, pindexNew->hashProofOfStake.ToString());
                 }
-                // SolarCoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
                 pcursor->Next();
             } else {
                 return error("LoadBlockIndex() : failed to read value");
@@ -16,6 +16,8 @@
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
@@ -67,19 +69,147 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** SolarCoin: fields of a transaction output needed to evaluate a PoST kernel */
+struct CStakeInputInfo
+{
+    uint256 hashBlockFrom;       // block containing the transaction
+    unsigned int nTimeBlockFrom; // timestamp of that block
+    unsigned int nTxOffset;      // offset of the transaction from the start of the block (including header)
+    unsigned int nTimeTx;        // timestamp of the transaction
+    CAmount nValue;              // value of the output
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlockFrom);
+        READWRITE(nTimeBlockFrom);
+        READWRITE(VARINT(nTxOffset));
+        READWRITE(nTimeTx);
+        READWRITE(nValue);
+    }
+
+    CStakeInputInfo(const uint256& hashBlockFromIn, unsigned int nTimeBlockFromIn, unsigned int nTxOffsetIn, unsigned int nTimeTxIn, CAmount nValueIn) :
+        hashBlockFrom(hashBlockFromIn), nTimeBlockFrom(nTimeBlockFromIn), nTxOffset(nTxOffsetIn), nTimeTx(nTimeTxIn), nValue(nValueIn) {
+    }
+
+    CStakeInputInfo() {
+        SetNull();
+    }
+
+    void SetNull() {
+        hashBlockFrom.SetNull();
+        nTimeBlockFrom = 0;
+        nTxOffset = 0;
+        nTimeTx = 0;
+        nValue = 0;
+    }
+};
+
+/** SolarCoin: the block a chainstate snapshot was loaded at, kept for its background validation */
+struct CSnapshotBase
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint256 hashSerialized; // gettxoutsetinfo's hash_serialized of the snapshot coins
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(hashSerialized);
+    }
+
+    CSnapshotBase(const uint256& hashBlockIn, int nHeightIn, const uint256& hashSerializedIn) :
+        hashBlock(hashBlockIn), nHeight(nHeightIn), hashSerialized(hashSerializedIn) {
+    }
+
+    CSnapshotBase() : nHeight(0) {}
+};
+
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * Every unspent output is its own record, keyed by its outpoint, so spending
+ * one output of a transaction erases one record instead of rewriting the
+ * transaction's whole CCoins. A summary record per txid lists its unspent
+ * outputs, so lookups are point reads: a miss costs one read of the summary,
+ * and a hit reads the output records by their exact keys.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBProfile& profile = CDBProfile("chainstate"));
+    //! A coin database elsewhere than chainstate/, as background validation of a snapshot builds
+    CCoinsViewDB(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBProfile& profile = CDBProfile("chainstate"));
+
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! Like BatchWrite, but leaves mapCoins untouched so others can keep reading it meanwhile
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+    CCoinsViewCursor *Cursor() const;
+    //! Shards split the txid space by its first byte, all read from one database snapshot
+    bool Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const;
+
+    //! Convert a chainstate that still stores one record per transaction to per-output records
+    bool Upgrade();
+
+private:
+    //! Add the record changes of a dirty cache entry to batch, returning how many outputs changed
+    size_t WriteEntry(CDBBatch &batch, const uint256 &txid, const CCoinsCacheEntry &entry) const;
+};
+
+/**
+ * Sits between the coins cache and the coin database and lets the database
+ * be written in the background. A flush from the cache above swaps the
+ * cache's entries into a frozen map and returns at once; a writer thread
+ * running ThreadWrite then commits the map to the database in one batch.
+ * Until that batch is in, reads see the frozen map before the database.
+ * Only one map can be frozen at a time, so a flush that comes while the last
+ * one is still being written waits for it. Without a writer thread, flushes
+ * are committed before BatchWrite returns.
+ */
+class CCoinsViewFlushBuffer : public CCoinsViewBacked
+{
+private:
+    CCoinsViewDB &db;
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    CCoinsMap mapFrozen;
+    uint256 hashFrozen;
+    bool fPending; //!< mapFrozen is not in the database yet
+    bool fWriting; //!< mapFrozen is being written, and must not change
+    bool fFailed;  //!< a write failed, mapFrozen is kept for reads
+    int nWriters;  //!< running writer threads
+
+    //! Wait until mapFrozen is committed, committing it here if no writer runs
+    bool Wait(boost::unique_lock<boost::mutex> &lock);
+    //! Write mapFrozen to the database, with the lock released meanwhile
+    bool Commit(boost::unique_lock<boost::mutex> &lock);
+
+public:
+    CCoinsViewFlushBuffer(CCoinsViewDB *dbIn);
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! Cursors read the database, so these wait for the frozen map first
     CCoinsViewCursor *Cursor() const;
+    bool Cursors(int nShards, std::vector<std::unique_ptr<CCoinsViewCursor> > &vCursors) const;
+
+    //! Wait until everything flushed so far is in the database. Returns false if a write failed.
+    bool Sync();
+    bool HasFailed() const;
+
+    //! Body of the writer thread, returns when interrupted
+    void ThreadWrite();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -97,9 +227,18 @@ public:
 
 private:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), fHaveEnd(false), fValid(false), nValueSize(0) {}
+    //! Snapshot the iterator reads from, if any; declared first so that it outlives pcursor
+    std::shared_ptr<CDBSnapshot> snapshot;
     std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    //! Stop before this txid
+    bool fHaveEnd;
+    uint256 txidEnd;
+    //! Transaction the cursor is at, assembled from its output records
+    bool fValid;
+    uint256 txidTmp;
+    CCoins coinsTmp;
+    unsigned int nValueSize;
 
     friend class CCoinsViewDB;
 };
@@ -108,20 +247,26 @@ private:
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBProfile& profile = CDBProfile("blockindex"));
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBlockIndex(const std::vector<CDiskBlockIndex>& vIndex);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadStakeIndex(const COutPoint &prevout, CStakeInputInfo &info);
+    bool WriteStakeIndex(const std::vector<std::pair<COutPoint, CStakeInputInfo> > &list);
+    bool EraseStakeIndex(const std::vector<COutPoint> &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    bool WriteSnapshotBase(const CSnapshotBase &base);
+    bool ReadSnapshotBase(CSnapshotBase &base);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -5,13 +5,17 @@
 
 #include "validation.h"
 #include "kernel.h"
+#include "mappedfile.h"
 #include "arith_uint256.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinstats.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/scrypt.h"
+#include "cuckoocache.h"
 #include "hash.h"
 #include "init.h"
 #include "policy/fees.h"
@@ -23,6 +27,7 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "snapshot.h"
 #include "timedata.h"
 #include "tinyformat.h"
 #include "txdb.h"
@@ -36,7 +41,9 @@
 #include "versionbits.h"
 #include "warnings.h"
 
+#include <algorithm>
 #include <atomic>
+#include <memory>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -60,9 +67,10 @@ CCriticalSection cs_main;
 
 // SolarCoin: PoST
 HashMap mapProofOfStake;
-std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 
 BlockMap mapBlockIndex;
+/** Guards mapBlockIndex against inserts for LookupBlockIndex, which does not take cs_main */
+static boost::shared_mutex cs_mapBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
@@ -73,10 +81,15 @@ bool fReindex = false;
 bool fTxIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fSnapshotChainstate = false;
+bool fSnapshotValidated = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fTrustVerifiedBlocks = DEFAULT_TRUST_VERIFIED_BLOCKS;
+bool fMmapBlocks = DEFAULT_MMAPBLOCKS;
+unsigned int nTxIndexCacheSize = DEFAULT_TXINDEX_CACHE;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -136,6 +149,10 @@ namespace {
     CCriticalSection cs_LastBlockFile;
     std::vector<CBlockFileInfo> vinfoBlockFile;
     int nLastBlockFile = 0;
+
+    /** Read-only mappings of finished block files, by file number (-mmapblocks) */
+    CCriticalSection cs_MappedBlockFiles;
+    std::map<int, std::shared_ptr<const CMappedFile> > mapMappedBlockFiles;
     /** Global flag to indicate we should check to see if there are
      *  block/undo files that should be deleted.  Set on startup
      *  or if we allocate more file space when we're in prune mode
@@ -213,6 +230,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewFlushBuffer *pcoinsbuffer = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 enum FlushStateMode {
@@ -1045,14 +1063,96 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee);
 }
 
+namespace {
+
+/**
+ * Transactions GetTransaction found through the transaction index, with the
+ * block they are in and their offset in it, least recently used ones evicted
+ * first. The transactions of connected and disconnected blocks are erased, as
+ * the index moves them to another block or has them in one no longer active;
+ * a lookup that started before that does not store what it read.
+ */
+class CTxIndexCache
+{
+private:
+    struct CEntry
+    {
+        uint256 txid;
+        CTransactionRef tx;
+        uint256 hashBlock;
+        unsigned int nTxOffset;
+    };
+    typedef std::list<CEntry> list_type;
+
+    CCriticalSection cs;
+    //! Most recently used first
+    list_type listEntries;
+    boost::unordered_map<uint256, list_type::iterator, SaltedTxidHasher> mapEntries;
+    uint64_t nGeneration;
+
+public:
+    CTxIndexCache() : nGeneration(0) {}
+
+    bool Get(const uint256& txid, CTransactionRef& tx, uint256& hashBlock, unsigned int& nTxOffset)
+    {
+        LOCK(cs);
+        auto it = mapEntries.find(txid);
+        if (it == mapEntries.end())
+            return false;
+        listEntries.splice(listEntries.begin(), listEntries, it->second);
+        tx = it->second->tx;
+        hashBlock = it->second->hashBlock;
+        nTxOffset = it->second->nTxOffset;
+        return true;
+    }
+
+    //! Pass to Insert, to detect blocks disconnected in between
+    uint64_t GetGeneration()
+    {
+        LOCK(cs);
+        return nGeneration;
+    }
+
+    void Insert(uint64_t nGenerationRead, const CTransactionRef& tx, const uint256& hashBlock, unsigned int nTxOffset)
+    {
+        LOCK(cs);
+        if (nGenerationRead != nGeneration || nTxIndexCacheSize == 0 || mapEntries.count(tx->GetHash()))
+            return;
+        listEntries.push_front(CEntry{tx->GetHash(), tx, hashBlock, nTxOffset});
+        mapEntries.emplace(tx->GetHash(), listEntries.begin());
+        while (listEntries.size() > nTxIndexCacheSize) {
+            mapEntries.erase(listEntries.back().txid);
+            listEntries.pop_back();
+        }
+    }
+
+    //! Forget the transactions of a block that was connected or disconnected
+    void Invalidate(const CBlock& block)
+    {
+        LOCK(cs);
+        nGeneration++;
+        for (const auto& tx : block.vtx) {
+            auto it = mapEntries.find(tx->GetHash());
+            if (it != mapEntries.end()) {
+                listEntries.erase(it->second);
+                mapEntries.erase(it);
+            }
+        }
+    }
+};
+
+CTxIndexCache txIndexCache;
+
+} // anon namespace
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 // SolarCoin: Modified to return nTxOffset into block.
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, unsigned int &nTxOffset, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
     CBlockIndex *pindexSlow = NULL;
 
-    LOCK(cs_main);
-
+    // The mempool, the transaction index and the block files have locks of
+    // their own, so only the coin database fallback needs cs_main.
     CTransactionRef ptx = mempool.get(hash);
     if (ptx)
     {
@@ -1061,20 +1161,30 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, unsigned int &n
     }
 
     if (fTxIndex) {
+        if (txIndexCache.Get(hash, txOut, hashBlock, nTxOffset))
+            return true;
+        const uint64_t nGeneration = txIndexCache.GetGeneration();
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
-
             // SolarCoin: Return nTxOffset into block
             nTxOffset = postx.nTxOffset;
 
+            std::shared_ptr<const CMappedFile> mapped = GetMappedBlockFile(postx);
             CBlockHeader header;
             try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
+                if (mapped) {
+                    CSpanReader file(SER_DISK, CLIENT_VERSION, mapped->data() + postx.nPos, mapped->size() - postx.nPos);
+                    file >> header;
+                    file.ignore(postx.nTxOffset);
+                    file >> txOut;
+                } else {
+                    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                    if (file.IsNull())
+                        return error("%s: OpenBlockFile failed", __func__);
+                    file >> header;
+                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                    file >> txOut;
+                }
             } catch (const std::exception& e) {
                 return error("%s: Deserialize or I/O error - %s", __func__, e.what());
             }
@@ -1082,11 +1192,13 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, unsigned int &n
             if (txOut->GetHash() != hash) {
                 return error("%s: txid mismatch", __func__);
             }
+            txIndexCache.Insert(nGeneration, txOut, hashBlock, nTxOffset);
             return true;
         }
     }
 
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+        LOCK(cs_main);
         int nHeight = -1;
         {
             const CCoinsViewCache& view = *pcoinsTip;
@@ -1118,7 +1230,6 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, unsigned int &n
 
 
 
-
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
@@ -1145,25 +1256,129 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns)
+namespace {
+
+/**
+ * Entries are salted block hashes, so the first 32 bytes are already random
+ * and can be used directly as the cuckoo hash functions.
+ */
+class PoWVerifiedHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select <8, "PoWVerifiedHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin()+4*hash_select, 4);
+        return u;
+    }
+};
+
+/**
+ * Set of block hashes whose scrypt proof-of-work has already been checked
+ * this session, to avoid recomputing GetPoWHash() every time the same block
+ * is read back from disk (ConnectTip, rescans, getblock, kernel checks).
+ */
+class CPoWVerifiedCache
+{
+private:
+    //! Entries are SHA256(nonce || block hash)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, PoWVerifiedHasher> map_type;
+    map_type setVerified;
+    boost::shared_mutex cs_powcache;
+
+    uint256 ComputeEntry(const uint256& hash) const
+    {
+        uint256 entry;
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Finalize(entry.begin());
+        return entry;
+    }
+
+public:
+    //! Returns the number of elements the cache can hold
+    size_t Setup(size_t nBytes)
+    {
+        GetRandBytes(nonce.begin(), 32);
+        return setVerified.setup_bytes(nBytes);
+    }
+
+    bool Contains(const uint256& hash)
+    {
+        uint256 entry = ComputeEntry(hash);
+        boost::shared_lock<boost::shared_mutex> lock(cs_powcache);
+        return setVerified.contains(entry, false);
+    }
+
+    void Insert(const uint256& hash)
+    {
+        uint256 entry = ComputeEntry(hash);
+        boost::unique_lock<boost::shared_mutex> lock(cs_powcache);
+        setVerified.insert(entry);
+    }
+};
+
+//! Set up by InitPoWVerifiedCache(); checks go straight to scrypt until then
+std::unique_ptr<CPoWVerifiedCache> powVerifiedCache;
+
+} // anon namespace
+
+void InitPoWVerifiedCache()
+{
+    // -powcachesize=0 disables the cache
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-powcachesize", DEFAULT_POW_CACHE_SIZE)), MAX_POW_CACHE_SIZE) * ((size_t) 1 << 20);
+    if (nMaxCacheSize == 0) {
+        powVerifiedCache.reset();
+        LogPrintf("Proof-of-work cache disabled\n");
+        return;
+    }
+    powVerifiedCache.reset(new CPoWVerifiedCache());
+    size_t nElems = powVerifiedCache->Setup(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for proof-of-work cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+/** Check the scrypt proof-of-work of a header, consulting the verified-hash cache first */
+static bool CheckProofOfWorkCached(const CBlockHeader& block, const Consensus::Params& consensusParams)
+{
+    const uint256 hash = block.GetHash();
+    if (powVerifiedCache && powVerifiedCache->Contains(hash))
+        return true;
+    CBlock b(block);
+    if (!CheckProofOfWork(b.GetPoWHash(), block.nBits, consensusParams))
+        return false;
+    if (powVerifiedCache)
+        powVerifiedCache->Insert(hash);
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns, bool fCheckPOW)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), fReadTxns ? SER_DISK : SER_DISK|SER_BLOCKHEADERONLY, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    const int nType = fReadTxns ? SER_DISK : SER_DISK|SER_BLOCKHEADERONLY;
+    std::shared_ptr<const CMappedFile> mapped = GetMappedBlockFile(pos);
 
     // Read block
     try {
-        filein >> block;
+        if (mapped) {
+            CSpanReader filein(nType, CLIENT_VERSION, mapped->data() + pos.nPos, mapped->size() - pos.nPos);
+            filein >> block;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), nType, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            filein >> block;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
     // Check the header
-    if (block.IsProofOfWork() && !CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+    if (fCheckPOW && block.IsProofOfWork() && !CheckProofOfWorkCached(block, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -1171,7 +1386,11 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fReadTxns)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, fReadTxns))
+    // A block whose index entry reached BLOCK_VALID_SCRIPTS had its proof-of-work
+    // checked when it was connected. The hash comparison below is enough to make
+    // sure we read back that same header, so the scrypt re-check can be skipped.
+    const bool fCheckPOW = !(fTrustVerifiedBlocks && pindex->IsValid(BLOCK_VALID_SCRIPTS));
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, fReadTxns, fCheckPOW))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
@@ -1179,6 +1398,43 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const CDiskBlockPos& pos)
+{
+    header.SetNull();
+
+    std::shared_ptr<const CMappedFile> mapped = GetMappedBlockFile(pos);
+    try {
+        if (mapped) {
+            CSpanReader filein(SER_DISK, CLIENT_VERSION, mapped->data() + pos.nPos, mapped->size() - pos.nPos);
+            filein >> header;
+        } else {
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockHeaderFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            filein >> header;
+        }
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const CBlockIndex* pindex)
+{
+    // Every header field is kept in the index once the header was accepted
+    if (pindex->IsValid(BLOCK_VALID_TREE)) {
+        header = pindex->GetBlockHeader();
+        return true;
+    }
+    if (!ReadBlockHeaderFromDisk(header, pindex->GetBlockPos()))
+        return false;
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadBlockHeaderFromDisk(CBlockHeader&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     // Set starting subsidy
@@ -1741,6 +1997,97 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * SolarCoin: scrypt proof-of-work check of a run of headers from a headers
+ * message. Headers that pass go into the verified-hash cache, where the
+ * sequential CheckBlockHeader call in AcceptBlockHeader then finds them.
+ */
+class CHeaderPoWCheck
+{
+private:
+    std::vector<const CBlockHeader*> vHeaders;
+    const Consensus::Params* pparams;
+
+public:
+    CHeaderPoWCheck() : pparams(NULL) {}
+    CHeaderPoWCheck(std::vector<const CBlockHeader*>&& vHeadersIn, const Consensus::Params& params) :
+        vHeaders(std::move(vHeadersIn)), pparams(&params) {}
+
+    //! Fails at the first header of the run with a bad proof-of-work
+    bool operator()()
+    {
+        std::vector<uint256> vHashes;
+        GetPoWHashes(vHeaders, vHashes);
+        for (size_t i = 0; i < vHeaders.size(); i++) {
+            if (!CheckProofOfWork(vHashes[i], vHeaders[i]->nBits, *pparams))
+                return false;
+            if (powVerifiedCache)
+                powVerifiedCache->Insert(vHeaders[i]->GetHash());
+        }
+        return true;
+    }
+
+    void swap(CHeaderPoWCheck& check)
+    {
+        vHeaders.swap(check.vHeaders);
+        std::swap(pparams, check.pparams);
+    }
+};
+
+static CCheckQueue<CHeaderPoWCheck> headercheckqueue(4);
+/** Only one thread may drive headercheckqueue at a time */
+static CCriticalSection cs_headercheckqueue;
+
+void ThreadHeaderCheck() {
+    RenameThread("bitcoin-headerch");
+    headercheckqueue.Thread();
+}
+
+/**
+ * SolarCoin: read of the coins of one transaction spent by a block, done on
+ * the input prefetch threads, see PrefetchBlockInputs.
+ */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsView* pview;
+    uint256 txid;
+    CCoins* pcoins;
+    char* pfFound;
+
+public:
+    CCoinsPrefetch() : pview(NULL), pcoins(NULL), pfFound(NULL) {}
+    CCoinsPrefetch(const CCoinsView& view, const uint256& txidIn, CCoins& coins, char& fFound) :
+        pview(&view), txid(txidIn), pcoins(&coins), pfFound(&fFound) {}
+
+    bool operator()()
+    {
+        *pfFound = pview->GetCoins(txid, *pcoins);
+        return true;
+    }
+
+    void swap(CCoinsPrefetch& check)
+    {
+        std::swap(pview, check.pview);
+        std::swap(txid, check.txid);
+        std::swap(pcoins, check.pcoins);
+        std::swap(pfFound, check.pfFound);
+    }
+};
+
+/** Only driven by ConnectTip, under cs_main */
+static CCheckQueue<CCoinsPrefetch> prefetchqueue(16);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("bitcoin-prefetch");
+    prefetchqueue.Thread();
+}
+
+void ThreadFlushCoins() {
+    RenameThread("bitcoin-coinsflush");
+    pcoinsbuffer->ThreadWrite();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1929,6 +2276,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    std::vector<std::pair<COutPoint, CStakeInputInfo> > vStakeInputs; // SolarCoin: PoST kernel inputs
+    std::vector<COutPoint> vStakeSpent; // SolarCoin: outputs that can no longer be kernel inputs
+    uint64_t nStakeTime = 0; // SolarCoin: of the coinstake
+    const bool fStakeIndex = fTxIndex && !fJustCheck; // just checking has no block hash to record
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -1988,8 +2339,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
+
+            // SolarCoin: spent outputs can no longer be kernel inputs, the coinstake's included
+            if (fStakeIndex) {
+                for (const CTxIn& txin : tx.vin)
+                    vStakeSpent.push_back(txin.prevout);
+            }
         }
 
+        // SolarCoin: look the coinstake's inputs up while they are still unspent in view,
+        // a view below the tip has no other place to find them
+        if (i == 1 && block.IsProofOfStake() && !GetStakeTime(tx, nStakeTime, pindex->pprev, chainparams.GetConsensus(), &view))
+            return error("() : %s unable to get coin age for coinstake", tx.GetHash().ToString().substr(0,10).c_str());
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -1997,6 +2359,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
+        // SolarCoin: record what a future kernel needs from each output, the
+        // kernel offset counts from the start of the block (80 byte header).
+        for (unsigned int j = 0; j < tx.vout.size() && fStakeIndex; j++) {
+            if (!tx.vout[j].IsEmpty())
+                vStakeInputs.push_back(std::make_pair(COutPoint(tx.GetHash(), j),
+                    CStakeInputInfo(pindex->GetBlockHash(), block.GetBlockTime(), pos.nTxOffset + 80, tx.nTime, tx.vout[j].nValue)));
+        }
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
@@ -2006,9 +2375,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (block.IsProofOfStake()) {
         int64_t nCalculatedStakeReward;
         // SolarCoin: coin stake tx earns reward instead of paying fee
-        uint64_t nStakeTime;
-        if (!GetStakeTime(*(block.vtx[1]), nStakeTime, pindex->pprev, chainparams.GetConsensus()))
-            return error("() : %s unable to get coin age for coinstake", (*block.vtx[1]).GetHash().ToString().substr(0,10).c_str());
         nCalculatedStakeReward = GetProofOfStakeTimeReward(nStakeTime, nFees, pindex->pprev, chainparams.GetConsensus());
 
         if (nStakeReward > nCalculatedStakeReward)
@@ -2059,9 +2425,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
+    if (fTxIndex) {
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
+        // Spent outputs go after the new ones, those spent in the block are never kept
+        if (!pblocktree->WriteStakeIndex(vStakeInputs) || !pblocktree->EraseStakeIndex(vStakeSpent))
+            return AbortNode(state, "Failed to write stake input index");
+    }
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2097,6 +2467,9 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
+    // A background write of the coins may have failed since the last call
+    if (pcoinsbuffer && pcoinsbuffer->HasFailed())
+        return AbortNode(state, "Failed to write to coin database");
     if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
         if (nManualPruneHeight > 0) {
             FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
@@ -2162,9 +2535,13 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
                 return AbortNode(state, "Failed to write to block index database");
             }
         }
-        // Finally remove any pruned files
-        if (fFlushForPrune)
+        // Finally remove any pruned files. A coin database that is still
+        // being written in the background could need them after a crash.
+        if (fFlushForPrune) {
+            if (pcoinsbuffer && !pcoinsbuffer->Sync())
+                return AbortNode(state, "Failed to write to coin database");
             UnlinkPrunedFiles(setFilesToPrune);
+        }
         nLastWrite = nNow;
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2177,8 +2554,12 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
+        // With -backgroundflush this only hands the coins to the writer
+        // thread, unless the caller needs them on disk now.
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && pcoinsbuffer && !pcoinsbuffer->Sync())
+            return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -2203,9 +2584,44 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+namespace {
+    /** The last published copy of chainActive, see GetChainSnapshot */
+    std::shared_ptr<const CChainSnapshot> chainSnapshot = std::make_shared<const CChainSnapshot>();
+}
+
+/** Publish a copy of chainActive for readers that do not hold cs_main. */
+void static PublishChainSnapshot() {
+    AssertLockHeld(cs_main);
+    std::shared_ptr<const CChainSnapshot> snapshotPrev = std::atomic_load(&chainSnapshot);
+    std::atomic_store(&chainSnapshot, std::shared_ptr<const CChainSnapshot>(std::make_shared<const CChainSnapshot>(chainActive, snapshotPrev.get())));
+}
+
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot() {
+    return std::atomic_load(&chainSnapshot);
+}
+
+CBlockIndex* LookupBlockIndex(const uint256& hash) {
+    boost::shared_lock<boost::shared_mutex> lock(cs_mapBlockIndex);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    return mi == mapBlockIndex.end() ? NULL : mi->second;
+}
+
+bool ReadChainBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const CChainSnapshot& chain, const Consensus::Params& consensusParams)
+{
+    // The files of blocks in the active chain stay in place, unless pruned.
+    if (!fHavePruned && chain.Contains(pindex) && (pindex->nStatus & BLOCK_HAVE_DATA))
+        return ReadBlockFromDisk(block, pindex, consensusParams);
+
+    LOCK(cs_main);
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+        return false;
+    return ReadBlockFromDisk(block, pindex, consensusParams);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
+    PublishChainSnapshot();
 
     // New best block
     mempool.AddTransactionsUpdated(1);
@@ -2266,6 +2682,46 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
 
 }
 
+/**
+ * SolarCoin: Undo the stake input index changes of a block disconnected from
+ * the tip: its outputs are gone, and the outputs it spent are stake inputs
+ * again. The coinstake is handled like any other transaction, so the index
+ * follows the active chain even though DisconnectBlock leaves its coins alone.
+ */
+static void DisconnectStakeIndex(const CBlock& block, const Consensus::Params& params)
+{
+    std::set<uint256> setBlockTxids;
+    std::vector<COutPoint> vStakeGone;
+    for (const auto& ptx : block.vtx) {
+        const uint256 hash = ptx->GetHash();
+        setBlockTxids.insert(hash);
+        for (unsigned int j = 0; j < ptx->vout.size(); j++) {
+            if (!ptx->vout[j].IsEmpty())
+                vStakeGone.push_back(COutPoint(hash, j));
+        }
+    }
+    if (!pblocktree->EraseStakeIndex(vStakeGone))
+        LogPrintf("%s: failed to erase stake input index entries of block %s\n", __func__, block.GetHash().ToString());
+
+    // The spent outputs' entries were erased, so this reads them back through the transaction index
+    std::vector<std::pair<COutPoint, CStakeInputInfo> > vStakeInputs;
+    for (const auto& ptx : block.vtx) {
+        if (ptx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : ptx->vin) {
+            if (setBlockTxids.count(txin.prevout.hash))
+                continue;
+            CStakeInputInfo stakeInput;
+            if (GetStakeInputInfo(txin.prevout, stakeInput, params))
+                vStakeInputs.push_back(std::make_pair(txin.prevout, stakeInput));
+            else
+                LogPrint("stake", "%s: cannot restore stake input index entry of %s\n", __func__, txin.prevout.ToString());
+        }
+    }
+    if (!pblocktree->WriteStakeIndex(vStakeInputs))
+        LogPrintf("%s: failed to restore stake input index entries of block %s\n", __func__, block.GetHash().ToString());
+}
+
 /** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
 bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, bool fBare = false)
 {
@@ -2281,6 +2737,9 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         CCoinsViewCache view(pcoinsTip);
         if (!DisconnectBlock(block, state, pindexDelete, view))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        if (fTxIndex)
+            DisconnectStakeIndex(block, chainparams.GetConsensus());
+        coinsStatsCache.UpdateTip(*pcoinsTip, view, block, pindexDelete->pprev);
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2312,6 +2771,8 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
+    kernelModifierIndex.Disconnect(pindexDelete);
+    txIndexCache.Invalidate(block);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     for (const auto& tx : block.vtx) {
@@ -2321,11 +2782,64 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
 
+/**
+ * SolarCoin: read the coins spent by a block from the database below
+ * pcoinsTip on the prefetch threads, and add them to pcoinsTip before
+ * ConnectBlock looks them up one input at a time. On a cold cache this turns
+ * a long run of sequential database reads into a few parallel ones.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setCreated;
+    for (const auto& tx : block.vtx)
+        setCreated.insert(tx->GetHash());
+    std::vector<uint256> vTxid;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            const uint256& hash = txin.prevout.hash;
+            if (!setCreated.count(hash) && !pcoinsTip->HaveCoinsInCache(hash))
+                vTxid.push_back(hash);
+        }
+    }
+    std::sort(vTxid.begin(), vTxid.end());
+    vTxid.erase(std::unique(vTxid.begin(), vTxid.end()), vTxid.end());
+    if (vTxid.empty())
+        return;
+
+    const CCoinsView& base = pcoinsTip->GetBackend();
+    std::vector<CCoins> vCoins(vTxid.size());
+    std::vector<char> vFound(vTxid.size(), 0);
+    std::vector<CCoinsPrefetch> vChecks;
+    vChecks.reserve(vTxid.size());
+    for (size_t i = 0; i < vTxid.size(); i++)
+        vChecks.emplace_back(base, vTxid[i], vCoins[i], vFound[i]);
+    {
+        CCheckQueueControl<CCoinsPrefetch> control(&prefetchqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+    for (size_t i = 0; i < vTxid.size(); i++) {
+        if (vFound[i])
+            pcoinsTip->AddFetchedCoins(vTxid[i], vCoins[i]);
+    }
+
+    int64_t nTimeEnd = GetTimeMicros(); nTimePrefetch += nTimeEnd - nTimeStart;
+    LogPrint("bench", "  - Prefetch %u inputs: %.2fms [%.2fs]\n", vTxid.size(), (nTimeEnd - nTimeStart) * 0.001, nTimePrefetch * 0.000001);
+}
+
 /**
  * Used to track blocks whose transactions were applied to the UTXO state as a
  * part of a single ActivateBestChainStep call.
@@ -2360,6 +2874,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchBlockInputs(blockConnecting);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2371,6 +2886,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        coinsStatsCache.UpdateTip(*pcoinsTip, view, blockConnecting, pindexNew);
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2385,6 +2901,12 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
+    kernelModifierIndex.Connect(pindexNew);
+    txIndexCache.Invalidate(blockConnecting);
+    stakeSeenFilter.Prune(pindexNew->nHeight);
+    // SolarCoin: the header may have been too far above the tip to be recorded
+    if (pindexNew->nHeight > chainparams.GetConsensus().LAST_POW_BLOCK)
+        stakeSeenFilter.Insert(pindexNew->prevoutStake, pindexNew->nStakeTime, pindexNew->nHeight);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
@@ -2768,9 +3290,11 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const CChainParams& chai
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    BlockMap::iterator mi;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_mapBlockIndex);
+        mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
+    }
     pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
@@ -2781,6 +3305,8 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const CChainParams& chai
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
+    // SolarCoin: from pprev's cached values, so kernel checks on top of this block only do a lookup
+    SetStakeWeightCache(pindexNew, chainparams.GetConsensus());
 
     // ppcoin: compute stake entropy bit for stake modifier
     if (!pindexNew->SetStakeEntropyBit(block.GetStakeEntropyBit(pindexNew->nTime)))
@@ -2809,8 +3335,9 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const CChainParams& chai
             LogPrintf("%s: Rejected by stake modifier checkpoint height=%d, modifier=%016x\n", __func__, pindexNew->nHeight, nStakeModifier);
 
     // SolarCoin: CBlockIndex::IsProofOfStake is not valid during header download. Use height instead.
+    // Headers far above the active tip are left out, see CStakeSeenFilter.
     if (pindexNew->nHeight > chainparams.GetConsensus().LAST_POW_BLOCK)
-        setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        stakeSeenFilter.Insert(pindexNew->prevoutStake, pindexNew->nStakeTime, pindexNew->nHeight);
 
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
@@ -2964,8 +3491,7 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const
     bool fPoW = block.nVersion <= CBlockHeader::LEGACY_VERSION_2 ? true : false;
     // Check proof of work matches claimed amount
     if (fPoW && fCheckPOW) {
-        CBlock b(block);
-        if (!CheckProofOfWork(b.GetPoWHash(), block.nBits, consensusParams))
+        if (!CheckProofOfWorkCached(block, consensusParams))
             return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
     }
 
@@ -3165,6 +3691,12 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const Co
         }
     }
 
+    // ppcoin: check block signature once the rule is active. The signature is
+    // not covered by the block hash, so a bad one does not make the block
+    // itself invalid.
+    if (nHeight >= consensusParams.BlockSignatureHeight && block.IsProofOfStake() && !block.CheckBlockSignature())
+        return state.DoS(100, false, REJECT_INVALID, "bad-blk-signature", true, "bad proof-of-stake block signature");
+
     // Enforce rule that the coinbase starts with serialized block height
     //if (nHeight >= consensusParams.BIP34Height)
     //{
@@ -3336,9 +3868,64 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 }
 
 // Exposed wrapper for AcceptBlockHeader
+/**
+ * SolarCoin: check the scrypt proof-of-work of the new PoW-era headers of a
+ * headers message on the header check threads, without holding cs_main.
+ * Only the leading headers that connect, to a known valid block or to the
+ * header before them in the message, are checked, so a message that does not
+ * connect costs no scrypt work. Work stops at the first header that fails;
+ * it and the headers after it are left out of the cache and rejected by the
+ * sequential checks.
+ */
+static void CheckHeadersPoW(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams)
+{
+    std::vector<const CBlockHeader*> vUnchecked;
+    {
+        LOCK(cs_main);
+        uint256 hashLast;
+        for (const CBlockHeader& header : headers) {
+            if (hashLast.IsNull() || header.hashPrevBlock != hashLast) {
+                BlockMap::const_iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+                if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_FAILED_MASK))
+                    break;
+            }
+            hashLast = header.GetHash();
+            if (header.nVersion <= CBlockHeader::LEGACY_VERSION_2 && !mapBlockIndex.count(hashLast))
+                vUnchecked.push_back(&header);
+        }
+    }
+    if (vUnchecked.size() < 2)
+        return;
+
+    // Runs of a few SIMD batches each, so every thread gets a share. The
+    // queue hands out checks from the back, so the last run goes in first:
+    // once a run fails, the threads skip the runs after it.
+    const size_t nRun = 2 * scrypt_batch_lanes();
+    std::vector<CHeaderPoWCheck> vChecks;
+    vChecks.reserve((vUnchecked.size() + nRun - 1) / nRun);
+    for (size_t i = 0; i < vUnchecked.size(); i += nRun) {
+        std::vector<const CBlockHeader*> vRun(vUnchecked.begin() + i, vUnchecked.begin() + std::min(i + nRun, vUnchecked.size()));
+        vChecks.push_back(CHeaderPoWCheck(std::move(vRun), consensusParams));
+    }
+    std::reverse(vChecks.begin(), vChecks.end());
+
+    if (!nScriptCheckThreads) {
+        for (std::vector<CHeaderPoWCheck>::reverse_iterator it = vChecks.rbegin(); it != vChecks.rend(); ++it) {
+            if (!(*it)())
+                break;
+        }
+        return;
+    }
+    LOCK(cs_headercheckqueue);
+    CCheckQueueControl<CHeaderPoWCheck> control(&headercheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    CheckHeadersPoW(headers, chainparams.GetConsensus());
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
@@ -3453,18 +4040,22 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         if (ret) {
             uint256 hash = pblock->GetHash();
             LogPrintf("ProcessNewBlock(): %s\n",hash.ToString());
+            // SolarCoin: a block below a snapshot chainstate is already in the active chain, its
+            // kernel is checked by the background validation against the coins it spends
+            BlockMap::iterator miSelf = mapBlockIndex.find(hash);
+            const bool fSnapshotBlock = miSelf != mapBlockIndex.end() && IsSnapshotValidationBlock(miSelf->second);
             // ppcoin: check proof-of-stake
             // Limited duplicity on stake: prevents block flood attack
-            if (pblock->IsProofOfStake())
+            if (pblock->IsProofOfStake() && !fSnapshotBlock)
             {
-                if (setStakeSeen.count(pblock->GetProofOfStake()))
+                if (stakeSeenFilter.Contains(pblock->GetProofOfStake()))
                     return error("%s: duplicate proof-of-stake (%s, %d) for block %s", __func__,
                         pblock->GetProofOfStake().first.ToString(), pblock->GetProofOfStake().second,
                         hash.ToString());
             }
             // ppcoin: verify hash target and signature of coinstake tx
             // if we have the previous block and we are not downloading
-            if (pblock->IsProofOfStake() && mapBlockIndex.count(pblock->hashPrevBlock))
+            if (pblock->IsProofOfStake() && !fSnapshotBlock && mapBlockIndex.count(pblock->hashPrevBlock))
             {
                 uint256 targetProofOfStake;
                 if (!CheckProofOfStake(*pblock->vtx[1], pblock->nBits, hashProofOfStake, targetProofOfStake, chainparams.GetConsensus())) {
@@ -3589,12 +4180,24 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        {
+            LOCK(cs_MappedBlockFiles);
+            mapMappedBlockFiles.erase(*it);
+        }
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
 }
 
+/* SolarCoin: keep the blocks below a snapshot chainstate that background validation has yet to connect */
+static void LimitPruneToSnapshotValidation(unsigned int& nLastBlockWeCanPrune)
+{
+    int nValidatedHeight, nSnapshotHeight;
+    if (GetSnapshotValidationProgress(nValidatedHeight, nSnapshotHeight))
+        nLastBlockWeCanPrune = std::min(nLastBlockWeCanPrune, (unsigned int)std::max(nValidatedHeight, 0));
+}
+
 /* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
 void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
 {
@@ -3606,6 +4209,7 @@ void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeig
 
     // last block to prune is the lesser of (user-specified height, MIN_BLOCKS_TO_KEEP from the tip)
     unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
+    LimitPruneToSnapshotValidation(nLastBlockWeCanPrune);
     int count=0;
     for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
         if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
@@ -3636,6 +4240,7 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
     }
 
     unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
+    LimitPruneToSnapshotValidation(nLastBlockWeCanPrune);
     uint64_t nCurrentUsage = CalculateCurrentUsage();
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
@@ -3710,6 +4315,25 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "blk", fReadOnly);
 }
 
+std::shared_ptr<const CMappedFile> GetMappedBlockFile(const CDiskBlockPos &pos)
+{
+    if (!fMmapBlocks || pos.IsNull())
+        return nullptr;
+    {
+        // The last file is still being appended to
+        LOCK(cs_LastBlockFile);
+        if ((int)pos.nFile >= nLastBlockFile)
+            return nullptr;
+    }
+    LOCK(cs_MappedBlockFiles);
+    std::shared_ptr<const CMappedFile>& mapped = mapMappedBlockFiles[pos.nFile];
+    if (!mapped)
+        mapped = std::make_shared<const CMappedFile>(GetBlockPosFilename(pos, "blk"));
+    if (mapped->IsNull() || pos.nPos >= mapped->size())
+        return nullptr;
+    return mapped;
+}
+
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
@@ -3733,9 +4357,10 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     CBlockIndex* pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
-    mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_mapBlockIndex);
+        mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
+    }
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
@@ -3762,6 +4387,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        SetStakeWeightCache(pindex, chainparams.GetConsensus());
         // SolarCoin: calculate stake modifier checksum
         if (pindex->nHeight > 0) {
             pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex, chainparams.GetConsensus());
@@ -3833,6 +4459,16 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // SolarCoin: check whether the chainstate was loaded from a snapshot
+    pblocktree->ReadFlag("snapshotchainstate", fSnapshotChainstate);
+    if (fSnapshotChainstate) {
+        if (pcoinsTip->GetBestBlock().IsNull())
+            return error("LoadBlockIndexDB(): chainstate snapshot load was interrupted, restart with -loadtxoutset or -reindex");
+        pblocktree->ReadFlag("snapshotvalidated", fSnapshotValidated);
+        LogPrintf("LoadBlockIndexDB(): Chainstate was loaded from a snapshot, %s\n",
+            fSnapshotValidated ? "the blocks below it have been validated" : "the blocks below it are validated in the background");
+    }
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -3844,9 +4480,21 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+
+    // SolarCoin: record the stakes of blocks near the tip for the duplicate-stake check
+    stakeSeenFilter.Prune(it == mapBlockIndex.end() ? 0 : it->second->nHeight);
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+    {
+        CBlockIndex* pindex = item.second;
+        if (pindex->IsProofOfStake())
+            stakeSeenFilter.Insert(pindex->prevoutStake, pindex->nStakeTime, pindex->nHeight);
+    }
+
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    PublishChainSnapshot();
+    kernelModifierIndex.Rebuild(chainActive.Tip());
 
     PruneBlockIndexCandidates();
 
@@ -3898,7 +4546,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
             // If pruning, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
@@ -3975,7 +4623,7 @@ bool RewindBlockIndex(const CChainParams& params)
     CValidationState state;
     CBlockIndex* pindex = chainActive.Tip();
     while (chainActive.Height() >= nHeight) {
-        if (fPruneMode && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
+        if (fHavePruned && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
             // If pruning, don't try rewinding past the HAVE_DATA point;
             // since older blocks can't be served anyway, there's
             // no need to walk further, and trying to DisconnectTip()
@@ -4051,6 +4699,10 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    PublishChainSnapshot();
+    kernelModifierIndex.Clear();
+    stakeSeenFilter.Clear();
+    coinsStatsCache.Clear();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
@@ -4065,16 +4717,22 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
+    boost::unique_lock<boost::shared_mutex> lockIndex(cs_mapBlockIndex);
     BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
         delete entry.second;
     }
     mapBlockIndex.clear();
+    lockIndex.unlock();
     mapProofOfStake.clear();
     fHavePruned = false;
+    fSnapshotChainstate = false;
+    fSnapshotValidated = false;
 }
 
 bool LoadBlockIndex(const CChainParams& chainparams)
 {
+    LOCK(cs_main);
+
     // Load block index from databases
     if (!fReindex && !LoadBlockIndexDB(chainparams))
         return false;
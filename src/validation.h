@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -36,7 +37,9 @@ class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
 class CChainParams;
+class CCoinsViewFlushBuffer;
 class CInv;
+class CMappedFile;
 class CConnman;
 class CScriptCheck;
 class CTxMemPool;
@@ -80,6 +83,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of header proof-of-work checking threads, they only run during header sync */
+static const int MAX_HEADERCHECK_THREADS = 2;
+/** Maximum number of block input prefetch threads, they mostly wait on the database */
+static const int MAX_PREFETCH_THREADS = 4;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -131,6 +138,18 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -trustverifiedblocks */
+static const bool DEFAULT_TRUST_VERIFIED_BLOCKS = false;
+/** Default for -mmapblocks */
+static const bool DEFAULT_MMAPBLOCKS = false;
+/** Default for -backgroundflush */
+static const bool DEFAULT_BACKGROUND_FLUSH = false;
+/** Default for -txindexcache, the number of transactions GetTransaction keeps */
+static const unsigned int DEFAULT_TXINDEX_CACHE = 10000;
+/** Default for -powcachesize, the set of block hashes whose proof-of-work has been checked (in MiB) */
+static const unsigned int DEFAULT_POW_CACHE_SIZE = 8;
+/** Maximum for -powcachesize (in MiB) */
+static const int64_t MAX_POW_CACHE_SIZE = 256;
 
 // While not building the index saves space, under the current PoST algorthm the TX index 
 // is required to correctly calculate the offset of the previous transaction from its block start 
@@ -160,7 +179,6 @@ struct BlockHasher
 // SolarCoin: PoST
 typedef boost::unordered_map<uint256, uint256, BlockHasher> HashMap;
 extern HashMap mapProofOfStake;
-extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 /**
  * Returns true if there are nRequired or more blocks of minVersion or above
  * in the last nToCheck blocks, starting at pstart and going backwards.
@@ -173,6 +191,8 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Find a block index entry by hash, without holding cs_main. Returns NULL if it is unknown. */
+CBlockIndex* LookupBlockIndex(const uint256& hash);
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern uint64_t nLastBlockWeight;
@@ -187,6 +207,11 @@ extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Skip the scrypt re-check when reading blocks whose index entry is already BLOCK_VALID_SCRIPTS */
+extern bool fTrustVerifiedBlocks;
+/** Read blocks from read-only mappings of finished block files instead of through stdio */
+extern bool fMmapBlocks;
+extern unsigned int nTxIndexCacheSize;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -213,6 +238,10 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** SolarCoin: True if the chainstate was loaded from a snapshot (-loadtxoutset); blocks below it count as pruned. */
+extern bool fSnapshotChainstate;
+/** SolarCoin: True once the blocks below a snapshot chainstate have been validated in the background. */
+extern bool fSnapshotValidated;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -268,6 +297,8 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationS
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+/** Mapping of the block file containing pos, or NULL if -mmapblocks is off or the file is still being written */
+std::shared_ptr<const CMappedFile> GetMappedBlockFile(const CDiskBlockPos &pos);
 /** Open an undo file (rev?????.dat) */
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
@@ -276,12 +307,20 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
+/** Set up the cache of checked proof-of-work hashes from -powcachesize; call once in AppInitMain/TestingSetup */
+void InitPoWVerifiedCache();
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadHeaderCheck();
+/** Run an instance of the block input prefetch thread */
+void ThreadCoinsPrefetch();
+/** Run the thread that writes flushed coins to the coin database, for -backgroundflush */
+void ThreadFlushCoins();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -489,8 +528,18 @@ public:
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns = true);
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fReadTxns = true, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fReadTxns = true);
+/**
+ * Read a block for a reader that does not hold cs_main. Blocks in chain (a snapshot
+ * of the active chain) are read directly, others after checking under cs_main that
+ * their data was not pruned.
+ */
+bool ReadChainBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const CChainSnapshot& chain, const Consensus::Params& consensusParams);
+/** Read only the 80-byte header of a block, without its transactions */
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const CDiskBlockPos& pos);
+/** Header of pindex, taken from the block index when it holds the accepted header and read from disk otherwise */
+bool ReadBlockHeaderFromDisk(CBlockHeader& header, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -554,9 +603,19 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/**
+ * An immutable copy of chainActive, replaced every time its tip changes. Callers
+ * may keep and use it without holding cs_main; the block index entries it points
+ * to are never freed while the node runs.
+ */
+std::shared_ptr<const CChainSnapshot> GetChainSnapshot();
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the layer below pcoinsTip that writes the coin database (protected by cs_main) */
+extern CCoinsViewFlushBuffer *pcoinsbuffer;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
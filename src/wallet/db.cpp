@@ -10,6 +10,7 @@
 #include "protocol.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "wallet/logdb.h"
 
 #include <stdint.h>
 
@@ -23,6 +24,338 @@
 
 using namespace std;
 
+static CLogDB::Data GetLogData(const CDataStream& ss)
+{
+    return CLogDB::Data(ss.begin(), ss.end());
+}
+
+static void SetLogData(CDataStream& ss, const CLogDB::Data& data)
+{
+    ss.SetType(SER_DISK);
+    ss.clear();
+    ss.write(data.data(), data.size());
+}
+
+namespace {
+
+class CBDBTxn : public CDBTxn
+{
+private:
+    DbTxn* ptxn;
+
+public:
+    explicit CBDBTxn(DbTxn* ptxnIn) : ptxn(ptxnIn) {}
+
+    DbTxn* Get() const { return ptxn; }
+    bool Commit() override { return ptxn->commit(0) == 0; }
+    bool Abort() override { return ptxn->abort() == 0; }
+};
+
+class CBDBCursor : public CDBCursor
+{
+private:
+    Dbc* pcursor;
+
+public:
+    explicit CBDBCursor(Dbc* pcursorIn) : pcursor(pcursorIn) {}
+    ~CBDBCursor() { pcursor->close(); }
+
+    int Read(CDataStream& ssKey, CDataStream& ssValue, bool setRange) override
+    {
+        // Read at cursor
+        Dbt datKey;
+        unsigned int fFlags = DB_NEXT;
+        if (setRange) {
+            datKey.set_data(ssKey.data());
+            datKey.set_size(ssKey.size());
+            fFlags = DB_SET_RANGE;
+        }
+        Dbt datValue;
+        datKey.set_flags(DB_DBT_MALLOC);
+        datValue.set_flags(DB_DBT_MALLOC);
+        int ret = pcursor->get(&datKey, &datValue, fFlags);
+        if (ret != 0)
+            return ret;
+        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
+            return 99999;
+
+        // Convert to streams
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write((char*)datKey.get_data(), datKey.get_size());
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+        // Clear and free memory
+        memset(datKey.get_data(), 0, datKey.get_size());
+        memset(datValue.get_data(), 0, datValue.get_size());
+        free(datKey.get_data());
+        free(datValue.get_data());
+        return 0;
+    }
+};
+
+/** A Berkeley DB btree in the environment of env */
+class CBDBStore : public CDBStore
+{
+private:
+    CDBEnv& env;
+    Db* pdb;
+
+    static DbTxn* GetTxn(CDBTxn* ptxn) { return ptxn ? static_cast<CBDBTxn*>(ptxn)->Get() : NULL; }
+
+public:
+    CBDBStore(CDBEnv& envIn, Db* pdbIn) : env(envIn), pdb(pdbIn) {}
+    ~CBDBStore() { Close(); }
+
+    bool Read(CDBTxn* ptxn, const CDataStream& ssKey, CDataStream& ssValue) override
+    {
+        Dbt datKey((void*)ssKey.data(), ssKey.size());
+        Dbt datValue;
+        datValue.set_flags(DB_DBT_MALLOC);
+        int ret = pdb->get(GetTxn(ptxn), &datKey, &datValue, 0);
+        if (datValue.get_data() == NULL)
+            return false;
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+        // Clear and free memory
+        memset(datValue.get_data(), 0, datValue.get_size());
+        free(datValue.get_data());
+        return (ret == 0);
+    }
+
+    bool Write(CDBTxn* ptxn, const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite) override
+    {
+        Dbt datKey((void*)ssKey.data(), ssKey.size());
+        Dbt datValue((void*)ssValue.data(), ssValue.size());
+        int ret = pdb->put(GetTxn(ptxn), &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+        return (ret == 0);
+    }
+
+    bool Erase(CDBTxn* ptxn, const CDataStream& ssKey) override
+    {
+        Dbt datKey((void*)ssKey.data(), ssKey.size());
+        int ret = pdb->del(GetTxn(ptxn), &datKey, 0);
+        return (ret == 0 || ret == DB_NOTFOUND);
+    }
+
+    bool Exists(CDBTxn* ptxn, const CDataStream& ssKey) override
+    {
+        Dbt datKey((void*)ssKey.data(), ssKey.size());
+        int ret = pdb->exists(GetTxn(ptxn), &datKey, 0);
+        return (ret == 0);
+    }
+
+    CDBCursor* GetCursor() override
+    {
+        Dbc* pcursor = NULL;
+        int ret = pdb->cursor(NULL, &pcursor, 0);
+        if (ret != 0)
+            return NULL;
+        return new CBDBCursor(pcursor);
+    }
+
+    CDBTxn* TxnBegin() override
+    {
+        DbTxn* ptxn = env.TxnBegin();
+        if (!ptxn)
+            return NULL;
+        return new CBDBTxn(ptxn);
+    }
+
+    void Checkpoint(bool fReadOnly) override
+    {
+        // Flush database activity from memory pool to disk log
+        unsigned int nMinutes = 0;
+        if (fReadOnly)
+            nMinutes = 1;
+
+        env.dbenv->txn_checkpoint(nMinutes ? GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
+    }
+
+    bool Flush() override
+    {
+        // Only closing the file moves the log data into it, see CDBEnv::FlushDb
+        return false;
+    }
+
+    bool Close() override
+    {
+        if (!pdb)
+            return true;
+        int ret = pdb->close(0);
+        delete pdb;
+        pdb = NULL;
+        return (ret == 0);
+    }
+};
+
+/** Writes held back until they are committed as one frame */
+class CLogDBTxn : public CDBTxn
+{
+private:
+    CLogDB& log;
+    std::vector<CLogDB::Record> vRecords;
+    //! Last record of each key in vRecords
+    std::map<CLogDB::Data, size_t, CLogDB::DataLess> mapLast;
+
+public:
+    explicit CLogDBTxn(CLogDB& logIn) : log(logIn) {}
+
+    void Add(const CLogDB::Record& record)
+    {
+        mapLast[record.key] = vRecords.size();
+        vRecords.push_back(record);
+    }
+
+    const CLogDB::Record* Find(const CLogDB::Data& key) const
+    {
+        std::map<CLogDB::Data, size_t, CLogDB::DataLess>::const_iterator it = mapLast.find(key);
+        if (it == mapLast.end())
+            return NULL;
+        return &vRecords[it->second];
+    }
+
+    bool Commit() override
+    {
+        bool ret = vRecords.empty() || log.Write(vRecords);
+        vRecords.clear();
+        mapLast.clear();
+        return ret;
+    }
+
+    bool Abort() override
+    {
+        vRecords.clear();
+        mapLast.clear();
+        return true;
+    }
+};
+
+/** Steps through the records of a log by key, so writes in between do not upset it */
+class CLogDBCursor : public CDBCursor
+{
+private:
+    const CLogDB& log;
+    CLogDB::Data key;
+    bool fStarted;
+
+public:
+    explicit CLogDBCursor(const CLogDB& logIn) : log(logIn), fStarted(false) {}
+
+    int Read(CDataStream& ssKey, CDataStream& ssValue, bool setRange) override
+    {
+        if (setRange)
+            key = GetLogData(ssKey);
+        CLogDB::Data value;
+        if (!log.Next(key, !fStarted || setRange, key, value))
+            return DB_NOTFOUND;
+        fStarted = true;
+        SetLogData(ssKey, key);
+        SetLogData(ssValue, value);
+        return 0;
+    }
+};
+
+/** A CLogDB log; transactions go to the file as one frame when committed */
+class CLogDBStore : public CDBStore
+{
+private:
+    CLogDB log;
+
+    bool Apply(CDBTxn* ptxn, const CLogDB::Record& record)
+    {
+        if (ptxn) {
+            static_cast<CLogDBTxn*>(ptxn)->Add(record);
+            return true;
+        }
+        return log.Write(std::vector<CLogDB::Record>(1, record));
+    }
+
+public:
+    explicit CLogDBStore(const boost::filesystem::path& path) : log(path) {}
+    ~CLogDBStore() { Close(); }
+
+    CLogDB::OpenResult Open(bool fCreate) { return log.Open(fCreate); }
+
+    bool Read(CDBTxn* ptxn, const CDataStream& ssKey, CDataStream& ssValue) override
+    {
+        CLogDB::Data key = GetLogData(ssKey), value;
+        const CLogDB::Record* precord = ptxn ? static_cast<CLogDBTxn*>(ptxn)->Find(key) : NULL;
+        if (precord) {
+            if (precord->fErase)
+                return false;
+            value = precord->value;
+        } else if (!log.Read(key, value))
+            return false;
+        SetLogData(ssValue, value);
+        return true;
+    }
+
+    bool Write(CDBTxn* ptxn, const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite) override
+    {
+        if (!fOverwrite && Exists(ptxn, ssKey))
+            return false;
+        CLogDB::Record record;
+        record.key = GetLogData(ssKey);
+        record.value = GetLogData(ssValue);
+        return Apply(ptxn, record);
+    }
+
+    bool Erase(CDBTxn* ptxn, const CDataStream& ssKey) override
+    {
+        if (!Exists(ptxn, ssKey))
+            return true;
+        CLogDB::Record record;
+        record.fErase = true;
+        record.key = GetLogData(ssKey);
+        return Apply(ptxn, record);
+    }
+
+    bool Exists(CDBTxn* ptxn, const CDataStream& ssKey) override
+    {
+        CLogDB::Data key = GetLogData(ssKey);
+        const CLogDB::Record* precord = ptxn ? static_cast<CLogDBTxn*>(ptxn)->Find(key) : NULL;
+        if (precord)
+            return !precord->fErase;
+        return log.Exists(key);
+    }
+
+    CDBCursor* GetCursor() override
+    {
+        return new CLogDBCursor(log);
+    }
+
+    CDBTxn* TxnBegin() override
+    {
+        return new CLogDBTxn(log);
+    }
+
+    void Checkpoint(bool fReadOnly) override
+    {
+        // Every write is in the file already, make them durable as a Berkeley
+        // DB checkpoint would. Compacting is left to Flush.
+        if (!fReadOnly && !log.Commit())
+            LogPrintf("CLogDBStore::Checkpoint: Failed to commit the log to disk\n");
+    }
+
+    bool Flush() override
+    {
+        return log.Flush();
+    }
+
+    bool Close() override
+    {
+        log.Close();
+        return true;
+    }
+};
+
+} // namespace
+
 
 //
 // CDB
@@ -150,8 +483,16 @@ CDBEnv::VerifyResult CDBEnv::Verify(const std::string& strFile, bool (*recoverFu
     LOCK(cs_db);
     assert(mapFileUseCount.count(strFile) == 0);
 
-    Db db(dbenv, 0);
-    int result = db.verify(strFile.c_str(), NULL, NULL, 0);
+    int result;
+    if (IsLogFile(strFile)) {
+        // Opening a log reads and checks all of it, so keep it open for the first handle
+        if (mapDb[strFile] == NULL)
+            mapDb[strFile] = OpenStore(strFile, false, true);
+        result = (mapDb[strFile] != NULL ? 0 : DB_VERIFY_BAD);
+    } else {
+        Db db(dbenv, 0);
+        result = db.verify(strFile.c_str(), NULL, NULL, 0);
+    }
     if (result == 0)
         return VERIFY_OK;
     else if (recoverFunc == NULL)
@@ -172,6 +513,23 @@ bool CDBEnv::Salvage(const std::string& strFile, bool fAggressive, std::vector<C
     LOCK(cs_db);
     assert(mapFileUseCount.count(strFile) == 0);
 
+    if (IsLogFile(strFile)) {
+        // The records before a damaged frame are all that can be read of a log
+        CLogDB log(boost::filesystem::path(strPath) / strFile);
+        CLogDB::OpenResult result = log.Open(false, true);
+        if (result == CLogDB::OPEN_FAIL)
+            return false;
+        if (result == CLogDB::OPEN_DAMAGED)
+            LogPrintf("CDBEnv::Salvage: Log salvage found a damaged frame, all data may not be recoverable.\n");
+        CLogDB::Data key, value;
+        bool fFirst = true;
+        while (log.Next(key, fFirst, key, value)) {
+            vResult.push_back(make_pair(std::vector<unsigned char>(key.begin(), key.end()), std::vector<unsigned char>(value.begin(), value.end())));
+            fFirst = false;
+        }
+        return (result == CLogDB::OPEN_OK);
+    }
+
     u_int32_t flags = DB_SALVAGE;
     if (fAggressive)
         flags |= DB_AGGRESSIVE;
@@ -231,24 +589,62 @@ bool CDBEnv::Salvage(const std::string& strFile, bool fAggressive, std::vector<C
 void CDBEnv::CheckpointLSN(const std::string& strFile)
 {
     dbenv->txn_checkpoint(0, 0, 0);
-    if (fMockDb)
+    if (fMockDb || IsLogFile(strFile))
         return;
     dbenv->lsn_reset(strFile.c_str(), 0);
 }
 
+bool CDBEnv::IsLogFile(const std::string& strFile)
+{
+    return !fMockDb && CLogDB::IsLogFile(boost::filesystem::path(strPath) / strFile);
+}
+
+CDBStore* CDBEnv::OpenStore(const std::string& strFile, bool fCreate, bool fLog)
+{
+    if (fLog) {
+        std::unique_ptr<CLogDBStore> pstore(new CLogDBStore(boost::filesystem::path(strPath) / strFile));
+        if (pstore->Open(fCreate) != CLogDB::OPEN_OK)
+            return NULL;
+        return pstore.release();
+    }
+
+    unsigned int nFlags = DB_THREAD;
+    if (fCreate)
+        nFlags |= DB_CREATE;
+
+    Db* pdb = new Db(dbenv, 0);
+    if (fMockDb) {
+        DbMpoolFile* mpf = pdb->get_mpf();
+        int ret = mpf->set_flags(DB_MPOOL_NOFILE, 1);
+        if (ret != 0) {
+            delete pdb;
+            throw runtime_error(strprintf("CDB: Failed to configure for no temp file backing for database %s", strFile));
+        }
+    }
+
+    int ret = pdb->open(NULL,                               // Txn pointer
+                        fMockDb ? NULL : strFile.c_str(),   // Filename
+                        fMockDb ? strFile.c_str() : "main", // Logical db name
+                        DB_BTREE,                           // Database type
+                        nFlags,                             // Flags
+                        0);
+    if (ret != 0) {
+        LogPrintf("CDBEnv::OpenStore: Error %d opening database %s: %s\n", ret, strFile, DbEnv::strerror(ret));
+        delete pdb;
+        return NULL;
+    }
+    return new CBDBStore(*this, pdb);
+}
+
 
 CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL)
 {
-    int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
     if (strFilename.empty())
         return;
 
     bool fCreate = strchr(pszMode, 'c') != NULL;
-    unsigned int nFlags = DB_THREAD;
-    if (fCreate)
-        nFlags |= DB_CREATE;
 
     {
         LOCK(bitdb.cs_db);
@@ -259,29 +655,14 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
         ++bitdb.mapFileUseCount[strFile];
         pdb = bitdb.mapDb[strFile];
         if (pdb == NULL) {
-            pdb = new Db(bitdb.dbenv, 0);
-
-            bool fMockDb = bitdb.IsMock();
-            if (fMockDb) {
-                DbMpoolFile* mpf = pdb->get_mpf();
-                ret = mpf->set_flags(DB_MPOOL_NOFILE, 1);
-                if (ret != 0)
-                    throw runtime_error(strprintf("CDB: Failed to configure for no temp file backing for database %s", strFile));
-            }
-
-            ret = pdb->open(NULL,                               // Txn pointer
-                            fMockDb ? NULL : strFile.c_str(),   // Filename
-                            fMockDb ? strFile.c_str() : "main", // Logical db name
-                            DB_BTREE,                           // Database type
-                            nFlags,                             // Flags
-                            0);
-
-            if (ret != 0) {
-                delete pdb;
-                pdb = NULL;
+            // Files keep their kind, new ones are logs with -walletlog
+            bool fLog = bitdb.IsLogFile(strFile) ||
+                (fCreate && !bitdb.IsMock() && GetBoolArg("-walletlog", DEFAULT_WALLET_LOG) && !boost::filesystem::exists(GetDataDir() / strFile));
+            pdb = bitdb.OpenStore(strFile, fCreate, fLog);
+            if (pdb == NULL) {
                 --bitdb.mapFileUseCount[strFile];
                 strFile = "";
-                throw runtime_error(strprintf("CDB: Error %d, can't open database %s", ret, strFilename));
+                throw runtime_error(strprintf("CDB: Can't open database %s", strFilename));
             }
 
             if (fCreate && !Exists(string("version"))) {
@@ -298,28 +679,25 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    if (!pdb || activeTxn)
         return;
 
-    // Flush database activity from memory pool to disk log
-    unsigned int nMinutes = 0;
-    if (fReadOnly)
-        nMinutes = 1;
-
-    bitdb.dbenv->txn_checkpoint(nMinutes ? GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
+    pdb->Checkpoint(fReadOnly);
 }
 
 void CDB::Close()
 {
     if (!pdb)
         return;
-    if (activeTxn)
-        activeTxn->abort();
+    if (activeTxn) {
+        activeTxn->Abort();
+        delete activeTxn;
+    }
     activeTxn = NULL;
-    pdb = NULL;
 
     if (fFlushOnClose)
         Flush();
+    pdb = NULL;
 
     {
         LOCK(bitdb.cs_db);
@@ -333,23 +711,45 @@ void CDBEnv::CloseDb(const string& strFile)
         LOCK(cs_db);
         if (mapDb[strFile] != NULL) {
             // Close the database handle
-            Db* pdb = mapDb[strFile];
-            pdb->close(0);
+            CDBStore* pdb = mapDb[strFile];
+            pdb->Close();
             delete pdb;
             mapDb[strFile] = NULL;
         }
     }
 }
 
+void CDBEnv::FlushDb(const string& strFile)
+{
+    LOCK(cs_db);
+    if (mapDb[strFile] != NULL && mapDb[strFile]->Flush())
+        return;
+    CloseDb(strFile);
+    CheckpointLSN(strFile);
+}
+
 bool CDBEnv::RemoveDb(const string& strFile)
 {
     this->CloseDb(strFile);
 
     LOCK(cs_db);
+    if (IsLogFile(strFile)) {
+        boost::system::error_code ec;
+        return boost::filesystem::remove(boost::filesystem::path(strPath) / strFile, ec);
+    }
     int rc = dbenv->dbremove(NULL, strFile.c_str(), NULL, DB_AUTO_COMMIT);
     return (rc == 0);
 }
 
+bool CDBEnv::RenameDb(const string& strFile, const string& strNewFile)
+{
+    LOCK(cs_db);
+    if (IsLogFile(strFile))
+        return RenameOver(boost::filesystem::path(strPath) / strFile, boost::filesystem::path(strPath) / strNewFile);
+    int rc = dbenv->dbrename(NULL, strFile.c_str(), NULL, strNewFile.c_str(), DB_AUTO_COMMIT);
+    return (rc == 0);
+}
+
 bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 {
     while (true) {
@@ -361,35 +761,31 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                 bitdb.CheckpointLSN(strFile);
                 bitdb.mapFileUseCount.erase(strFile);
 
+                // A Berkeley DB file is rewritten into a log with -walletlog
+                bool fLogIn = bitdb.IsLogFile(strFile);
+                bool fLog = fLogIn || (!bitdb.IsMock() && GetBoolArg("-walletlog", DEFAULT_WALLET_LOG));
+
                 bool fSuccess = true;
                 LogPrintf("CDB::Rewrite: Rewriting %s...\n", strFile);
                 string strFileRes = strFile + ".rewrite";
+                bitdb.RemoveDb(strFileRes);
                 { // surround usage of db with extra {}
                     CDB db(strFile.c_str(), "r");
-                    Db* pdbCopy = new Db(bitdb.dbenv, 0);
-
-                    int ret = pdbCopy->open(NULL,               // Txn pointer
-                                            strFileRes.c_str(), // Filename
-                                            "main",             // Logical db name
-                                            DB_BTREE,           // Database type
-                                            DB_CREATE,          // Flags
-                                            0);
-                    if (ret > 0) {
+                    std::unique_ptr<CDBStore> pdbCopy(bitdb.OpenStore(strFileRes, true, fLog));
+                    if (!pdbCopy) {
                         LogPrintf("CDB::Rewrite: Can't create database file %s\n", strFileRes);
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    std::unique_ptr<CDBCursor> pcursor(db.GetCursor());
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-                            int ret1 = db.ReadAtCursor(pcursor, ssKey, ssValue);
+                            int ret1 = db.ReadAtCursor(pcursor.get(), ssKey, ssValue);
                             if (ret1 == DB_NOTFOUND) {
-                                pcursor->close();
                                 break;
                             } else if (ret1 != 0) {
-                                pcursor->close();
                                 fSuccess = false;
                                 break;
                             }
@@ -401,28 +797,32 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                                 ssValue.clear();
                                 ssValue << CLIENT_VERSION;
                             }
-                            Dbt datKey(ssKey.data(), ssKey.size());
-                            Dbt datValue(ssValue.data(), ssValue.size());
-                            int ret2 = pdbCopy->put(NULL, &datKey, &datValue, DB_NOOVERWRITE);
-                            if (ret2 > 0)
+                            if (!pdbCopy->Write(NULL, ssKey, ssValue, false))
                                 fSuccess = false;
                         }
+                    pcursor.reset();
                     if (fSuccess) {
                         db.Close();
                         bitdb.CloseDb(strFile);
-                        if (pdbCopy->close(0))
+                        if (!pdbCopy->Close())
                             fSuccess = false;
-                        delete pdbCopy;
                     }
                 }
-                if (fSuccess) {
+                // A log is replaced by the rename; a Berkeley DB file is
+                // removed first, or kept as a backup when converted to a log
+                if (fSuccess && !fLogIn && fLog) {
+                    string strFileBak = strprintf("%s.%d.bak", strFile, GetTime());
+                    if (bitdb.RenameDb(strFile, strFileBak))
+                        LogPrintf("CDB::Rewrite: Converted %s to a log, the original is kept as %s\n", strFile, strFileBak);
+                    else
+                        fSuccess = false;
+                } else if (fSuccess && !fLogIn) {
                     Db dbA(bitdb.dbenv, 0);
                     if (dbA.remove(strFile.c_str(), NULL, 0))
                         fSuccess = false;
-                    Db dbB(bitdb.dbenv, 0);
-                    if (dbB.rename(strFileRes.c_str(), NULL, strFile.c_str(), 0))
-                        fSuccess = false;
                 }
+                if (fSuccess && !bitdb.RenameDb(strFileRes, strFile))
+                    fSuccess = false;
                 if (!fSuccess)
                     LogPrintf("CDB::Rewrite: Failed to rewrite database file %s\n", strFileRes);
                 return fSuccess;
@@ -450,13 +850,10 @@ void CDBEnv::Flush(bool fShutdown)
             LogPrint("db", "CDBEnv::Flush: Flushing %s (refcount = %d)...\n", strFile, nRefCount);
             if (nRefCount == 0) {
                 // Move log data to the dat file
-                CloseDb(strFile);
-                LogPrint("db", "CDBEnv::Flush: %s checkpoint\n", strFile);
-                dbenv->txn_checkpoint(0, 0, 0);
-                LogPrint("db", "CDBEnv::Flush: %s detach\n", strFile);
-                if (!fMockDb)
-                    dbenv->lsn_reset(strFile.c_str(), 0);
-                LogPrint("db", "CDBEnv::Flush: %s closed\n", strFile);
+                FlushDb(strFile);
+                if (fShutdown)
+                    CloseDb(strFile);
+                LogPrint("db", "CDBEnv::Flush: %s flushed\n", strFile);
                 mapFileUseCount.erase(mi++);
             } else
                 mi++;
@@ -465,6 +862,9 @@ void CDBEnv::Flush(bool fShutdown)
         if (fShutdown) {
             char** listp;
             if (mapFileUseCount.empty()) {
+                // Logs stay open between flushes without being in use
+                for (const std::pair<const string, CDBStore*>& item : mapDb)
+                    CloseDb(item.first);
                 dbenv->log_archive(&listp, DB_ARCH_REMOVE);
                 Close();
                 if (!fMockDb)
@@ -22,6 +22,47 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+static const bool DEFAULT_WALLET_LOG = false;
+
+/** A transaction on a CDBStore, see CDB::TxnBegin */
+class CDBTxn
+{
+public:
+    virtual ~CDBTxn() {}
+    virtual bool Commit() = 0;
+    virtual bool Abort() = 0;
+};
+
+/** A walk over the records of a CDBStore in key order, see CDB::GetCursor */
+class CDBCursor
+{
+public:
+    virtual ~CDBCursor() {}
+    /** Read the next record, or with setRange the first at or after ssKey. Returns 0, or DB_NOTFOUND past the last one */
+    virtual int Read(CDataStream& ssKey, CDataStream& ssValue, bool setRange) = 0;
+};
+
+/**
+ * Storage of one database file, shared by the CDB handles on it: a Berkeley
+ * DB btree, or a CLogDB append-only log for new files with -walletlog.
+ * Keys and values come serialized; ptxn is NULL outside of a transaction.
+ */
+class CDBStore
+{
+public:
+    virtual ~CDBStore() {}
+    virtual bool Read(CDBTxn* ptxn, const CDataStream& ssKey, CDataStream& ssValue) = 0;
+    virtual bool Write(CDBTxn* ptxn, const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite) = 0;
+    virtual bool Erase(CDBTxn* ptxn, const CDataStream& ssKey) = 0;
+    virtual bool Exists(CDBTxn* ptxn, const CDataStream& ssKey) = 0;
+    virtual CDBCursor* GetCursor() = 0;
+    virtual CDBTxn* TxnBegin() = 0;
+    /** Called as a handle closes, with whether it was read-only */
+    virtual void Checkpoint(bool fReadOnly) = 0;
+    /** Commit the file to disk and keep it open; false if it has to be closed for that */
+    virtual bool Flush() = 0;
+    virtual bool Close() = 0;
+};
 
 class CDBEnv
 {
@@ -38,7 +79,7 @@ public:
     mutable CCriticalSection cs_db;
     DbEnv *dbenv;
     std::map<std::string, int> mapFileUseCount;
-    std::map<std::string, Db*> mapDb;
+    std::map<std::string, CDBStore*> mapDb;
 
     CDBEnv();
     ~CDBEnv();
@@ -72,8 +113,15 @@ public:
     void Flush(bool fShutdown);
     void CheckpointLSN(const std::string& strFile);
 
+    /** Whether strFile is a CLogDB log rather than a Berkeley DB file */
+    bool IsLogFile(const std::string& strFile);
+    /** Open strFile as a log or a Berkeley DB file, NULL on failure */
+    CDBStore* OpenStore(const std::string& strFile, bool fCreate, bool fLog);
+    /** Make strFile self-contained on disk; a log stays open, a Berkeley DB file is closed */
+    void FlushDb(const std::string& strFile);
     void CloseDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
+    bool RenameDb(const std::string& strFile, const std::string& strNewFile);
 
     DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC)
     {
@@ -88,13 +136,13 @@ public:
 extern CDBEnv bitdb;
 
 
-/** RAII class that provides access to a Berkeley database */
+/** RAII class that provides access to a database file through its CDBStore */
 class CDB
 {
 protected:
-    Db* pdb;
+    CDBStore* pdb;
     std::string strFile;
-    DbTxn* activeTxn;
+    CDBTxn* activeTxn;
     bool fReadOnly;
     bool fFlushOnClose;
 
@@ -120,28 +168,19 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(ssKey.data(), ssKey.size());
 
         // Read
-        Dbt datValue;
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pdb->get(activeTxn, &datKey, &datValue, 0);
-        memset(datKey.get_data(), 0, datKey.get_size());
-        if (datValue.get_data() == NULL)
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        if (!pdb->Read(activeTxn, ssKey, ssValue))
             return false;
 
         // Unserialize value
         try {
-            CDataStream ssValue((char*)datValue.get_data(), (char*)datValue.get_data() + datValue.get_size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
         }
-
-        // Clear and free memory
-        memset(datValue.get_data(), 0, datValue.get_size());
-        free(datValue.get_data());
-        return (ret == 0);
+        return true;
     }
 
     template <typename K, typename T>
@@ -156,21 +195,14 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(ssKey.data(), ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
-        Dbt datValue(ssValue.data(), ssValue.size());
 
         // Write
-        int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
-
-        // Clear memory in case it was a private key
-        memset(datKey.get_data(), 0, datKey.get_size());
-        memset(datValue.get_data(), 0, datValue.get_size());
-        return (ret == 0);
+        return pdb->Write(activeTxn, ssKey, ssValue, fOverwrite);
     }
 
     template <typename K>
@@ -185,14 +217,9 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(ssKey.data(), ssKey.size());
 
         // Erase
-        int ret = pdb->del(activeTxn, &datKey, 0);
-
-        // Clear memory
-        memset(datKey.get_data(), 0, datKey.get_size());
-        return (ret == 0 || ret == DB_NOTFOUND);
+        return pdb->Erase(activeTxn, ssKey);
     }
 
     template <typename K>
@@ -205,60 +232,21 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(ssKey.data(), ssKey.size());
 
         // Exists
-        int ret = pdb->exists(activeTxn, &datKey, 0);
-
-        // Clear memory
-        memset(datKey.get_data(), 0, datKey.get_size());
-        return (ret == 0);
+        return pdb->Exists(activeTxn, ssKey);
     }
 
-    Dbc* GetCursor()
+    CDBCursor* GetCursor()
     {
         if (!pdb)
             return NULL;
-        Dbc* pcursor = NULL;
-        int ret = pdb->cursor(NULL, &pcursor, 0);
-        if (ret != 0)
-            return NULL;
-        return pcursor;
+        return pdb->GetCursor();
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
+    int ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
     {
-        // Read at cursor
-        Dbt datKey;
-        unsigned int fFlags = DB_NEXT;
-        if (setRange) {
-            datKey.set_data(ssKey.data());
-            datKey.set_size(ssKey.size());
-            fFlags = DB_SET_RANGE;
-        }
-        Dbt datValue;
-        datKey.set_flags(DB_DBT_MALLOC);
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
-        if (ret != 0)
-            return ret;
-        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
-            return 99999;
-
-        // Convert to streams
-        ssKey.SetType(SER_DISK);
-        ssKey.clear();
-        ssKey.write((char*)datKey.get_data(), datKey.get_size());
-        ssValue.SetType(SER_DISK);
-        ssValue.clear();
-        ssValue.write((char*)datValue.get_data(), datValue.get_size());
-
-        // Clear and free memory
-        memset(datKey.get_data(), 0, datKey.get_size());
-        memset(datValue.get_data(), 0, datValue.get_size());
-        free(datKey.get_data());
-        free(datValue.get_data());
-        return 0;
+        return pcursor->Read(ssKey, ssValue, setRange);
     }
 
 public:
@@ -266,29 +254,28 @@ public:
     {
         if (!pdb || activeTxn)
             return false;
-        DbTxn* ptxn = bitdb.TxnBegin();
-        if (!ptxn)
-            return false;
-        activeTxn = ptxn;
-        return true;
+        activeTxn = pdb->TxnBegin();
+        return activeTxn != NULL;
     }
 
     bool TxnCommit()
     {
         if (!pdb || !activeTxn)
             return false;
-        int ret = activeTxn->commit(0);
+        bool ret = activeTxn->Commit();
+        delete activeTxn;
         activeTxn = NULL;
-        return (ret == 0);
+        return ret;
     }
 
     bool TxnAbort()
     {
         if (!pdb || !activeTxn)
             return false;
-        int ret = activeTxn->abort();
+        bool ret = activeTxn->Abort();
+        delete activeTxn;
         activeTxn = NULL;
-        return (ret == 0);
+        return ret;
     }
 
     bool ReadVersion(int& nVersion)
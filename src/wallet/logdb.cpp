@@ -0,0 +1,357 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "serialize.h"
+#include "streams.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+
+namespace {
+
+const unsigned char LOG_MAGIC[8] = {'S', 'L', 'R', 'W', 'L', 'O', 'G', 0x01};
+const unsigned char RECORD_WRITE = 1;
+const unsigned char RECORD_ERASE = 2;
+//! Size and checksum around the records of a frame
+const unsigned int FRAME_OVERHEAD = 8;
+
+} // namespace
+
+static uint32_t FrameChecksum(const char* pbegin, size_t nSize)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)pbegin, nSize).Finalize(hash);
+    return ReadLE32(hash);
+}
+
+static uint64_t RecordSize(const CLogDB::Data& key, const CLogDB::Data& value)
+{
+    return 1 + GetSizeOfCompactSize(key.size()) + key.size() + GetSizeOfCompactSize(value.size()) + value.size();
+}
+
+static void SerializeRecord(CDataStream& ss, bool fErase, const CLogDB::Data& key, const CLogDB::Data& value)
+{
+    ss << (fErase ? RECORD_ERASE : RECORD_WRITE);
+    WriteCompactSize(ss, key.size());
+    ss.write(key.data(), key.size());
+    if (!fErase) {
+        WriteCompactSize(ss, value.size());
+        ss.write(value.data(), value.size());
+    }
+}
+
+static void UnserializeRecord(CSpanReader& ss, CLogDB::Record& record)
+{
+    unsigned char nType;
+    ss >> nType;
+    if (nType != RECORD_WRITE && nType != RECORD_ERASE)
+        throw std::ios_base::failure("unknown record type");
+    record.fErase = (nType == RECORD_ERASE);
+    record.key.resize(ReadCompactSize(ss));
+    ss.read(record.key.data(), record.key.size());
+    if (!record.fErase) {
+        record.value.resize(ReadCompactSize(ss));
+        ss.read(record.value.data(), record.value.size());
+    }
+}
+
+static bool WriteFrame(FILE* file, const CDataStream& ssRecords)
+{
+    CDataStream ssFrame(SER_DISK, 0);
+    ssFrame.reserve(ssRecords.size() + FRAME_OVERHEAD);
+    ssFrame << (uint32_t)ssRecords.size();
+    ssFrame.write(ssRecords.data(), ssRecords.size());
+    ssFrame << FrameChecksum(ssFrame.data(), ssFrame.size());
+    return fwrite(ssFrame.data(), 1, ssFrame.size(), file) == ssFrame.size() && fflush(file) == 0;
+}
+
+bool CLogDB::DataLess::operator()(const Data& a, const Data& b) const
+{
+    size_t nSize = std::min(a.size(), b.size());
+    int c = nSize ? memcmp(a.data(), b.data(), nSize) : 0;
+    return c < 0 || (c == 0 && a.size() < b.size());
+}
+
+CLogDB::CLogDB(const boost::filesystem::path& pathIn) : path(pathIn), file(NULL), nFileSize(0), nLiveSize(0)
+{
+}
+
+CLogDB::~CLogDB()
+{
+    Close();
+}
+
+bool CLogDB::IsLogFile(const boost::filesystem::path& path)
+{
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file)
+        return false;
+    unsigned char magic[sizeof(LOG_MAGIC)];
+    bool fLog = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return fLog;
+}
+
+CLogDB::OpenResult CLogDB::Open(bool fCreate, bool fReadOnly)
+{
+    LOCK(cs);
+    assert(!file);
+    mapData.clear();
+    nFileSize = 0;
+    nLiveSize = 0;
+
+    file = fopen(path.string().c_str(), fReadOnly ? "rb" : "rb+");
+    if (!file && fCreate && !fReadOnly) {
+        file = fopen(path.string().c_str(), "wb+");
+        if (file && fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), file) == sizeof(LOG_MAGIC) && fflush(file) == 0) {
+            FileCommit(file);
+            nFileSize = sizeof(LOG_MAGIC);
+            return OPEN_OK;
+        }
+        Close();
+    }
+    if (!file) {
+        LogPrintf("CLogDB::Open: Cannot open %s\n", path.string());
+        return OPEN_FAIL;
+    }
+
+    // Read the whole file at once, and apply its frames from memory
+    Data vchFile;
+    long nSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        nSize = ftell(file);
+    if (nSize >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        vchFile.resize(nSize);
+        if (fread(vchFile.data(), 1, vchFile.size(), file) != vchFile.size())
+            nSize = -1;
+    }
+    if (nSize < (long)sizeof(LOG_MAGIC) || memcmp(vchFile.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+        LogPrintf("CLogDB::Open: %s is not a log file\n", path.string());
+        Close();
+        return OPEN_FAIL;
+    }
+
+    OpenResult result = OPEN_OK;
+    size_t nPos = sizeof(LOG_MAGIC);
+    std::vector<Record> vRecords;
+    while (vchFile.size() - nPos >= FRAME_OVERHEAD) {
+        const char* pframe = vchFile.data() + nPos;
+        uint32_t nRecordsSize = ReadLE32((const unsigned char*)pframe);
+        if (vchFile.size() - nPos - FRAME_OVERHEAD < nRecordsSize)
+            break;
+        if (FrameChecksum(pframe, 4 + nRecordsSize) != ReadLE32((const unsigned char*)pframe + 4 + nRecordsSize)) {
+            result = OPEN_DAMAGED;
+            break;
+        }
+        vRecords.clear();
+        try {
+            CSpanReader ss(SER_DISK, 0, pframe + 4, nRecordsSize);
+            while (!ss.empty()) {
+                vRecords.push_back(Record());
+                UnserializeRecord(ss, vRecords.back());
+            }
+        } catch (const std::exception&) {
+            result = OPEN_DAMAGED;
+            break;
+        }
+        for (const Record& record : vRecords)
+            Apply(record);
+        nPos += FRAME_OVERHEAD + nRecordsSize;
+    }
+    nFileSize = nPos;
+
+    if (result == OPEN_DAMAGED)
+        LogPrintf("CLogDB::Open: Damaged frame at offset %u of %s, %u bytes after it are not read\n", nPos, path.string(), vchFile.size() - nPos);
+    else if (nPos < vchFile.size() && !fReadOnly) {
+        LogPrintf("CLogDB::Open: Cutting a torn write of %u bytes off %s\n", vchFile.size() - nPos, path.string());
+        if (!TruncateFile(file, nPos)) {
+            Close();
+            return OPEN_FAIL;
+        }
+    }
+    if (fReadOnly || result != OPEN_OK) {
+        fclose(file);
+        file = NULL;
+    }
+    LogPrint("db", "CLogDB::Open: Read %u records of %s, %u of %u bytes live\n", mapData.size(), path.string(), nLiveSize, nFileSize);
+    return result;
+}
+
+void CLogDB::Close()
+{
+    LOCK(cs);
+    if (file) {
+        if (fflush(file) == 0)
+            FileCommit(file);
+        fclose(file);
+        file = NULL;
+    }
+}
+
+void CLogDB::Apply(const Record& record)
+{
+    DataMap::iterator it = mapData.find(record.key);
+    if (it != mapData.end()) {
+        nLiveSize -= RecordSize(it->first, it->second);
+        if (record.fErase) {
+            mapData.erase(it);
+            return;
+        }
+        it->second = record.value;
+    } else {
+        if (record.fErase)
+            return;
+        it = mapData.insert(std::make_pair(record.key, record.value)).first;
+    }
+    nLiveSize += RecordSize(it->first, it->second);
+}
+
+bool CLogDB::Read(const Data& key, Data& value) const
+{
+    LOCK(cs);
+    DataMap::const_iterator it = mapData.find(key);
+    if (it == mapData.end())
+        return false;
+    value = it->second;
+    return true;
+}
+
+bool CLogDB::Exists(const Data& key) const
+{
+    LOCK(cs);
+    return mapData.count(key) > 0;
+}
+
+bool CLogDB::Write(const std::vector<Record>& vRecords)
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+
+    CDataStream ssRecords(SER_DISK, 0);
+    for (const Record& record : vRecords)
+        SerializeRecord(ssRecords, record.fErase, record.key, record.value);
+    if (fseek(file, (long)nFileSize, SEEK_SET) != 0 || !WriteFrame(file, ssRecords)) {
+        // Leave no partial frame for the next one to follow
+        TruncateFile(file, (unsigned int)nFileSize);
+        return error("CLogDB::Write: Failed to write to %s", path.string());
+    }
+    nFileSize += FRAME_OVERHEAD + ssRecords.size();
+
+    for (const Record& record : vRecords)
+        Apply(record);
+    return true;
+}
+
+bool CLogDB::Next(const Data& key, bool fInclusive, Data& keyOut, Data& valueOut) const
+{
+    LOCK(cs);
+    DataMap::const_iterator it = fInclusive ? mapData.lower_bound(key) : mapData.upper_bound(key);
+    if (it == mapData.end())
+        return false;
+    keyOut = it->first;
+    valueOut = it->second;
+    return true;
+}
+
+bool CLogDB::Commit()
+{
+    LOCK(cs);
+    return CommitLocked();
+}
+
+bool CLogDB::CommitLocked()
+{
+    if (!file || fflush(file) != 0)
+        return false;
+    FileCommit(file);
+    return true;
+}
+
+bool CLogDB::Flush()
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+    if (nFileSize >= LOG_COMPACT_MIN_SIZE && nFileSize >= nLiveSize * LOG_COMPACT_RATIO)
+        CompactLocked();
+    return CommitLocked();
+}
+
+bool CLogDB::Compact()
+{
+    LOCK(cs);
+    return CompactLocked();
+}
+
+bool CLogDB::CompactLocked()
+{
+    if (!file)
+        return false;
+    int64_t nStart = GetTimeMillis();
+
+    // Write the live records to a new file and move it over the old one
+    boost::filesystem::path pathCompact = path.string() + ".compact";
+    FILE* fileCompact = fopen(pathCompact.string().c_str(), "wb");
+    if (!fileCompact)
+        return error("CLogDB::Compact: Cannot create %s", pathCompact.string());
+    bool fSuccess = fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), fileCompact) == sizeof(LOG_MAGIC);
+    uint64_t nCompactSize = sizeof(LOG_MAGIC);
+    CDataStream ssRecords(SER_DISK, 0);
+    DataMap::const_iterator it = mapData.begin();
+    while (fSuccess && it != mapData.end()) {
+        SerializeRecord(ssRecords, false, it->first, it->second);
+        ++it;
+        if (ssRecords.size() >= LOG_COMPACT_FRAME_SIZE || it == mapData.end()) {
+            fSuccess = WriteFrame(fileCompact, ssRecords);
+            nCompactSize += FRAME_OVERHEAD + ssRecords.size();
+            ssRecords.clear();
+        }
+    }
+    if (fSuccess)
+        FileCommit(fileCompact);
+    fclose(fileCompact);
+
+    if (fSuccess) {
+        fclose(file);
+        file = NULL;
+        fSuccess = RenameOver(pathCompact, path);
+        file = fopen(path.string().c_str(), "rb+");
+        if (!file)
+            return error("CLogDB::Compact: Cannot reopen %s", path.string());
+    }
+    if (!fSuccess) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(pathCompact, ec);
+        return error("CLogDB::Compact: Failed to compact %s", path.string());
+    }
+    LogPrint("db", "CLogDB::Compact: Compacted %s from %u to %u bytes in %dms\n", path.string(), nFileSize, nCompactSize, GetTimeMillis() - nStart);
+    nFileSize = nCompactSize;
+    return true;
+}
+
+size_t CLogDB::GetCount() const
+{
+    LOCK(cs);
+    return mapData.size();
+}
+
+uint64_t CLogDB::GetFileSize() const
+{
+    LOCK(cs);
+    return nFileSize;
+}
+
+uint64_t CLogDB::GetLiveSize() const
+{
+    LOCK(cs);
+    return nLiveSize;
+}
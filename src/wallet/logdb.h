@@ -0,0 +1,116 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_LOGDB_H
+#define BITCOIN_WALLET_LOGDB_H
+
+#include "support/allocators/zeroafterfree.h"
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+//! Log files smaller than this are not compacted
+static const uint64_t LOG_COMPACT_MIN_SIZE = 1 << 20;
+//! Log files are compacted once they are this many times the size of their live records
+static const unsigned int LOG_COMPACT_RATIO = 2;
+//! Most bytes of records written in one frame by a compaction
+static const unsigned int LOG_COMPACT_FRAME_SIZE = 1 << 20;
+
+/**
+ * Key/value database held in memory and kept on disk as an append-only log.
+ *
+ * The file starts with a magic and is followed by frames: the size of the
+ * records in the frame, the records, and the first four bytes of the SHA256
+ * of both. Each write appends one frame, which is the unit of atomicity: a
+ * frame torn by a crash is cut off the next time the file is opened. Records
+ * that are erased or overwritten stay in the file until it is compacted into
+ * a copy holding only the live records, which Flush does once the file has
+ * grown LOG_COMPACT_RATIO times their size.
+ *
+ * Opening reads the whole file with a single read and builds the map from
+ * it, so lookups and walks over the records never touch the disk.
+ */
+class CLogDB
+{
+public:
+    typedef CSerializeData Data;
+
+    /** Keys in byte order, as Berkeley DB sorts them */
+    struct DataLess
+    {
+        bool operator()(const Data& a, const Data& b) const;
+    };
+
+    /** One record of a frame: key is written with value, or erased if fErase */
+    struct Record
+    {
+        bool fErase;
+        Data key;
+        Data value;
+
+        Record() : fErase(false) {}
+    };
+
+    enum OpenResult {
+        OPEN_OK,
+        OPEN_DAMAGED, //!< a frame failed its checksum, the records before it were read
+        OPEN_FAIL,
+    };
+
+    explicit CLogDB(const boost::filesystem::path& pathIn);
+    ~CLogDB();
+
+    /** Whether the file at path starts with the magic of a log */
+    static bool IsLogFile(const boost::filesystem::path& path);
+
+    /**
+     * Read the records of the file, which is created if fCreate and missing.
+     * Unless fReadOnly, a torn frame at the end is cut off the file and it is
+     * kept open for writing. Nothing after a damaged frame is read.
+     */
+    OpenResult Open(bool fCreate, bool fReadOnly = false);
+    void Close();
+
+    bool Read(const Data& key, Data& value) const;
+    bool Exists(const Data& key) const;
+    /** Append vRecords to the file as one frame, then apply them */
+    bool Write(const std::vector<Record>& vRecords);
+    /** Find the first record after key, or at key if fInclusive */
+    bool Next(const Data& key, bool fInclusive, Data& keyOut, Data& valueOut) const;
+
+    /** Commit the file to disk */
+    bool Commit();
+    /** Compact the file if it has grown too large, and commit it to disk */
+    bool Flush();
+    /** Rewrite the file with only the live records */
+    bool Compact();
+
+    size_t GetCount() const;
+    uint64_t GetFileSize() const;
+    uint64_t GetLiveSize() const;
+
+private:
+    typedef std::map<Data, Data, DataLess> DataMap;
+
+    mutable CCriticalSection cs;
+    boost::filesystem::path path;
+    FILE* file;
+    DataMap mapData;
+    uint64_t nFileSize;
+    uint64_t nLiveSize;
+
+    void Apply(const Record& record);
+    bool CommitLocked();
+    bool CompactLocked();
+
+    CLogDB(const CLogDB&);
+    void operator=(const CLogDB&);
+};
+
+#endif // BITCOIN_WALLET_LOGDB_H
@@ -20,6 +20,8 @@
 #include "utilmoneystr.h"
 #include "wallet.h"
 #include "walletdb.h"
+#include "wallet/stakeplan.h"
+#include "wallet/staker.h"
 
 #include <stdint.h>
 
@@ -2360,6 +2362,154 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getstakinginfo(const JSONRPCRequest& request)
+{
+    if (!EnsureWalletIsAvailable(request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getstakinginfo\n"
+            "Returns an object containing staking-related information.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,       (boolean) whether -staking is set\n"
+            "  \"staking\": true|false,       (boolean) whether the wallet is searching for kernels\n"
+            "  \"threads\": n,                (numeric) number of kernel search threads\n"
+            "  \"candidates\": n,             (numeric) number of outputs that can stake at the current tip\n"
+            "  \"candidatevalue\": x.xxx,     (numeric) value of those outputs in " + CURRENCY_UNIT + "\n"
+            "  \"kernelstried\": n,           (numeric) kernels hashed since startup\n"
+            "  \"kernelspersecond\": x.xxx,   (numeric) kernel hash rate of the last search\n"
+            "  \"lastsearchtime\": ttt,       (numeric) latest transaction time searched\n"
+            "  \"lastsearchinterval\": n,     (numeric) seconds covered by the last search\n"
+            "  \"blocksstaked\": n            (numeric) blocks staked since startup\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakinginfo", "")
+            + HelpExampleRpc("getstakinginfo", "")
+        );
+
+    CStakerStats stats = GetStakerStats();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("enabled",            GetBoolArg("-staking", DEFAULT_STAKING)));
+    obj.push_back(Pair("staking",            stats.fStaking));
+    obj.push_back(Pair("threads",            stats.nThreads));
+    obj.push_back(Pair("candidates",         stats.nCandidates));
+    obj.push_back(Pair("candidatevalue",     ValueFromAmount(stats.nCandidateValue)));
+    obj.push_back(Pair("kernelstried",       stats.nKernelsTried));
+    obj.push_back(Pair("kernelspersecond",   stats.dKernelsPerSecond));
+    obj.push_back(Pair("lastsearchtime",     stats.nLastSearchTime));
+    obj.push_back(Pair("lastsearchinterval", stats.nLastSearchInterval));
+    obj.push_back(Pair("blocksstaked",       stats.nBlocksStaked));
+    return obj;
+}
+
+UniValue getstakeplan(const JSONRPCRequest& request)
+{
+    if (!EnsureWalletIsAvailable(request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() > 1)
+        throw runtime_error(
+            "getstakeplan ( execute )\n"
+            "Simulates the expected stake yield of wallet outputs of different sizes at the current tip,\n"
+            "and plans the transactions that split or combine the outputs into the band of sizes that stake best.\n"
+            "\nArguments:\n"
+            "1. execute          (boolean, optional, default=false) Also send the transactions of the plan\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"averagestakeweight\": x.xxx, (numeric) average stake weight the yield is simulated with\n"
+            "  \"interestrate\": x.xxx,       (numeric) yearly interest rate in percent\n"
+            "  \"bestvalue\": x.xxx,          (numeric) output size with the highest yield per coin\n"
+            "  \"bestyield\": x.xxx,          (numeric) its expected yearly reward as a fraction of its value\n"
+            "  \"bestdays\": x.xxx,           (numeric) expected age in days at which it stakes\n"
+            "  \"minvalue\": x.xxx,           (numeric) smallest size of the band\n"
+            "  \"maxvalue\": x.xxx,           (numeric) largest size of the band\n"
+            "  \"outputs\": n,                (numeric) number of outputs that can stake\n"
+            "  \"inband\": n,                 (numeric) number of them inside the band\n"
+            "  \"value\": x.xxx,              (numeric) their total value\n"
+            "  \"yield\": x.xxx,              (numeric) their expected yearly reward\n"
+            "  \"actions\": [                 (array) transactions of the plan\n"
+            "    {\n"
+            "      \"type\": \"split|combine\",\n"
+            "      \"inputs\": [ { \"txid\": \"id\", \"vout\": n }, ... ],\n"
+            "      \"value\": x.xxx,          (numeric) value of the inputs\n"
+            "      \"outputs\": [ x.xxx, ... ], (array) values of the outputs before the fee\n"
+            "      \"yieldbefore\": x.xxx,    (numeric) expected yearly reward of the inputs\n"
+            "      \"yieldafter\": x.xxx      (numeric) and of the outputs\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"txids\": [ \"id\", ... ]      (array) transactions sent, with execute\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakeplan", "")
+            + HelpExampleCli("getstakeplan", "true")
+            + HelpExampleRpc("getstakeplan", "")
+        );
+
+    bool fExecute = request.params.size() > 0 && request.params[0].get_bool();
+
+    CStakePlan plan;
+    std::string strError;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        if (fExecute)
+            EnsureWalletIsUnlocked();
+        if (!CreateStakePlan(pwalletMain, plan, strError))
+            throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("averagestakeweight", plan.conditions.dAverageStakeWeight));
+    obj.push_back(Pair("interestrate",       plan.conditions.dInterestRate));
+    obj.push_back(Pair("bestvalue",          ValueFromAmount(plan.best.nValue)));
+    obj.push_back(Pair("bestyield",          plan.best.dAnnualYield));
+    obj.push_back(Pair("bestdays",           plan.best.dExpectedDays));
+    obj.push_back(Pair("minvalue",           ValueFromAmount(plan.nMinValue)));
+    obj.push_back(Pair("maxvalue",           ValueFromAmount(plan.nMaxValue)));
+    obj.push_back(Pair("outputs",            plan.nOutputs));
+    obj.push_back(Pair("inband",             plan.nInBand));
+    obj.push_back(Pair("value",              ValueFromAmount(plan.nValue)));
+    obj.push_back(Pair("yield",              plan.dYield));
+    UniValue actions(UniValue::VARR);
+    for (const CStakePlanAction& action : plan.vActions) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("type", action.fSplit ? "split" : "combine"));
+        UniValue inputs(UniValue::VARR);
+        for (const COutPoint& prevout : action.vInputs) {
+            UniValue input(UniValue::VOBJ);
+            input.push_back(Pair("txid", prevout.hash.GetHex()));
+            input.push_back(Pair("vout", (int)prevout.n));
+            inputs.push_back(input);
+        }
+        entry.push_back(Pair("inputs", inputs));
+        entry.push_back(Pair("value", ValueFromAmount(action.nValueIn)));
+        UniValue outputs(UniValue::VARR);
+        for (CAmount nValue : action.vValues)
+            outputs.push_back(ValueFromAmount(nValue));
+        entry.push_back(Pair("outputs", outputs));
+        entry.push_back(Pair("yieldbefore", action.dYieldBefore));
+        entry.push_back(Pair("yieldafter", action.dYieldAfter));
+        actions.push_back(entry);
+    }
+    obj.push_back(Pair("actions", actions));
+
+    if (fExecute) {
+        std::vector<uint256> vTxids;
+        bool fOk = ExecuteStakePlan(pwalletMain, plan, vTxids, strError);
+        if (!fOk && vTxids.empty())
+            throw JSONRPCError(RPC_WALLET_ERROR, strError);
+        UniValue txids(UniValue::VARR);
+        for (const uint256& txid : vTxids)
+            txids.push_back(txid.GetHex());
+        obj.push_back(Pair("txids", txids));
+        if (!fOk)
+            obj.push_back(Pair("error", strError));
+    }
+    return obj;
+}
+
 UniValue resendwallettransactions(const JSONRPCRequest& request)
 {
     if (!EnsureWalletIsAvailable(request.fHelp))
@@ -3015,6 +3165,8 @@ static const CRPCCommand commands[] =
     { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,   {} },
     { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,  {"account","minconf"} },
     { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,  {"address","minconf"} },
+    { "wallet",             "getstakeplan",             &getstakeplan,             false,  {"execute"} },
+    { "wallet",             "getstakinginfo",           &getstakinginfo,           true,   {} },
     { "wallet",             "gettransaction",           &gettransaction,           false,  {"txid","include_watchonly"} },
     { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false,  {} },
     { "wallet",             "getwalletinfo",            &getwalletinfo,            false,  {} },
@@ -0,0 +1,279 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakeplan.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "kernel.h"
+#include "net.h"
+#include "pow.h"
+#include "pubkey.h"
+#include "script/standard.h"
+#include "util.h"
+#include "utilmoneystr.h"
+#include "validation.h"
+#include "wallet/coincontrol.h"
+#include "wallet/wallet.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace {
+
+//! Age step of the simulation
+static const int64_t STAKE_SIM_STEP = 60 * 60;
+//! Outputs that have not staked at this age are counted as staking at it
+static const int64_t STAKE_SIM_HORIZON = 365 * 24 * 60 * 60;
+//! Age after which GetStakeTime stops counting
+static const int64_t STAKE_TIME_MAX = 30 * 24 * 60 * 60;
+//! Output sizes simulated per doubling of the size
+static const int STAKE_PLAN_SIZES_PER_DOUBLING = 4;
+
+} // anon namespace
+
+// Yield per coin of a size between two simulated sizes
+static double InterpolateYield(const std::vector<CStakeYield>& vYields, CAmount nValue)
+{
+    std::vector<CStakeYield>::const_iterator it = std::lower_bound(vYields.begin(), vYields.end(), nValue,
+        [](const CStakeYield& yield, CAmount n) { return yield.nValue < n; });
+    if (it == vYields.begin())
+        return it->dAnnualYield;
+    if (it == vYields.end())
+        return vYields.back().dAnnualYield;
+    const CStakeYield& lower = *(it - 1);
+    double dPart = (double)(nValue - lower.nValue) / (it->nValue - lower.nValue);
+    return lower.dAnnualYield + dPart * (it->dAnnualYield - lower.dAnnualYield);
+}
+
+// Expected yearly reward of an output in coins
+static double GetOutputYield(const std::vector<CStakeYield>& vYields, CAmount nValue)
+{
+    return InterpolateYield(vYields, nValue) * nValue / COIN;
+}
+
+// Stake time of one input of nValue at nAge, as GetStakeTime computes it. The
+// coin-days are computed in floating point, so that large outputs do not
+// overflow.
+static int64_t GetInputStakeTime(CAmount nValue, int64_t nAge, double dAverageStakeWeight, const Consensus::Params& params)
+{
+    int64_t timeWeight = nAge > STAKE_TIME_MAX ? STAKE_TIME_MAX : nAge;
+    int64_t nCoinDay = (double)nValue / COIN * timeWeight / (24 * 60 * 60);
+    int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, nCoinDay, dAverageStakeWeight, params);
+    return (double)nValue / COIN * factoredTimeWeight / (24 * 60 * 60);
+}
+
+CStakeYield SimulateStakeYield(CAmount nValue, const CStakeConditions& conditions, const Consensus::Params& params)
+{
+    arith_uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(conditions.nBits);
+    const double dTargetPerCoinDay = bnTargetPerCoinDay.getdouble() / pow(2.0, 256);
+    const double dCoins = (double)nValue / COIN;
+
+    // Walk the age of the output, keeping the chance that it has not staked yet
+    double dUnstaked = 1, dAge = 0, dReward = 0;
+    for (int64_t nAge = params.nStakeMinAge; nAge < STAKE_SIM_HORIZON && dUnstaked > 1e-9; nAge += STAKE_SIM_STEP) {
+        const int64_t nMidAge = nAge + STAKE_SIM_STEP / 2;
+
+        // Chance of a kernel for one second of this step, see GetStakeKernelTarget
+        int64_t timeWeight = nMidAge - params.nStakeMinAge;
+        int64_t nCoinDayWeight = dCoins * timeWeight / (24 * 60 * 60);
+        int64_t factoredTimeWeight = GetStakeTimeFactoredWeight(timeWeight, nCoinDayWeight, conditions.dAverageStakeWeight, params);
+        double dChance = dTargetPerCoinDay * dCoins * factoredTimeWeight / (24 * 60 * 60);
+
+        double dStaked = dUnstaked * (dChance >= 1 ? 1 : -expm1(STAKE_SIM_STEP * log1p(-dChance)));
+        dAge += dStaked * nMidAge;
+        dReward += dStaked * GetProofOfStakeTimeSubsidy(GetInputStakeTime(nValue, nMidAge, conditions.dAverageStakeWeight, params), conditions.dInterestRate);
+        dUnstaked -= dStaked;
+    }
+    dAge += dUnstaked * STAKE_SIM_HORIZON;
+    dReward += dUnstaked * GetProofOfStakeTimeSubsidy(GetInputStakeTime(nValue, STAKE_SIM_HORIZON, conditions.dAverageStakeWeight, params), conditions.dInterestRate);
+
+    CStakeYield yield;
+    yield.nValue = nValue;
+    yield.dExpectedDays = dAge / (24 * 60 * 60);
+    yield.nExpectedReward = dReward;
+    yield.dAnnualYield = (nValue > 0 && dAge > 0) ? dReward / nValue * (365 * 24 * 60 * 60) / dAge : 0;
+    return yield;
+}
+
+bool CreateStakePlan(CWallet* pwallet, CStakePlan& plan, std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pwallet->cs_wallet);
+
+    const Consensus::Params& params = Params().GetConsensus();
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    if (!pindexPrev || !pindexPrev->pprev) {
+        strError = "No proof-of-stake conditions before the first block";
+        return false;
+    }
+
+    // The conditions a kernel is searched under by the staker
+    plan = CStakePlan();
+    plan.conditions.nBits = GetNextTargetRequired(pindexPrev, true, params);
+    plan.conditions.dAverageStakeWeight = GetAverageStakeWeight(pindexPrev->pprev, params);
+    plan.conditions.dInterestRate = GetCurrentInterestRate(pindexPrev, params);
+
+    // Outputs that can stake, as the staker selects them
+    std::vector<COutput> vCoins;
+    std::vector<std::pair<CAmount, COutPoint> > vOutputs;
+    pwallet->AvailableCoins(vCoins, true);
+    for (const COutput& out : vCoins) {
+        if (out.nDepth < 1 || !out.fSpendable)
+            continue;
+        if ((out.tx->IsCoinBase() || out.tx->IsCoinStake()) && out.tx->GetBlocksToMaturity() > 0)
+            continue;
+        const CTxOut& txout = out.tx->tx->vout[out.i];
+        txnouttype whichType;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        if (!Solver(txout.scriptPubKey, whichType, vSolutions) || (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH))
+            continue;
+        vOutputs.push_back(std::make_pair(txout.nValue, COutPoint(out.tx->GetHash(), out.i)));
+        plan.nValue += txout.nValue;
+    }
+    plan.nOutputs = vOutputs.size();
+
+    // Yield of the sizes from one coin to everything in one output
+    std::vector<CStakeYield> vYields;
+    const CAmount nMaxSize = std::max(plan.nValue, COIN);
+    for (int i = 0; ; i++) {
+        CAmount nSize = COIN * pow(2.0, (double)i / STAKE_PLAN_SIZES_PER_DOUBLING);
+        if (nSize > nMaxSize)
+            nSize = nMaxSize;
+        if (!vYields.empty() && nSize <= vYields.back().nValue)
+            break;
+        vYields.push_back(SimulateStakeYield(nSize, plan.conditions, params));
+    }
+
+    size_t nBest = 0;
+    for (size_t i = 1; i < vYields.size(); i++)
+        if (vYields[i].dAnnualYield > vYields[nBest].dAnnualYield)
+            nBest = i;
+    plan.best = vYields[nBest];
+    if (plan.best.dAnnualYield <= 0) {
+        plan.nMinValue = 0;
+        plan.nMaxValue = MAX_MONEY;
+        plan.nInBand = plan.nOutputs;
+        return true;
+    }
+    size_t nLow = nBest, nHigh = nBest;
+    while (nLow > 0 && vYields[nLow - 1].dAnnualYield >= STAKE_PLAN_BAND * plan.best.dAnnualYield)
+        nLow--;
+    while (nHigh + 1 < vYields.size() && vYields[nHigh + 1].dAnnualYield >= STAKE_PLAN_BAND * plan.best.dAnnualYield)
+        nHigh++;
+    plan.nMinValue = nLow > 0 ? vYields[nLow].nValue : 0;
+    plan.nMaxValue = nHigh + 1 < vYields.size() ? vYields[nHigh].nValue : MAX_MONEY;
+
+    // Split the outputs above the band into parts of about the best size,
+    // and collect those below it
+    std::vector<std::pair<CAmount, COutPoint> > vSmall;
+    for (const std::pair<CAmount, COutPoint>& output : vOutputs) {
+        plan.dYield += GetOutputYield(vYields, output.first);
+        if (output.first < plan.nMinValue) {
+            vSmall.push_back(output);
+            continue;
+        }
+        if (output.first <= plan.nMaxValue) {
+            plan.nInBand++;
+            continue;
+        }
+
+        int64_t nParts = std::max((output.first + plan.best.nValue / 2) / plan.best.nValue, (output.first + plan.nMaxValue - 1) / plan.nMaxValue);
+        if (nParts > (int64_t)STAKE_PLAN_MAX_OUTPUTS)
+            nParts = STAKE_PLAN_MAX_OUTPUTS;
+        CStakePlanAction action;
+        action.fSplit = true;
+        action.vInputs.push_back(output.second);
+        action.nValueIn = output.first;
+        action.dYieldBefore = GetOutputYield(vYields, output.first);
+        action.dYieldAfter = 0;
+        for (int64_t i = 0; i < nParts; i++) {
+            CAmount nPart = output.first / nParts + (i == 0 ? output.first % nParts : 0);
+            action.vValues.push_back(nPart);
+            action.dYieldAfter += GetOutputYield(vYields, nPart);
+        }
+        plan.vActions.push_back(action);
+    }
+
+    // Combine the small outputs, largest first, into outputs of about the
+    // best size that stay inside the band
+    std::sort(vSmall.begin(), vSmall.end(), [](const std::pair<CAmount, COutPoint>& a, const std::pair<CAmount, COutPoint>& b) {
+        return a.first > b.first;
+    });
+    std::vector<bool> vUsed(vSmall.size(), false);
+    for (size_t nFirst = 0; nFirst < vSmall.size(); nFirst++) {
+        if (vUsed[nFirst])
+            continue;
+        CStakePlanAction action;
+        action.fSplit = false;
+        action.nValueIn = 0;
+        action.dYieldBefore = 0;
+        std::vector<size_t> vGroup;
+        for (size_t i = nFirst; i < vSmall.size() && action.nValueIn < plan.best.nValue && vGroup.size() < STAKE_PLAN_MAX_INPUTS; i++) {
+            if (vUsed[i] || action.nValueIn + vSmall[i].first > plan.nMaxValue)
+                continue;
+            vGroup.push_back(i);
+            action.nValueIn += vSmall[i].first;
+        }
+        // Everything left is smaller, so no later group reaches the band either
+        if (action.nValueIn < plan.nMinValue)
+            break;
+        for (size_t i : vGroup) {
+            vUsed[i] = true;
+            action.vInputs.push_back(vSmall[i].second);
+            action.dYieldBefore += GetOutputYield(vYields, vSmall[i].first);
+        }
+        action.vValues.push_back(action.nValueIn);
+        action.dYieldAfter = GetOutputYield(vYields, action.nValueIn);
+        plan.vActions.push_back(action);
+    }
+
+    return true;
+}
+
+bool ExecuteStakePlan(CWallet* pwallet, const CStakePlan& plan, std::vector<uint256>& vTxids, std::string& strError)
+{
+    for (const CStakePlanAction& action : plan.vActions) {
+        // The outputs go back to the script of the first input, and pay the fee
+        CScript scriptPubKey;
+        {
+            LOCK(pwallet->cs_wallet);
+            const CWalletTx* wtx = pwallet->GetWalletTx(action.vInputs[0].hash);
+            if (!wtx) {
+                strError = strprintf("Output %s is not in the wallet", action.vInputs[0].ToString());
+                return false;
+            }
+            scriptPubKey = wtx->tx->vout[action.vInputs[0].n].scriptPubKey;
+        }
+
+        CCoinControl coinControl;
+        for (const COutPoint& prevout : action.vInputs)
+            coinControl.Select(prevout);
+        std::vector<CRecipient> vecSend;
+        for (CAmount nValue : action.vValues) {
+            CRecipient recipient = {scriptPubKey, nValue, true};
+            vecSend.push_back(recipient);
+        }
+
+        CWalletTx wtx;
+        CReserveKey reservekey(pwallet);
+        CAmount nFeeRequired;
+        int nChangePosRet = -1;
+        std::string strFailReason;
+        if (!pwallet->CreateTransaction(vecSend, wtx, reservekey, nFeeRequired, nChangePosRet, strFailReason, &coinControl)) {
+            strError = strprintf("Unable to %s %s: %s", action.fSplit ? "split" : "combine", FormatMoney(action.nValueIn), strFailReason);
+            return false;
+        }
+        CValidationState state;
+        if (!pwallet->CommitTransaction(wtx, reservekey, g_connman.get(), state)) {
+            strError = strprintf("Unable to commit transaction: %s", state.GetRejectReason());
+            return false;
+        }
+        vTxids.push_back(wtx.GetHash());
+    }
+    return true;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_STAKEPLAN_H
+#define BITCOIN_WALLET_STAKEPLAN_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CWallet;
+
+namespace Consensus {
+struct Params;
+} // namespace Consensus
+
+//! Default for -stakeplan
+static const bool DEFAULT_STAKE_PLAN = false;
+//! Seconds between automatic runs of the stake plan
+static const int64_t STAKE_PLAN_INTERVAL = 60 * 60;
+//! Most inputs combined into one output by one transaction
+static const unsigned int STAKE_PLAN_MAX_INPUTS = 50;
+//! Most outputs one output is split into by one transaction
+static const unsigned int STAKE_PLAN_MAX_OUTPUTS = 50;
+//! Output sizes whose yield per coin is at least this part of the best are left alone
+static const double STAKE_PLAN_BAND = 0.9;
+
+/** Network conditions the yield of an output is simulated under */
+struct CStakeConditions
+{
+    unsigned int nBits;          //!< proof-of-stake target of the next block
+    double dAverageStakeWeight;  //!< GetAverageStakeWeight below the tip
+    double dInterestRate;        //!< GetCurrentInterestRate at the tip
+};
+
+/** Expected outcome of staking one output, see SimulateStakeYield */
+struct CStakeYield
+{
+    CAmount nValue;          //!< value of the output
+    double dExpectedDays;    //!< expected age in days at which it stakes
+    CAmount nExpectedReward; //!< expected reward of that stake
+    double dAnnualYield;     //!< expected reward per year as a fraction of nValue
+};
+
+/**
+ * Simulate the staking of an output of nValue from the moment it confirms.
+ * The chance of a kernel for every second of its age is taken from the
+ * kernel target (GetStakeKernelTarget), and the reward at each age from the
+ * stake time GetStakeTime would give it, which stops growing after 30 days.
+ * Outputs too small stake late, after their reward has stopped growing;
+ * outputs too large get their weight cut once weightFraction exceeds 0.45.
+ */
+CStakeYield SimulateStakeYield(CAmount nValue, const CStakeConditions& conditions, const Consensus::Params& params);
+
+/** One transaction of a stake plan: spend vInputs into outputs of vValues */
+struct CStakePlanAction
+{
+    bool fSplit;                    //!< split one output, otherwise combine several
+    std::vector<COutPoint> vInputs;
+    CAmount nValueIn;
+    std::vector<CAmount> vValues;   //!< outputs before the fee is taken from them
+    double dYieldBefore;            //!< expected yearly reward of the inputs in coins
+    double dYieldAfter;             //!< and of the outputs
+};
+
+/** Output sizes that stake best under the current conditions, and how to get there */
+struct CStakePlan
+{
+    CStakeConditions conditions;
+    CStakeYield best;               //!< output size with the highest yield per coin
+    CAmount nMinValue;              //!< band of sizes within STAKE_PLAN_BAND of the best
+    CAmount nMaxValue;
+    int nOutputs;                   //!< stakeable outputs of the wallet
+    int nInBand;                    //!< of which are inside the band
+    CAmount nValue;                 //!< their total value
+    double dYield;                  //!< expected yearly reward of all of them in coins
+    std::vector<CStakePlanAction> vActions;
+
+    CStakePlan() : nMinValue(0), nMaxValue(0), nOutputs(0), nInBand(0), nValue(0), dYield(0) {}
+};
+
+/**
+ * Simulate the yield of a range of output sizes at the current tip, and
+ * plan the transactions that bring the stakeable outputs of pwallet into
+ * the band of the best sizes: outputs above it are split, outputs below it
+ * are combined. Requires cs_main and pwallet->cs_wallet.
+ */
+bool CreateStakePlan(CWallet* pwallet, CStakePlan& plan, std::string& strError);
+
+/** Create and broadcast the transactions of plan, adding their ids to vTxids */
+bool ExecuteStakePlan(CWallet* pwallet, const CStakePlan& plan, std::vector<uint256>& vTxids, std::string& strError);
+
+#endif // BITCOIN_WALLET_STAKEPLAN_H
@@ -0,0 +1,388 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/staker.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "checkqueue.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "kernel.h"
+#include "miner.h"
+#include "net.h"
+#include "pow.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "timedata.h"
+#include "txdb.h"
+#include "util.h"
+#include "utilmoneystr.h"
+#include "validation.h"
+#include "wallet/stakeplan.h"
+#include "wallet/wallet.h"
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+/** Seconds of transaction time covered by one unit of search work */
+static const unsigned int KERNEL_CHECK_SPAN = 64;
+
+/** A wallet output that can stake, with the kernel fields that stay fixed for a tip */
+struct CStakeCandidate
+{
+    COutPoint prevout;
+    CScript scriptPubKey;
+    CStakeInputInfo stakeInput;
+    uint64_t nStakeModifier;
+};
+
+/** State shared by the threads of one kernel search */
+struct CKernelSearch
+{
+    const unsigned int nBits;
+    const double dAverageStakeWeight;
+    const Consensus::Params& params;
+
+    std::atomic<bool> fFound;
+    std::atomic<uint64_t> nTried;
+
+    boost::mutex mutex;
+    const CStakeCandidate* pcandidateFound;
+    unsigned int nTimeFound;
+
+    CKernelSearch(unsigned int nBitsIn, double dAverageStakeWeightIn, const Consensus::Params& paramsIn) :
+        nBits(nBitsIn), dAverageStakeWeight(dAverageStakeWeightIn), params(paramsIn),
+        fFound(false), nTried(0), pcandidateFound(nullptr), nTimeFound(0) {}
+};
+
+/**
+ * Hashes the kernel of one candidate over a range of transaction times.
+ * Returns false when it finds a kernel, which makes the queue skip the
+ * remaining work.
+ */
+class CKernelCheck
+{
+private:
+    const CStakeCandidate* pcandidate;
+    unsigned int nTimeBegin;
+    unsigned int nTimeEnd;
+    CKernelSearch* psearch;
+
+public:
+    CKernelCheck() : pcandidate(nullptr), nTimeBegin(0), nTimeEnd(0), psearch(nullptr) {}
+    CKernelCheck(const CStakeCandidate* pcandidateIn, unsigned int nTimeBeginIn, unsigned int nTimeEndIn, CKernelSearch* psearchIn) :
+        pcandidate(pcandidateIn), nTimeBegin(nTimeBeginIn), nTimeEnd(nTimeEndIn), psearch(psearchIn) {}
+
+    bool operator()()
+    {
+        uint64_t nTried = 0;
+        bool fFound = false;
+        for (unsigned int nTimeTx = nTimeBegin; nTimeTx <= nTimeEnd && !psearch->fFound; nTimeTx++) {
+            uint256 hashProofOfStake = GetStakeKernelHash(pcandidate->nStakeModifier, pcandidate->stakeInput, pcandidate->prevout.n, nTimeTx);
+            arith_uint256 bnTarget = GetStakeKernelTarget(psearch->nBits, pcandidate->stakeInput, nTimeTx, psearch->dAverageStakeWeight, psearch->params);
+            nTried++;
+            if (UintToArith256(hashProofOfStake) <= bnTarget) {
+                boost::unique_lock<boost::mutex> lock(psearch->mutex);
+                if (!psearch->fFound) {
+                    psearch->pcandidateFound = pcandidate;
+                    psearch->nTimeFound = nTimeTx;
+                    psearch->fFound = true;
+                }
+                fFound = true;
+                break;
+            }
+        }
+        psearch->nTried += nTried;
+        return !fFound;
+    }
+
+    void swap(CKernelCheck& check)
+    {
+        std::swap(pcandidate, check.pcandidate);
+        std::swap(nTimeBegin, check.nTimeBegin);
+        std::swap(nTimeEnd, check.nTimeEnd);
+        std::swap(psearch, check.psearch);
+    }
+};
+
+CCheckQueue<CKernelCheck> kernelcheckqueue(16);
+
+CCriticalSection cs_stakerStats;
+CStakerStats stakerStats;
+
+} // anon namespace
+
+static void ThreadKernelCheck()
+{
+    RenameThread("solarcoin-kernelcheck");
+    kernelcheckqueue.Thread();
+}
+
+// Collect the wallet outputs that can stake on top of the active tip
+static void SelectStakeCandidates(CWallet* pwallet, std::vector<CStakeCandidate>& vCandidates, CAmount& nValue, const Consensus::Params& params)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pwallet->cs_wallet);
+
+    vCandidates.clear();
+    nValue = 0;
+
+    std::vector<COutput> vCoins;
+    pwallet->AvailableCoins(vCoins, true);
+    for (const COutput& out : vCoins) {
+        if (out.nDepth < 1 || !out.fSpendable)
+            continue;
+        if ((out.tx->IsCoinBase() || out.tx->IsCoinStake()) && out.tx->GetBlocksToMaturity() > 0)
+            continue;
+
+        // The block is signed with the key of the kernel output
+        const CTxOut& txout = out.tx->tx->vout[out.i];
+        txnouttype whichType;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        if (!Solver(txout.scriptPubKey, whichType, vSolutions) || (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH))
+            continue;
+
+        CStakeCandidate candidate;
+        candidate.prevout = COutPoint(out.tx->GetHash(), out.i);
+        candidate.scriptPubKey = txout.scriptPubKey;
+        if (!GetStakeInputInfo(candidate.prevout, candidate.stakeInput, params))
+            continue;
+
+        // Outputs younger than a selection interval have no modifier yet
+        int nStakeModifierHeight = 0;
+        int64_t nStakeModifierTime = 0;
+        if (!GetKernelStakeModifier(candidate.stakeInput.hashBlockFrom, candidate.nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false, params))
+            continue;
+
+        vCandidates.push_back(candidate);
+        nValue += txout.nValue;
+    }
+}
+
+// Build a block around a kernel, sign it and hand it to validation
+static bool CreateStakeBlock(CWallet* pwallet, const CStakeCandidate& candidate, unsigned int nTimeTx, unsigned int nBits, const CChainParams& chainparams)
+{
+    const Consensus::Params& params = chainparams.GetConsensus();
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(CScript(), true, true));
+    if (!pblocktemplate.get())
+        return error("%s: CreateNewBlock failed", __func__);
+    CBlock* pblock = &pblocktemplate->block;
+
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+
+        // The kernel is only good for the tip and target it was searched against
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        if (pblock->hashPrevBlock != pindexPrev->GetBlockHash() || pblock->nBits != nBits)
+            return false;
+
+        txnouttype whichType;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        CPubKey pubkey;
+        CKey key;
+        if (!Solver(candidate.scriptPubKey, whichType, vSolutions))
+            return error("%s: unable to solve kernel output %s", __func__, candidate.prevout.ToString());
+        if (whichType == TX_PUBKEY)
+            pubkey = CPubKey(vSolutions[0]);
+        else if (!pwallet->GetPubKey(CKeyID(uint160(vSolutions[0])), pubkey))
+            return error("%s: no public key for kernel output %s", __func__, candidate.prevout.ToString());
+        if (!pwallet->GetKey(pubkey.GetID(), key))
+            return error("%s: no private key for kernel output %s", __func__, candidate.prevout.ToString());
+
+        // Coinstake: empty first output, then the kernel value plus reward
+        // and fees paid back to the kernel's key
+        CMutableTransaction txCoinStake;
+        txCoinStake.nTime = nTimeTx;
+        txCoinStake.vin.push_back(CTxIn(candidate.prevout));
+        txCoinStake.vout.push_back(CTxOut(0, CScript()));
+
+        CAmount nFees = -pblocktemplate->vTxFees[0];
+        uint64_t nStakeTime = 0;
+        if (!GetStakeTime(txCoinStake, nStakeTime, pindexPrev, params))
+            return error("%s: unable to get stake time of kernel %s", __func__, candidate.prevout.ToString());
+        CAmount nReward = GetProofOfStakeTimeReward(nStakeTime, nFees, pindexPrev, params);
+        txCoinStake.vout.push_back(CTxOut(candidate.stakeInput.nValue + nReward, CScript() << ToByteVector(pubkey) << OP_CHECKSIG));
+
+        if (!SignSignature(*pwallet, candidate.scriptPubKey, txCoinStake, 0, candidate.stakeInput.nValue, SIGHASH_ALL))
+            return error("%s: unable to sign coinstake", __func__);
+
+        // Coinbase and block carry the kernel's timestamp
+        CMutableTransaction txCoinBase(*pblock->vtx[0]);
+        txCoinBase.nTime = nTimeTx;
+        pblock->vtx[0] = MakeTransactionRef(std::move(txCoinBase));
+        pblock->vtx.insert(pblock->vtx.begin() + 1, MakeTransactionRef(std::move(txCoinStake)));
+        pblock->nTime = nTimeTx;
+        GenerateCoinbaseCommitment(*pblock, pindexPrev, params);
+        pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+
+        if (!key.Sign(pblock->GetHash(), pblock->vchBlockSig))
+            return error("%s: unable to sign block", __func__);
+
+        CValidationState state;
+        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, true))
+            return error("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state));
+
+        LogPrintf("%s: new proof-of-stake block %s at height %d, kernel %s, reward %s\n", __func__,
+            pblock->GetHash().ToString(), pindexPrev->nHeight + 1, candidate.prevout.ToString(), FormatMoney(nReward));
+    }
+
+    std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
+    if (!ProcessNewBlock(chainparams, shared_pblock, true, nullptr))
+        return error("%s: block not accepted", __func__);
+    return true;
+}
+
+// Split and combine outputs toward the size that stakes best
+static void RunStakePlan(CWallet* pwallet)
+{
+    CStakePlan plan;
+    std::string strError;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        if (!CreateStakePlan(pwallet, plan, strError)) {
+            LogPrintf("%s: %s\n", __func__, strError);
+            return;
+        }
+    }
+    if (plan.vActions.empty())
+        return;
+
+    std::vector<uint256> vTxids;
+    if (!ExecuteStakePlan(pwallet, plan, vTxids, strError))
+        LogPrintf("%s: %s\n", __func__, strError);
+    LogPrintf("%s: sent %u of %u transactions to bring outputs into %s-%s, expected yield %.4f a year at %s\n", __func__,
+        vTxids.size(), plan.vActions.size(), FormatMoney(plan.nMinValue), FormatMoney(plan.nMaxValue), plan.best.dAnnualYield, FormatMoney(plan.best.nValue));
+}
+
+static void ThreadStakeMiner(CWallet* pwallet, int nThreads)
+{
+    LogPrintf("Staker started with %d kernel search threads\n", nThreads);
+
+    const CChainParams& chainparams = Params();
+    const Consensus::Params& params = chainparams.GetConsensus();
+
+    uint256 hashTip;
+    std::vector<CStakeCandidate> vCandidates;
+    unsigned int nBits = 0;
+    double dAverageStakeWeight = 0;
+    int64_t nLastSearchTime = 0;
+    const bool fStakePlan = GetBoolArg("-stakeplan", DEFAULT_STAKE_PLAN);
+    int64_t nNextStakePlan = 0;
+
+    while (true) {
+        MilliSleep(STAKER_SEARCH_INTERVAL);
+
+        bool fCanStake = !pwallet->IsLocked() && !IsInitialBlockDownload() &&
+            g_connman && g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) > 0;
+
+        if (fCanStake && fStakePlan && GetTime() >= nNextStakePlan) {
+            nNextStakePlan = GetTime() + STAKE_PLAN_INTERVAL;
+            RunStakePlan(pwallet);
+            // Spent outputs must not be searched any more
+            hashTip.SetNull();
+        }
+
+        if (fCanStake) {
+            LOCK2(cs_main, pwallet->cs_wallet);
+            CBlockIndex* pindexPrev = chainActive.Tip();
+            if (pindexPrev->nHeight < params.LAST_POW_BLOCK) {
+                fCanStake = false;
+            } else if (pindexPrev->GetBlockHash() != hashTip) {
+                // Everything but the transaction time is fixed until the next tip.
+                // The average weight is taken below the tip, as CheckProofOfStake does.
+                CAmount nCandidateValue = 0;
+                SelectStakeCandidates(pwallet, vCandidates, nCandidateValue, params);
+                hashTip = pindexPrev->GetBlockHash();
+                nBits = GetNextTargetRequired(pindexPrev, true, params);
+                dAverageStakeWeight = GetAverageStakeWeight(pindexPrev->pprev, params);
+                nLastSearchTime = pindexPrev->GetMedianTimePast();
+
+                LOCK(cs_stakerStats);
+                stakerStats.nCandidates = vCandidates.size();
+                stakerStats.nCandidateValue = nCandidateValue;
+            }
+        }
+
+        {
+            LOCK(cs_stakerStats);
+            stakerStats.fStaking = fCanStake && !vCandidates.empty();
+        }
+        if (!fCanStake || vCandidates.empty())
+            continue;
+
+        int64_t nSearchTime = GetAdjustedTime();
+        if (nSearchTime <= nLastSearchTime)
+            continue;
+
+        CKernelSearch search(nBits, dAverageStakeWeight, params);
+        std::vector<CKernelCheck> vChecks;
+        for (const CStakeCandidate& candidate : vCandidates) {
+            int64_t nTimeBegin = std::max(nLastSearchTime + 1, (int64_t)candidate.stakeInput.nTimeBlockFrom + params.nStakeMinAge);
+            nTimeBegin = std::max(nTimeBegin, (int64_t)candidate.stakeInput.nTimeTx);
+            for (int64_t nTime = nTimeBegin; nTime <= nSearchTime; nTime += KERNEL_CHECK_SPAN)
+                vChecks.push_back(CKernelCheck(&candidate, nTime, std::min(nTime + KERNEL_CHECK_SPAN - 1, nSearchTime), &search));
+        }
+
+        int64_t nTimeStart = GetTimeMicros();
+        CCheckQueueControl<CKernelCheck> control(&kernelcheckqueue);
+        control.Add(vChecks);
+        bool fFound = !control.Wait();
+        int64_t nTimeElapsed = GetTimeMicros() - nTimeStart;
+
+        {
+            LOCK(cs_stakerStats);
+            stakerStats.nKernelsTried += search.nTried;
+            stakerStats.dKernelsPerSecond = nTimeElapsed > 0 ? 1000000.0 * search.nTried / nTimeElapsed : 0;
+            stakerStats.nLastSearchInterval = nSearchTime - nLastSearchTime;
+            stakerStats.nLastSearchTime = nSearchTime;
+        }
+        LogPrint("stake", "%s: tried %u kernels of %u outputs over %d seconds in %.2fms\n", __func__,
+            (uint64_t)search.nTried, vCandidates.size(), nSearchTime - nLastSearchTime, 0.001 * nTimeElapsed);
+        nLastSearchTime = nSearchTime;
+
+        if (fFound && CreateStakeBlock(pwallet, *search.pcandidateFound, search.nTimeFound, nBits, chainparams)) {
+            LOCK(cs_stakerStats);
+            stakerStats.nBlocksStaked++;
+        }
+    }
+}
+
+void StartStaking(CWallet* pwallet, boost::thread_group& threadGroup)
+{
+    if (!GetBoolArg("-staking", DEFAULT_STAKING))
+        return;
+
+    int nThreads = GetArg("-stakingthreads", DEFAULT_STAKING_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    if (nThreads < 1)
+        nThreads = 1;
+    else if (nThreads > MAX_STAKING_THREADS)
+        nThreads = MAX_STAKING_THREADS;
+
+    {
+        LOCK(cs_stakerStats);
+        stakerStats.nThreads = nThreads;
+    }
+
+    // The staker thread joins the search as the last worker
+    for (int i = 0; i < nThreads - 1; i++)
+        threadGroup.create_thread(&ThreadKernelCheck);
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "staker",
+        boost::function<void()>(boost::bind(&ThreadStakeMiner, pwallet, nThreads))));
+}
+
+CStakerStats GetStakerStats()
+{
+    LOCK(cs_stakerStats);
+    return stakerStats;
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_STAKER_H
+#define BITCOIN_WALLET_STAKER_H
+
+#include "amount.h"
+
+#include <stdint.h>
+
+class CWallet;
+
+namespace boost {
+class thread_group;
+} // namespace boost
+
+//! Default for -staking
+static const bool DEFAULT_STAKING = false;
+//! Default for -stakingthreads, 0 means one per core
+static const int DEFAULT_STAKING_THREADS = 0;
+//! Maximum number of kernel search threads
+static const int MAX_STAKING_THREADS = 16;
+//! Milliseconds between kernel searches
+static const unsigned int STAKER_SEARCH_INTERVAL = 1000;
+
+/** Snapshot of what the staker is doing, reported by getstakinginfo */
+struct CStakerStats
+{
+    bool fStaking;                 //!< whether the last poll searched for a kernel
+    int nThreads;                  //!< kernel search threads, including the staker thread
+    int nCandidates;               //!< wallet outputs eligible to stake at the current tip
+    CAmount nCandidateValue;       //!< total value of those outputs
+    uint64_t nKernelsTried;        //!< kernels hashed since startup
+    double dKernelsPerSecond;      //!< kernel hash rate of the last search
+    int64_t nLastSearchTime;       //!< latest transaction time searched
+    int64_t nLastSearchInterval;   //!< seconds covered by the last search
+    uint64_t nBlocksStaked;        //!< blocks found and accepted since startup
+
+    CStakerStats() : fStaking(false), nThreads(0), nCandidates(0), nCandidateValue(0), nKernelsTried(0),
+        dKernelsPerSecond(0), nLastSearchTime(0), nLastSearchInterval(0), nBlocksStaked(0) {}
+};
+
+/** Start the staker and its kernel search threads for pwallet if -staking is set */
+void StartStaking(CWallet* pwallet, boost::thread_group& threadGroup);
+CStakerStats GetStakerStats();
+
+#endif // BITCOIN_WALLET_STAKER_H
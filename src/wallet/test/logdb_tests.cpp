@@ -0,0 +1,155 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "test/test_bitcoin.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+static CLogDB::Data MakeData(const std::string& str)
+{
+    return CLogDB::Data(str.begin(), str.end());
+}
+
+static bool WriteOne(CLogDB& db, const std::string& key, const std::string& value, bool fErase = false)
+{
+    std::vector<CLogDB::Record> vRecords(1);
+    vRecords[0].fErase = fErase;
+    vRecords[0].key = MakeData(key);
+    vRecords[0].value = MakeData(value);
+    return db.Write(vRecords);
+}
+
+static std::string ReadOne(const CLogDB& db, const std::string& key)
+{
+    CLogDB::Data value;
+    if (!db.Read(MakeData(key), value))
+        return "<none>";
+    return std::string(value.begin(), value.end());
+}
+
+BOOST_FIXTURE_TEST_SUITE(logdb_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(logdb_reopen)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    {
+        CLogDB db(path);
+        BOOST_CHECK(db.Open(false) == CLogDB::OPEN_FAIL);
+        BOOST_CHECK(db.Open(true) == CLogDB::OPEN_OK);
+        BOOST_CHECK(CLogDB::IsLogFile(path));
+        BOOST_CHECK(WriteOne(db, "a", "1"));
+        BOOST_CHECK(WriteOne(db, "\x80", "2"));
+        BOOST_CHECK(WriteOne(db, "\x01", "3"));
+        BOOST_CHECK(WriteOne(db, "a", "4"));
+        BOOST_CHECK(WriteOne(db, "\x01", "", true));
+        BOOST_CHECK(WriteOne(db, "missing", "", true));
+    }
+
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(false) == CLogDB::OPEN_OK);
+    BOOST_CHECK_EQUAL(db.GetCount(), 2U);
+    BOOST_CHECK_EQUAL(ReadOne(db, "a"), "4");
+    BOOST_CHECK_EQUAL(ReadOne(db, "\x80"), "2");
+    BOOST_CHECK(!db.Exists(MakeData("\x01")));
+
+    // Keys come in byte order, as from Berkeley DB
+    CLogDB::Data key, value;
+    BOOST_CHECK(db.Next(CLogDB::Data(), true, key, value));
+    BOOST_CHECK(key == MakeData("a"));
+    BOOST_CHECK(db.Next(key, false, key, value));
+    BOOST_CHECK(key == MakeData("\x80"));
+    BOOST_CHECK(db.Next(key, true, key, value));
+    BOOST_CHECK(key == MakeData("\x80"));
+    BOOST_CHECK(!db.Next(key, false, key, value));
+
+    db.Close();
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(logdb_torn_and_damaged)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    uint64_t nSizeBefore;
+    {
+        CLogDB db(path);
+        BOOST_CHECK(db.Open(true) == CLogDB::OPEN_OK);
+        BOOST_CHECK(WriteOne(db, "a", "1"));
+        nSizeBefore = db.GetFileSize();
+        BOOST_CHECK(WriteOne(db, "b", "2"));
+    }
+
+    // A write torn by a crash is cut off
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 3);
+    {
+        CLogDB db(path);
+        BOOST_CHECK(db.Open(false) == CLogDB::OPEN_OK);
+        BOOST_CHECK_EQUAL(db.GetFileSize(), nSizeBefore);
+        BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSizeBefore);
+        BOOST_CHECK_EQUAL(ReadOne(db, "a"), "1");
+        BOOST_CHECK_EQUAL(ReadOne(db, "b"), "<none>");
+        BOOST_CHECK(WriteOne(db, "c", "3"));
+    }
+
+    // A damaged frame stops the reading at it
+    FILE* file = fopen(path.string().c_str(), "rb+");
+    BOOST_REQUIRE(file);
+    fseek(file, nSizeBefore - 6, SEEK_SET);
+    fputc('x', file);
+    fclose(file);
+    {
+        CLogDB db(path);
+        BOOST_CHECK(db.Open(false) == CLogDB::OPEN_DAMAGED);
+        BOOST_CHECK_EQUAL(db.GetCount(), 0U);
+        BOOST_CHECK(!WriteOne(db, "d", "4"));
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(logdb_compact)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    CLogDB db(path);
+    BOOST_CHECK(db.Open(true) == CLogDB::OPEN_OK);
+
+    // Overwrite the same records until the file is well past its live size
+    std::string strValue(1000, 'v');
+    for (int i = 0; i < 3000; i++)
+        BOOST_CHECK(WriteOne(db, std::to_string(i % 100), strValue + std::to_string(i)));
+    BOOST_CHECK(db.GetFileSize() >= LOG_COMPACT_MIN_SIZE);
+    BOOST_CHECK(db.GetFileSize() >= db.GetLiveSize() * LOG_COMPACT_RATIO);
+
+    // Committing makes the writes durable without compacting
+    uint64_t nSizeBefore = db.GetFileSize();
+    BOOST_CHECK(db.Commit());
+    BOOST_CHECK_EQUAL(db.GetFileSize(), nSizeBefore);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSizeBefore);
+
+    BOOST_CHECK(db.Flush());
+    BOOST_CHECK(db.GetFileSize() < db.GetLiveSize() + 100);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), db.GetFileSize());
+    BOOST_CHECK(!boost::filesystem::exists(path.string() + ".compact"));
+
+    // Writes go on after the compacted records
+    BOOST_CHECK(WriteOne(db, "0", "new"));
+    db.Close();
+
+    CLogDB dbReopened(path);
+    BOOST_CHECK(dbReopened.Open(false) == CLogDB::OPEN_OK);
+    BOOST_CHECK_EQUAL(dbReopened.GetCount(), 100U);
+    BOOST_CHECK_EQUAL(ReadOne(dbReopened, "0"), "new");
+    BOOST_CHECK_EQUAL(ReadOne(dbReopened, "99"), strValue + "2999");
+
+    dbReopened.Close();
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
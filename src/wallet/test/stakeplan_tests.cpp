@@ -0,0 +1,46 @@
+// Copyright (c) 2017 The SolarCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakeplan.h"
+
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakeplan_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(stake_yield_by_size)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+
+    // A network of 10 million coin-days finding a kernel about every minute
+    arith_uint256 bnTarget = ~arith_uint256(0);
+    bnTarget /= 60 * 10000000;
+    CStakeConditions conditions;
+    conditions.nBits = bnTarget.GetCompact();
+    conditions.dAverageStakeWeight = 10000000;
+    conditions.dInterestRate = 2;
+
+    CStakeYield small = SimulateStakeYield(1 * COIN, conditions, params);
+    CStakeYield medium = SimulateStakeYield(128 * COIN, conditions, params);
+    CStakeYield large = SimulateStakeYield(8388608 * COIN, conditions, params);
+
+    // Mid-sized outputs earn about the interest rate
+    BOOST_CHECK(medium.dAnnualYield > 0.019 && medium.dAnnualYield < 0.021);
+    BOOST_CHECK(medium.nExpectedReward > 0);
+
+    // Small outputs stake after their stake time stopped growing
+    BOOST_CHECK(small.dExpectedDays > 30);
+    BOOST_CHECK(small.dAnnualYield < 0.9 * medium.dAnnualYield);
+    BOOST_CHECK(medium.dExpectedDays < small.dExpectedDays);
+
+    // Large outputs lose their weight as weightFraction nears 0.45
+    BOOST_CHECK(large.dAnnualYield < 0.9 * medium.dAnnualYield);
+
+    BOOST_CHECK_EQUAL(SimulateStakeYield(0, conditions, params).dAnnualYield, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -363,6 +363,62 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(wallet.cs_wallet);
+
+    empty_wallet();
+
+    CCoinSelectionParams params((CFeeRate()));
+    params.nInputFee = 0;
+    params.nCostOfChange = 0;
+
+    add_coin(1 * COIN);
+    add_coin(2 * COIN);
+    add_coin(3 * COIN);
+    add_coin(5 * COIN);
+    add_coin(8 * COIN);
+    add_coin(100 * COIN);
+
+    // An exact match is found without change
+    BOOST_CHECK(wallet.SelectCoinsMinConf(10 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * COIN);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(19 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params));
+    BOOST_CHECK_EQUAL(nValueRet, 19 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 5U);
+
+    // Within the cost of change, the selection closest to the target wins
+    params.nCostOfChange = COIN;
+    BOOST_CHECK(wallet.SelectCoinsMinConf(10.5 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params));
+    BOOST_CHECK_EQUAL(nValueRet, 11 * COIN);
+
+    // Coins that cost more to spend than they are worth are left out
+    params.nCostOfChange = 0;
+    params.nInputFee = COIN;
+    BOOST_CHECK(wallet.SelectCoinsMinConf(11 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params));
+    BOOST_CHECK_EQUAL(nValueRet, 11 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // Without an exact match the knapsack solver is used
+    params.nInputFee = 0;
+    BOOST_CHECK(wallet.SelectCoinsMinConf(20 * COIN, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params));
+    BOOST_CHECK_EQUAL(nValueRet, 100 * COIN);
+
+    // Many coins of the same value
+    empty_wallet();
+    for (int i = 0; i < 1000; i++)
+        add_coin(3 * CENT);
+    add_coin(5 * CENT);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(14 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet, &params));
+    BOOST_CHECK_EQUAL(nValueRet, 14 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+
+    empty_wallet();
+}
+
 BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
 {
     LOCK(cs_main);
@@ -430,6 +486,80 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+// Verify the rescan prefilter finds outputs to watch-only scripts and
+// pay-to-script-hash outputs of known scripts, not only outputs to keys.
+BOOST_FIXTURE_TEST_CASE(rescan_prefilter, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CScript scriptP2SH = GetScriptForDestination(CScriptID(scriptPubKey));
+    CreateAndProcessBlock({}, scriptP2SH);
+
+    CWallet walletKey;
+    CWallet walletWatch;
+    LOCK2(walletKey.cs_wallet, walletWatch.cs_wallet);
+    walletKey.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    walletKey.AddCScript(scriptPubKey);
+    walletWatch.AddWatchOnly(scriptPubKey, 1);
+    BOOST_CHECK_EQUAL(chainActive.Genesis(), walletKey.ScanForWalletTransactions(chainActive.Genesis()));
+    BOOST_CHECK_EQUAL(chainActive.Genesis(), walletWatch.ScanForWalletTransactions(chainActive.Genesis()));
+
+    // The key wallet has the coinbase of every block, the watch-only wallet
+    // all but the one paying to the script hash.
+    BOOST_CHECK_EQUAL(walletKey.mapWallet.size(), (size_t)chainActive.Height());
+    BOOST_CHECK_EQUAL(walletWatch.mapWallet.size(), (size_t)chainActive.Height() - 1);
+}
+
+// Verify the index of unspent outputs follows a spend the same way a
+// rebuild of it does.
+BOOST_FIXTURE_TEST_CASE(unspent_index, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+    CAmount nBalance = wallet.GetBalance();
+    std::vector<COutput> vCoins;
+    wallet.AvailableCoins(vCoins);
+    size_t nCoins = vCoins.size();
+    BOOST_CHECK(nBalance > 0);
+    BOOST_CHECK(nCoins > 0);
+
+    // Spend the first coinbase to a key that is not ours
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CScript scriptOther = GetScriptForRawPubKey(keyOther.GetPubKey());
+    CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptOther;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    CreateAndProcessBlock({spend}, scriptOther);
+    wallet.SyncTransaction(spend, chainActive.Tip(), 1);
+
+    nBalance = wallet.GetBalance();
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), nCoins - 1);
+    for (const COutput& out : vCoins)
+        BOOST_CHECK(out.tx->GetHash() != coinbaseTxns[0].GetHash());
+
+    wallet.MarkDirty();
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nBalance);
+    wallet.AvailableCoins(vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), nCoins - 1);
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
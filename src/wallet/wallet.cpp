@@ -9,6 +9,8 @@
 #include "checkpoints.h"
 #include "chain.h"
 #include "wallet/coincontrol.h"
+#include "wallet/stakeplan.h"
+#include "wallet/staker.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "key.h"
@@ -77,6 +79,19 @@ struct CompareValueOnly
     }
 };
 
+//! Serialized size of a signed pay-to-pubkey-hash input
+static const unsigned int COIN_SELECTION_INPUT_SIZE = 148;
+//! Serialized size of a pay-to-pubkey-hash change output
+static const unsigned int COIN_SELECTION_CHANGE_SIZE = 34;
+//! Number of steps after which the branch and bound search gives up
+static const int BNB_TOTAL_TRIES = 100000;
+
+CCoinSelectionParams::CCoinSelectionParams(const CFeeRate& feeRate)
+{
+    nInputFee = feeRate.GetFee(COIN_SELECTION_INPUT_SIZE);
+    nCostOfChange = feeRate.GetFee(COIN_SELECTION_CHANGE_SIZE) + nInputFee;
+}
+
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->tx->vout[i].nValue));
@@ -497,6 +512,12 @@ bool CWallet::Verify()
         }
         if (r == CDBEnv::RECOVER_FAIL)
             return InitError(strprintf(_("%s corrupt, salvage failed"), walletFile));
+
+        if (GetBoolArg("-walletlog", DEFAULT_WALLET_LOG) && !bitdb.IsLogFile(walletFile)) {
+            uiInterface.InitMessage(_("Converting wallet..."));
+            if (!CDB::Rewrite(walletFile))
+                return InitError(strprintf(_("Error converting %s to a log file"), walletFile));
+        }
     }
     
     return true;
@@ -562,9 +583,52 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+bool CWallet::MayHaveUnspent(const CWalletTx& wtx) const
+{
+    if (wtx.GetBlocksToMaturity() > 0)
+        return true;
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) != ISMINE_NO && !IsSpent(hash, i))
+            return true;
+    }
+    return false;
+}
+
+void CWallet::MarkUnspentDirty(const uint256& hash) const
+{
+    if (!fWalletUnspentAllDirty)
+        setWalletUnspentDirty.insert(hash);
+}
+
+void CWallet::UpdateWalletUnspent() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (fWalletUnspentAllDirty) {
+        setWalletUnspent.clear();
+        for (const auto& item : mapWallet) {
+            if (MayHaveUnspent(item.second))
+                setWalletUnspent.insert(setWalletUnspent.end(), item.first);
+        }
+        fWalletUnspentAllDirty = false;
+    } else {
+        for (const uint256& hash : setWalletUnspentDirty) {
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it != mapWallet.end() && MayHaveUnspent(it->second))
+                setWalletUnspent.insert(hash);
+            else
+                setWalletUnspent.erase(hash);
+        }
+    }
+    setWalletUnspentDirty.clear();
+}
+
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
+    MarkUnspentDirty(outpoint.hash);
 
     pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -848,6 +912,8 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
+        fWalletUnspentAllDirty = true;
+        setWalletUnspentDirty.clear();
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
     }
@@ -1545,14 +1611,117 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
     }
 }
 
+namespace {
+
+//! Most threads a rescan reads blocks with
+const int MAX_RESCAN_THREADS = 8;
+//! Blocks each rescan thread may read ahead of the scan
+const int RESCAN_BLOCKS_PER_THREAD = 16;
+
+/**
+ * A copy of the wallet's key and script ids, taken when a rescan starts, to
+ * tell without cs_wallet whether an output might be ours. It errs on the side
+ * of yes (multisig outputs we only have some keys of, watch-only scripts that
+ * are not solvable); AddToWalletIfInvolvingMe makes the final decision.
+ */
+struct CRescanFilter
+{
+    std::set<CKeyID> setKeyIDs;
+    std::set<CScriptID> setScriptIDs;
+    WatchOnlySet setWatchOnly;
+
+    bool MaybeMine(const CScript& scriptPubKey) const
+    {
+        if (setWatchOnly.count(scriptPubKey))
+            return true;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        txnouttype whichType;
+        if (!Solver(scriptPubKey, whichType, vSolutions))
+            return false;
+        switch (whichType) {
+        case TX_PUBKEY:
+            return setKeyIDs.count(CPubKey(vSolutions[0]).GetID()) > 0;
+        case TX_PUBKEYHASH:
+            return setKeyIDs.count(CKeyID(uint160(vSolutions[0]))) > 0;
+        case TX_SCRIPTHASH:
+            return setScriptIDs.count(CScriptID(uint160(vSolutions[0]))) > 0;
+        case TX_WITNESS_V0_KEYHASH:
+        case TX_WITNESS_V0_SCRIPTHASH:
+            // Only matched when the P2SH version of the witness program is known
+            return setScriptIDs.count(CScriptID(CScript() << OP_0 << vSolutions[0])) > 0;
+        case TX_MULTISIG:
+            for (size_t i = 1; i + 1 < vSolutions.size(); i++) {
+                if (setKeyIDs.count(CPubKey(vSolutions[i]).GetID()))
+                    return true;
+            }
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    bool MaybeMine(const CTransaction& tx) const
+    {
+        for (const CTxOut& txout : tx.vout) {
+            if (MaybeMine(txout.scriptPubKey))
+                return true;
+        }
+        return false;
+    }
+
+    //! Wallet transactions and the outpoints they spend, kept up to date by
+    //! the scanning thread only (the read threads never look at these)
+    std::set<uint256> setWalletTxids;
+    std::set<COutPoint> setWalletSpends;
+
+    //! Whether tx is a wallet transaction, spends an output of one, or conflicts with one
+    bool MaybeFromMe(const CTransaction& tx) const
+    {
+        if (setWalletTxids.count(tx.GetHash()))
+            return true;
+        for (const CTxIn& txin : tx.vin) {
+            if (setWalletTxids.count(txin.prevout.hash) || setWalletSpends.count(txin.prevout))
+                return true;
+        }
+        return false;
+    }
+
+    void AddWalletTx(const CTransaction& tx)
+    {
+        setWalletTxids.insert(tx.GetHash());
+        for (const CTxIn& txin : tx.vin)
+            setWalletSpends.insert(txin.prevout);
+    }
+};
+
+/** A block read by a rescan thread, with the transactions whose outputs might be ours */
+struct CRescanBlock
+{
+    bool fDone;
+    bool fRead;
+    CBlock block;
+    std::vector<size_t> vPosMaybeMine;
+
+    CRescanBlock() : fDone(false), fRead(false) {}
+};
+
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * Blocks are read and their outputs matched against a CRescanFilter by
+ * worker threads, a window of blocks ahead of the scan. Only transactions
+ * that might involve the wallet go through AddToWalletIfInvolvingMe, in block
+ * order; whether a transaction spends one of ours is checked against a copy
+ * of the wallet's transactions that grows with what the scan adds. cs_main
+ * and cs_wallet are held only while a block's matches are added, and the
+ * scan stops if that block has left the active chain in the meantime.
+ *
  * Returns pointer to the first block in the last contiguous range that was
  * successfully scanned.
- *
  */
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -1561,6 +1730,9 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
     const CChainParams& chainParams = Params();
 
     CBlockIndex* pindex = pindexStart;
+    std::vector<CBlockIndex*> vIndex;
+    CRescanFilter filter;
+    double dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1569,32 +1741,150 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
-        double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
-        while (pindex)
+        for (; pindex; pindex = chainActive.Next(pindex))
+            vIndex.push_back(pindex);
+
+        GetKeys(filter.setKeyIDs);
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            LOCK(cs_KeyStore);
+            for (const auto& entry : mapScripts)
+                filter.setScriptIDs.insert(entry.first);
+            filter.setWatchOnly = setWatchOnly;
+        }
+        for (const auto& entry : mapWallet)
+            filter.setWalletTxids.insert(entry.first);
+        for (const auto& entry : mapTxSpends)
+            filter.setWalletSpends.insert(entry.first);
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate);
-                }
-                if (!ret) {
-                    ret = pindex;
+        dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+    }
+
+    // SolarCoin: cs_main and cs_wallet are only taken again for the blocks
+    // that have a transaction to add, so a long rescan does not stall block
+    // validation or the wallet RPCs.
+    {
+        const int nThreads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+        const size_t nWindow = nThreads * RESCAN_BLOCKS_PER_THREAD;
+        std::vector<CRescanBlock> vWindow(nWindow);
+        size_t nNextRead = 0, nNextScan = 0;
+        bool fStop = false;
+        boost::mutex csWindow;
+        boost::condition_variable condWindow;
+
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads && i < (int)vIndex.size(); i++) {
+            threads.create_thread([&] {
+                RenameThread("solarcoin-rescan");
+                const Consensus::Params& consensusParams = Params().GetConsensus();
+                boost::unique_lock<boost::mutex> lock(csWindow);
+                while (true) {
+                    while (!fStop && nNextRead < vIndex.size() && nNextRead >= nNextScan + nWindow)
+                        condWindow.wait(lock);
+                    if (fStop || nNextRead >= vIndex.size())
+                        return;
+                    size_t nPos = nNextRead++;
+                    CRescanBlock& slot = vWindow[nPos % nWindow];
+                    lock.unlock();
+
+                    slot.fRead = ReadBlockFromDisk(slot.block, vIndex[nPos], consensusParams);
+                    if (slot.fRead) {
+                        for (size_t posInBlock = 0; posInBlock < slot.block.vtx.size(); posInBlock++) {
+                            if (filter.MaybeMine(*slot.block.vtx[posInBlock]))
+                                slot.vPosMaybeMine.push_back(posInBlock);
+                        }
+                    }
+
+                    lock.lock();
+                    slot.fDone = true;
+                    condWindow.notify_all();
                 }
-            } else {
-                ret = nullptr;
+            });
+        }
+
+        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+        double dProgressStart = GuessVerificationProgress(chainParams.TxData(), vIndex.empty() ? NULL : vIndex.front());
+        const int64_t nScanStart = GetTimeMicros();
+        int64_t nStart = nScanStart;
+        size_t nLastLogged = 0;
+        auto stopThreads = [&] {
+            {
+                boost::unique_lock<boost::mutex> lock(csWindow);
+                fStop = true;
+                condWindow.notify_all();
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+            threads.join_all();
+        };
+        try {
+            for (size_t nPos = 0; nPos < vIndex.size(); nPos++)
+            {
+                pindex = vIndex[nPos];
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                CRescanBlock scanned;
+                {
+                    boost::unique_lock<boost::mutex> lock(csWindow);
+                    CRescanBlock& slot = vWindow[nPos % nWindow];
+                    while (!slot.fDone)
+                        condWindow.wait(lock);
+                    std::swap(scanned, slot);
+                    nNextScan = nPos + 1;
+                    condWindow.notify_all();
+                }
+
+                if (scanned.fRead) {
+                    // Find the first transaction that might involve us
+                    // without the locks; most blocks have none.
+                    size_t nPosFirst = scanned.vPosMaybeMine.empty() ? scanned.block.vtx.size() : scanned.vPosMaybeMine.front();
+                    for (size_t posInBlock = 0; posInBlock < nPosFirst; ++posInBlock) {
+                        if (filter.MaybeFromMe(*scanned.block.vtx[posInBlock]))
+                            nPosFirst = posInBlock;
+                    }
+                    if (nPosFirst < scanned.block.vtx.size()) {
+                        LOCK2(cs_main, cs_wallet);
+                        // The chain may have moved on while the locks were
+                        // released; don't record transactions as in a block
+                        // that is no longer part of it.
+                        if (!chainActive.Contains(pindex)) {
+                            LogPrintf("Rescan: block %s at height %d is no longer in the active chain, aborting\n", pindex->GetBlockHash().ToString(), pindex->nHeight);
+                            ret = nullptr;
+                            break;
+                        }
+                        // Later transactions may spend ones added here, so the
+                        // wallet sets are checked again as they grow
+                        std::vector<size_t>::const_iterator itMaybeMine = std::lower_bound(scanned.vPosMaybeMine.begin(), scanned.vPosMaybeMine.end(), nPosFirst);
+                        for (size_t posInBlock = nPosFirst; posInBlock < scanned.block.vtx.size(); ++posInBlock) {
+                            const CTransaction& tx = *scanned.block.vtx[posInBlock];
+                            bool fMaybeMine = itMaybeMine != scanned.vPosMaybeMine.end() && *itMaybeMine == posInBlock;
+                            if (fMaybeMine)
+                                ++itMaybeMine;
+                            if ((fMaybeMine || filter.MaybeFromMe(tx)) && AddToWalletIfInvolvingMe(tx, pindex, posInBlock, fUpdate))
+                                filter.AddWalletTx(tx);
+                        }
+                    }
+                    if (!ret) {
+                        ret = pindex;
+                    }
+                } else {
+                    ret = nullptr;
+                }
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    double dSeconds = (GetTimeMicros() - nStart) * 0.000001;
+                    LogPrintf("Still rescanning. At block %d. Progress=%f, %.1f blocks/s\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex), (nPos + 1 - nLastLogged) / std::max(dSeconds, 0.001));
+                    nLastLogged = nPos + 1;
+                    nStart = GetTimeMicros();
+                }
             }
+        } catch (...) {
+            // The threads use the locals of this function
+            stopThreads();
+            throw;
         }
+        stopThreads();
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        double dSeconds = (GetTimeMicros() - nScanStart) * 0.000001;
+        LogPrintf("Rescan: scanned %u blocks in %.1fs (%.1f blocks/s)\n", vIndex.size(), dSeconds, vIndex.size() / std::max(dSeconds, 0.001));
     }
     return ret;
 }
@@ -1730,6 +2020,21 @@ CAmount CWalletTx::GetCredit(const isminefilter& filter) const
     return credit;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet)
+        pwallet->MarkUnspentDirty(GetHash());
+}
+
 CAmount CWalletTx::GetImmatureCredit(bool fUseCache) const
 {
     if ((IsCoinBase() || IsCoinStake()) && GetBlocksToMaturity() > 0 && IsInMainChain())
@@ -1938,9 +2243,13 @@ CAmount CWallet::GetBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateWalletUnspent();
+        for (const uint256& hash : setWalletUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &it->second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1954,9 +2263,13 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateWalletUnspent();
+        for (const uint256& hash : setWalletUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &it->second;
             if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -1969,9 +2282,13 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateWalletUnspent();
+        for (const uint256& hash : setWalletUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &it->second;
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -1983,9 +2300,13 @@ CAmount CWallet::GetWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateWalletUnspent();
+        for (const uint256& hash : setWalletUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &it->second;
             if (pcoin->IsTrusted())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -1999,9 +2320,13 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateWalletUnspent();
+        for (const uint256& hash : setWalletUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &it->second;
             if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
                 nTotal += pcoin->GetAvailableWatchOnlyCredit();
         }
@@ -2014,9 +2339,13 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateWalletUnspent();
+        for (const uint256& hash : setWalletUnspent)
         {
-            const CWalletTx* pcoin = &(*it).second;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &it->second;
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -2029,10 +2358,13 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateWalletUnspent();
+        for (const uint256& wtxid : setWalletUnspent)
         {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+            std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &it->second;
 
             if (!CheckFinalTx(*pcoin))
                 continue;
@@ -2086,8 +2418,8 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
             for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
                 isminetype mine = IsMine(pcoin->tx->vout[i]);
                 if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->tx->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint((*it).first, i))))
+                    !IsLockedCoin(wtxid, i) && (pcoin->tx->vout[i].nValue > 0 || fIncludeZeroValue) &&
+                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint(wtxid, i))))
                         vCoins.push_back(COutput(pcoin, i, nDepth,
                                                  ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
                                                   (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO),
@@ -2143,21 +2475,77 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,uns
     }
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, vector<COutput> vCoins,
-                                 set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+/**
+ * Depth first search for the subset of vValue (sorted by descending value)
+ * whose total lies in [nTargetValue, nTargetValue + nCostOfChange] and exceeds
+ * nTargetValue the least. Such a selection needs no change output. Subtrees
+ * that cannot reach the target any more or already overshoot it are cut, and
+ * the search gives up after BNB_TOTAL_TRIES steps.
+ */
+static bool SelectCoinsBnB(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTargetValue, const CAmount& nCostOfChange,
+                           vector<char>& vfBest, CAmount& nBest)
 {
-    setCoinsRet.clear();
-    nValueRet = 0;
+    CAmount nAvailable = 0;
+    for (const auto& coin : vValue)
+        nAvailable += coin.first;
+    if (nAvailable < nTargetValue)
+        return false;
 
-    // List of values less than target
-    pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-    coinLowestLarger.second.first = NULL;
-    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
-    CAmount nTotalLower = 0;
+    vector<char> vfIncluded(vValue.size(), false);
+    CAmount nTotal = 0;
+    size_t nDepth = 0;
+    nBest = std::numeric_limits<CAmount>::max();
+
+    for (int nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nTotal + nAvailable < nTargetValue || nTotal > nTargetValue + nCostOfChange) {
+            fBacktrack = true;
+        } else if (nTotal >= nTargetValue) {
+            if (nTotal < nBest) {
+                nBest = nTotal;
+                vfBest = vfIncluded;
+                if (nBest == nTargetValue)
+                    break;
+            }
+            fBacktrack = true;
+        }
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+        if (fBacktrack) {
+            // Undo the trailing exclusions, then exclude the last included coin
+            while (nDepth > 0 && !vfIncluded[nDepth - 1]) {
+                nDepth--;
+                nAvailable += vValue[nDepth].first;
+            }
+            if (nDepth == 0)
+                break;
+            vfIncluded[nDepth - 1] = false;
+            nTotal -= vValue[nDepth - 1].first;
+            continue;
+        }
+
+        // Including a coin after excluding one of the same value would only
+        // repeat a subtree that has already been searched
+        nAvailable -= vValue[nDepth].first;
+        if (nDepth == 0 || vfIncluded[nDepth - 1] || vValue[nDepth].first != vValue[nDepth - 1].first) {
+            vfIncluded[nDepth] = true;
+            nTotal += vValue[nDepth].first;
+        }
+        nDepth++;
+    }
 
+    return nBest != std::numeric_limits<CAmount>::max();
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const vector<COutput>& vCoins,
+                                 set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinSelectionParams* params) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    // Coins that may be spent at this depth, without copying the COutputs
+    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vCandidates;
+    vCandidates.reserve(vCoins.size());
     BOOST_FOREACH(const COutput &output, vCoins)
     {
         if (!output.fSpendable)
@@ -2172,9 +2560,47 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
             continue;
 
         int i = output.i;
-        CAmount n = pcoin->tx->vout[i].nValue;
+        vCandidates.push_back(make_pair(pcoin->tx->vout[i].nValue, make_pair(pcoin, i)));
+    }
+
+    if (params)
+    {
+        // Only coins worth more than the fee of spending them take part
+        vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vEffective;
+        vEffective.reserve(vCandidates.size());
+        for (const auto& coin : vCandidates)
+            if (coin.first > params->nInputFee)
+                vEffective.push_back(coin);
+        std::sort(vEffective.begin(), vEffective.end(), CompareValueOnly());
+        std::reverse(vEffective.begin(), vEffective.end());
+
+        vector<char> vfBest;
+        CAmount nBest;
+        if (SelectCoinsBnB(vEffective, nTargetValue, params->nCostOfChange, vfBest, nBest))
+        {
+            for (unsigned int i = 0; i < vEffective.size(); i++)
+                if (vfBest[i])
+                {
+                    setCoinsRet.insert(vEffective[i].second);
+                    nValueRet += vEffective[i].first;
+                }
+            LogPrint("selectcoins", "SelectCoins() branch and bound: %d coins, total %s\n", setCoinsRet.size(), FormatMoney(nBest));
+            return true;
+        }
+    }
 
-        pair<CAmount,pair<const CWalletTx*,unsigned int> > coin = make_pair(n,make_pair(pcoin, i));
+    // List of values less than target
+    pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
+    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
+    coinLowestLarger.second.first = NULL;
+    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
+    CAmount nTotalLower = 0;
+
+    random_shuffle(vCandidates.begin(), vCandidates.end(), GetRandInt);
+
+    for (const auto& coin : vCandidates)
+    {
+        CAmount n = coin.first;
 
         if (n == nTargetValue)
         {
@@ -2248,7 +2674,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     return true;
 }
 
-bool CWallet::SelectCoins(const vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
+bool CWallet::SelectCoins(const vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, const CCoinSelectionParams* params) const
 {
     vector<COutput> vCoins(vAvailableCoins);
 
@@ -2300,13 +2726,13 @@ bool CWallet::SelectCoins(const vector<COutput>& vAvailableCoins, const CAmount&
     bool fRejectLongChains = GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet));
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, params) ||
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, params) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, params)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, params));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -2440,6 +2866,18 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
             std::vector<COutput> vAvailableCoins;
             AvailableCoins(vAvailableCoins, true, coinControl);
 
+            // Look for inputs that need no change output first. The little they
+            // exceed the target by is left to the fee, which costs less than
+            // creating change and spending it later. Not done when the fee is
+            // paid by the recipients, as that would make them pay more.
+            CFeeRate selectionFeeRate;
+            if (coinControl && coinControl->fOverrideFeeRate)
+                selectionFeeRate = coinControl->nFeeRate;
+            else
+                selectionFeeRate = CFeeRate(GetMinimumFee(1000, (coinControl && coinControl->nConfirmTarget > 0) ? coinControl->nConfirmTarget : nTxConfirmTarget, mempool), 1000);
+            const CCoinSelectionParams selectionParams(selectionFeeRate);
+            const CCoinSelectionParams* pselectionParams = nSubtractFeeFromAmount == 0 ? &selectionParams : NULL;
+
             nFeeRet = 0;
             // Start with no fee and loop until there is enough fee
             while (true)
@@ -2489,7 +2927,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                 // Choose coins to use
                 CAmount nValueIn = 0;
                 setCoins.clear();
-                if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coinControl))
+                if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coinControl, pselectionParams))
                 {
                     strFailReason = _("Insufficient funds");
                     return false;
@@ -2567,9 +3005,9 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                         }
                     }
 
-                    // Never create dust outputs; if we would, just
-                    // add the dust to the fee.
-                    if (newTxOut.IsDust(dustRelayFee))
+                    // Never create dust outputs, or change worth less than
+                    // what it costs; if we would, just add it to the fee.
+                    if (newTxOut.IsDust(dustRelayFee) || (pselectionParams && nChange <= pselectionParams->nCostOfChange))
                     {
                         nChangePosInOut = -1;
                         nFeeRet += nChange;
@@ -2888,11 +3326,12 @@ DBErrors CWallet::ZapSelectTx(vector<uint256>& vHashIn, vector<uint256>& vHashOu
         }
     }
 
+    // Transactions may have been erased even if some could not be
+    MarkDirty();
+
     if (nZapSelectTxRet != DB_LOAD_OK)
         return nZapSelectTxRet;
 
-    MarkDirty();
-
     return DB_LOAD_OK;
 
 }
@@ -3556,12 +3995,17 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
+    strUsage += HelpMessageOpt("-stakeplan", strprintf(_("With -staking, split and combine wallet outputs toward the size that stakes best, see getstakeplan (default: %u)"), DEFAULT_STAKE_PLAN));
+    strUsage += HelpMessageOpt("-staking", strprintf(_("Stake wallet outputs to create proof-of-stake blocks (default: %u)"), DEFAULT_STAKING));
+    strUsage += HelpMessageOpt("-stakingthreads=<n>", strprintf(_("Set the number of kernel search threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+                                                                -GetNumCores(), MAX_STAKING_THREADS, DEFAULT_STAKING_THREADS));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
     strUsage += HelpMessageOpt("-usehd", _("Use hierarchical deterministic key generation (HD) after BIP32. Only has effect during wallet creation/first start") + " " + strprintf(_("(default: %u)"), DEFAULT_USE_HD_WALLET));
     strUsage += HelpMessageOpt("-walletrbf", strprintf(_("Send transactions with full-RBF opt-in enabled (default: %u)"), DEFAULT_WALLET_RBF));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
     strUsage += HelpMessageOpt("-walletbroadcast", _("Make the wallet broadcast transactions") + " " + strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
+    strUsage += HelpMessageOpt("-walletlog", strprintf(_("Keep the wallet in an append-only log file instead of Berkeley DB, converting an existing one and keeping the original as <file>.<time>.bak. Earlier versions cannot read log files (default: %u)"), DEFAULT_WALLET_LOG));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
                                " " + _("(1 = keep tx meta data e.g. account owner and payment request information, 2 = drop tx meta data)"));
@@ -3791,6 +4235,9 @@ void CWallet::postInitProcess(boost::thread_group& threadGroup)
     if (!CWallet::fFlushThreadRunning.exchange(true)) {
         threadGroup.create_thread(ThreadFlushWalletDB);
     }
+
+    // SolarCoin: search for proof-of-stake kernels if -staking
+    StartStaking(this, threadGroup);
 }
 
 bool CWallet::ParameterInteraction()
@@ -3893,8 +4340,7 @@ bool CWallet::BackupWallet(const std::string& strDest)
             if (!bitdb.mapFileUseCount.count(strWalletFile) || bitdb.mapFileUseCount[strWalletFile] == 0)
             {
                 // Flush log data to the dat file
-                bitdb.CloseDb(strWalletFile);
-                bitdb.CheckpointLSN(strWalletFile);
+                bitdb.FlushDb(strWalletFile);
                 bitdb.mapFileUseCount.erase(strWalletFile);
 
                 // Copy wallet file
@@ -378,18 +378,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -453,6 +442,21 @@ public:
 
 
 
+/**
+ * Fees that SelectCoinsMinConf uses to look for a selection that needs no
+ * change output before falling back to the knapsack solver.
+ */
+struct CCoinSelectionParams
+{
+    //! Fee of spending one more input; coins worth less are not used
+    CAmount nInputFee;
+    //! Fee of adding a change output now and of spending it later; a
+    //! selection that exceeds the target by at most this much is kept
+    //! without change
+    CAmount nCostOfChange;
+
+    CCoinSelectionParams(const CFeeRate& feeRate);
+};
 
 /** Private key that includes an expiration date in case it never gets used. */
 class CWalletKey
@@ -578,7 +582,7 @@ private:
      * all coins from coinControl are selected; Never select unconfirmed coins
      * if they are not ours
      */
-    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL) const;
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL, const CCoinSelectionParams* params = NULL) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -607,6 +611,21 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Index of the wallet transactions that can add to a balance or have coins
+     * to spend: those with outputs of ours that are not spent, and immature
+     * coinbases and coinstakes. All others (in a long lived wallet nearly all
+     * of its history) add nothing, so balance queries and AvailableCoins only
+     * look at these. Transactions are marked dirty whenever their outputs or
+     * the spends of them change (see CWalletTx::MarkDirty) and checked again
+     * on the next query; fWalletUnspentAllDirty rebuilds the index.
+     */
+    mutable std::set<uint256> setWalletUnspent;
+    mutable std::set<uint256> setWalletUnspentDirty;
+    mutable bool fWalletUnspentAllDirty;
+    bool MayHaveUnspent(const CWalletTx& wtx) const;
+    void UpdateWalletUnspent() const;
+
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
@@ -688,6 +707,7 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        fWalletUnspentAllDirty = true;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -720,9 +740,10 @@ public:
      * Shuffle and select coins until nTargetValue is reached while avoiding
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
-     * assembled
+     * assembled. With params, an exact match that needs no change output is
+     * searched for first (branch and bound).
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinSelectionParams* params = NULL) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -786,6 +807,8 @@ public:
     bool GetAccountPubkey(CPubKey &pubKey, std::string strAccount, bool bForceNew = false);
 
     void MarkDirty();
+    //! Have the index of unspent outputs check wallet transaction hash again
+    void MarkUnspentDirty(const uint256& hash) const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock) override;
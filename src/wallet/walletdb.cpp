@@ -220,7 +220,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error(std::string(__func__) + ": cannot create DB cursor");
     bool setRange = true;
@@ -237,7 +237,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error(std::string(__func__) + ": error scanning DB");
         }
 
@@ -256,7 +256,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    delete pcursor;
 }
 
 class CWalletScanState {
@@ -570,7 +570,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
@@ -611,7 +611,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        delete pcursor;
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -676,7 +676,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
@@ -710,7 +710,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        delete pcursor;
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -750,6 +750,7 @@ DBErrors CWalletDB::ZapSelectTx(CWallet* pwallet, vector<uint256>& vTxHashIn, ve
         }
         else if ((*it) == hash) {
             pwallet->mapWallet.erase(hash);
+            pwallet->MarkUnspentDirty(hash);
             if(!EraseTx(hash)) {
                 LogPrint("db", "Transaction was found for deletion but returned database error: %s\n", hash.GetHex());
                 delerror = true;
@@ -832,8 +833,7 @@ void ThreadFlushWalletDB()
                         int64_t nStart = GetTimeMillis();
 
                         // Flush wallet file so it's self contained
-                        bitdb.CloseDb(strFile);
-                        bitdb.CheckpointLSN(strFile);
+                        bitdb.FlushDb(strFile);
 
                         bitdb.mapFileUseCount.erase(_mi++);
                         LogPrint("db", "Flushed %s %dms\n", strFile, GetTimeMillis() - nStart);
@@ -859,9 +859,9 @@ bool CWalletDB::Recover(CDBEnv& dbenv, const std::string& filename, bool fOnlyKe
     int64_t now = GetTime();
     std::string newFilename = strprintf("wallet.%d.bak", now);
 
-    int result = dbenv.dbenv->dbrename(NULL, filename.c_str(), NULL,
-                                       newFilename.c_str(), DB_AUTO_COMMIT);
-    if (result == 0)
+    // Salvaged records of a log go into a log again
+    bool fLog = dbenv.IsLogFile(filename);
+    if (dbenv.RenameDb(filename, newFilename))
         LogPrintf("Renamed %s to %s\n", filename, newFilename);
     else
     {
@@ -878,14 +878,9 @@ bool CWalletDB::Recover(CDBEnv& dbenv, const std::string& filename, bool fOnlyKe
     }
     LogPrintf("Salvage(aggressive) found %u records\n", salvagedData.size());
 
-    std::unique_ptr<Db> pdbCopy(new Db(dbenv.dbenv, 0));
-    int ret = pdbCopy->open(NULL,               // Txn pointer
-                            filename.c_str(),   // Filename
-                            "main",             // Logical db name
-                            DB_BTREE,           // Database type
-                            DB_CREATE,          // Flags
-                            0);
-    if (ret > 0)
+    std::unique_ptr<CDBStore> pdbCopy(dbenv.OpenStore(filename, true, fLog));
+    std::unique_ptr<CDBTxn> ptxn(pdbCopy ? pdbCopy->TxnBegin() : NULL);
+    if (!ptxn)
     {
         LogPrintf("Cannot create database file %s\n", filename);
         return false;
@@ -893,7 +888,6 @@ bool CWalletDB::Recover(CDBEnv& dbenv, const std::string& filename, bool fOnlyKe
     CWallet dummyWallet;
     CWalletScanState wss;
 
-    DbTxn* ptxn = dbenv.TxnBegin();
     BOOST_FOREACH(CDBEnv::KeyValPair& row, salvagedData)
     {
         if (fOnlyKeys)
@@ -916,14 +910,15 @@ bool CWalletDB::Recover(CDBEnv& dbenv, const std::string& filename, bool fOnlyKe
                 continue;
             }
         }
-        Dbt datKey(&row.first[0], row.first.size());
-        Dbt datValue(&row.second[0], row.second.size());
-        int ret2 = pdbCopy->put(ptxn, &datKey, &datValue, DB_NOOVERWRITE);
-        if (ret2 > 0)
+        CDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
+        if (pdbCopy->Exists(ptxn.get(), ssKey))
+            continue;
+        if (!pdbCopy->Write(ptxn.get(), ssKey, ssValue, false))
             fSuccess = false;
     }
-    ptxn->commit(0);
-    pdbCopy->close(0);
+    ptxn->Commit();
+    pdbCopy->Close();
 
     return fSuccess;
 }